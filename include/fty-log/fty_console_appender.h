@@ -0,0 +1,130 @@
+/*  =========================================================================
+    fty_console_appender - Console appender never blocking the logging threads
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_CONSOLE_APPENDER_H_INCLUDED
+#define FTY_CONSOLE_APPENDER_H_INCLUDED
+
+#include "fty-log/fty_string_streambuf.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <log4cplus/appender.h>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Default size of the buffer holding the output the console can't take yet
+#define FTY_LOG_CONSOLE_DEFAULT_BUFFER (256 * 1024)
+
+namespace fty::logger {
+
+/*! \brief NonBlockingConsoleAppender
+  Console appender for a stdout/stderr which may stall (pipe to a stuck
+  journald or container runtime): the events are written without blocking,
+  what the console can't take is kept in a bounded buffer written as soon as
+  possible, and the events not fitting in the buffer are dropped, the number
+  of dropped bytes being reported in the output once it flows again.
+  FATAL events are not dropped for a full buffer: they wait for the console,
+  for FATAL_TIMEOUT_MS at most, then the oldest buffered events make room for
+  them (the older FATAL events last).
+
+  In a configuration file:
+    log4cplus.appender.console=fty::logger::NonBlockingConsoleAppender
+    log4cplus.appender.console.logToStdErr=true
+    log4cplus.appender.console.BufferSize=262144
+ */
+class NonBlockingConsoleAppender : public log4cplus::Appender
+{
+public:
+    // Write to an already open descriptor (STDOUT_FILENO, STDERR_FILENO, ...)
+    explicit NonBlockingConsoleAppender(int fd, size_t bufferSize = FTY_LOG_CONSOLE_DEFAULT_BUFFER);
+    explicit NonBlockingConsoleAppender(const log4cplus::helpers::Properties& properties);
+    ~NonBlockingConsoleAppender() override;
+
+    void close() override;
+
+    // Bytes and events dropped since the creation of the appender
+    uint64_t droppedBytes() const;
+    uint64_t droppedEvents() const;
+
+    // Make the appender available to log4cplus configuration files
+    static void registerFactory();
+
+    // Delay given to the console to take the buffered output when closing
+    static constexpr int CLOSE_TIMEOUT_MS = 1000;
+    // Delay given to the console to take a FATAL event
+    static constexpr int FATAL_TIMEOUT_MS = 1000;
+
+protected:
+    void append(const log4cplus::spi::InternalLoggingEvent& event) override;
+
+private:
+    enum class Mode
+    {
+        // Own non-blocking descriptor on the same pipe
+        Reopened,
+        // Socket written with MSG_DONTWAIT
+        Socket,
+        // Other files: written by chunks the descriptor is ready for
+        Polled
+    };
+
+    void   open(int fd, size_t bufferSize);
+    size_t writeSome(const char* data, size_t size);
+    // Write as much of the buffer as possible without blocking (under _mutex)
+    void flushPending();
+    // Wait for the console until the buffer is written or timeoutMs elapsed
+    void waitFlushed(std::unique_lock<std::mutex>& lock, int timeoutMs);
+    // Drop the oldest lines of the buffer beyond its size, keeping its first
+    // line, which may be partially written, and its last FATAL event (under _mutex)
+    void trimPending();
+    void flusher();
+
+    int    _fd;
+    int    _ownFd;
+    Mode   _mode;
+    size_t _bufferSize;
+
+    std::mutex              _mutex;
+    std::condition_variable _wakeUp;
+    std::thread             _flusher;
+    bool                    _stop;
+    std::string             _pending;
+    uint64_t                _unreportedBytes;
+    uint64_t                _unreportedEvents;
+    std::atomic<uint64_t>   _droppedBytes;
+    std::atomic<uint64_t>   _droppedEvents;
+
+    // Start and end in _pending of the FATAL events it holds
+    std::vector<std::pair<size_t, size_t>> _fatalEvents;
+
+    // Rendering of the current event (under the appender lock)
+    std::string     _line;
+    StringStreamBuf _streamBuf;
+    std::ostream    _stream;
+};
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,113 @@
+/*  =========================================================================
+    fty_journald_appender - Native journald appender
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_JOURNALD_APPENDER_H_INCLUDED
+#define FTY_JOURNALD_APPENDER_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <log4cplus/appender.h>
+#include <string>
+
+// Socket of the native protocol of systemd-journald
+#define FTY_LOG_JOURNALD_SOCKET "/run/systemd/journal/socket"
+
+namespace fty::logger {
+
+/*! \brief journaldFieldName
+  Turn a MDC key into a journal field name: upper case letters, digits and
+  underscores, not starting with an underscore or a digit, at most 64
+  characters.
+  \return the field name, empty if nothing is left of the key
+ */
+std::string journaldFieldName(const std::string& key);
+
+/*! \brief JournaldAppender
+  Sends each event to systemd-journald as a native structured entry, without
+  libsystemd:
+    MESSAGE            message of the event (the layout is not used)
+    PRIORITY           syslog priority of the level (FATAL 2, ERROR 3,
+                       WARN 4, INFO 6, DEBUG and TRACE 7)
+    CODE_FILE, CODE_LINE, CODE_FUNC
+                       source location of the log call
+    SYSLOG_IDENTIFIER  Identifier property, name of the program by default
+    FTY_LOGGER         name of the logger
+  and a field per entry of the mapped diagnostic context (see
+  Ftylog::setContext), named with journaldFieldName().
+  The entries too large for a datagram are passed in a sealed memfd.
+  Logging does not wait for a busy journald, except for ERROR events
+  (ERROR_TIMEOUT_MS at most) and FATAL events: the other events, and the
+  ERROR events journald did not take in time, are dropped and counted.
+
+  In a configuration file:
+    log4cplus.appender.journal=fty::logger::JournaldAppender
+    log4cplus.appender.journal.Identifier=fty-nut
+    log4cplus.appender.journal.SocketPath=/run/systemd/journal/socket
+ */
+class JournaldAppender : public log4cplus::Appender
+{
+public:
+    explicit JournaldAppender(
+        const std::string& identifier = std::string(), const std::string& socketPath = FTY_LOG_JOURNALD_SOCKET);
+    explicit JournaldAppender(const log4cplus::helpers::Properties& properties);
+    ~JournaldAppender() override;
+
+    void close() override;
+
+    // Events dropped since the creation of the appender, ERROR events included
+    uint64_t droppedEvents() const;
+    // ERROR events dropped after waiting for journald
+    uint64_t droppedErrors() const;
+
+    // Make the appender available to log4cplus configuration files
+    static void registerFactory();
+
+    // Delay given to a busy journald to take an ERROR event
+    static constexpr int ERROR_TIMEOUT_MS = 100;
+
+protected:
+    void append(const log4cplus::spi::InternalLoggingEvent& event) override;
+
+private:
+    void open(const std::string& identifier, const std::string& socketPath);
+    void addField(const char* fieldName, size_t nameSize, const char* value, size_t valueSize);
+    void addField(const std::string& fieldName, const std::string& value);
+    // Send the entry, waiting timeoutMs at most for a busy journald (-1: no limit)
+    bool send(int timeoutMs);
+    bool sendMemfd(int flags);
+    // Flags of the sends waiting timeoutMs at most
+    int waitFlags(int timeoutMs);
+
+    int         _socket;
+    int         _sendTimeoutMs;
+    std::string _socketPath;
+    std::string _identifier;
+
+    // Serialized entry of the current event (under the appender lock)
+    std::string _entry;
+
+    std::atomic<uint64_t> _droppedEvents;
+    std::atomic<uint64_t> _droppedErrors;
+};
+
+} // namespace fty::logger
+
+#endif
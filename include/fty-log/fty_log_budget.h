@@ -0,0 +1,124 @@
+/*  =========================================================================
+    fty_log_budget - Adaptive log volume budget
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_LOG_BUDGET_H_INCLUDED
+#define FTY_LOG_BUDGET_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <log4cplus/loglevel.h>
+#include <mutex>
+#include <string>
+
+namespace fty::logger {
+
+/*! \brief LogBudget
+  Volume budget of a logger, in events and bytes of message per second.
+  When an event exceeds the budget of the current second, the threshold is
+  raised one level above the current one (TRACE, DEBUG, INFO, WARN, up to
+  ERROR: ERROR and FATAL events are always printed) and a new second
+  starts. The threshold is lowered one level once the volume of the events
+  of that level (printed or dropped) stayed under half the budget for
+  QUIET_SECONDS seconds: the dropped events are counted by admits(), so the
+  threshold comes down even when no event is printed anymore.
+ */
+class LogBudget
+{
+public:
+    // A limit of 0 does not limit
+    LogBudget(uint64_t eventsPerSecond, uint64_t bytesPerSecond);
+
+    // Replace the limits, the threshold starting again from TRACE_LOG_LEVEL
+    void setLimits(uint64_t eventsPerSecond, uint64_t bytesPerSecond);
+
+    // Events of lower levels are dropped (TRACE_LOG_LEVEL: no event is)
+    log4cplus::LogLevel threshold() const
+    {
+        return _threshold.load(std::memory_order_relaxed);
+    }
+
+    /*! \brief admits
+      Whether an event of a level passes the threshold, for a logger of level
+      loggerLevel. A dropped event is counted, and ends the current second
+      if it is over.
+      \return true if the event passes; notice is set to a message describing
+              the change of the threshold if it changed
+     */
+    bool admits(log4cplus::LogLevel level, log4cplus::LogLevel loggerLevel, std::string& notice)
+    {
+        return level >= threshold() || admitsDropped(level, loggerLevel, std::chrono::steady_clock::now(), notice);
+    }
+    bool admits(log4cplus::LogLevel level, log4cplus::LogLevel loggerLevel, std::chrono::steady_clock::time_point now,
+        std::string& notice)
+    {
+        return level >= threshold() || admitsDropped(level, loggerLevel, now, notice);
+    }
+
+    /*! \brief account
+      Count a printed event of size bytes, for a logger of level loggerLevel.
+      \return true if the threshold changed, notice is then set to a message
+              describing the change
+     */
+    bool account(size_t size, log4cplus::LogLevel loggerLevel, std::string& notice);
+    bool account(size_t size, log4cplus::LogLevel loggerLevel, std::chrono::steady_clock::time_point now,
+        std::string& notice);
+
+    uint64_t eventsPerSecond() const
+    {
+        return _maxEvents.load(std::memory_order_relaxed);
+    }
+
+    uint64_t bytesPerSecond() const
+    {
+        return _maxBytes.load(std::memory_order_relaxed);
+    }
+
+    // Seconds under half the budget before the threshold is lowered
+    static constexpr int QUIET_SECONDS = 3;
+
+private:
+    bool overBudget(uint64_t events, uint64_t bytes) const;
+    bool admitsDropped(log4cplus::LogLevel level, log4cplus::LogLevel loggerLevel,
+        std::chrono::steady_clock::time_point now, std::string& notice);
+    // End the current second if it is over or over budget
+    bool update(log4cplus::LogLevel loggerLevel, int64_t nowMs, std::string& notice);
+
+    std::atomic<uint64_t> _maxEvents;
+    std::atomic<uint64_t> _maxBytes;
+
+    std::atomic<log4cplus::LogLevel> _threshold;
+    std::atomic<int64_t>             _secondStartMs;
+    std::atomic<uint64_t>            _events;
+    std::atomic<uint64_t>            _bytes;
+    // Dropped events of the level below the threshold
+    std::atomic<uint64_t> _droppedBelow;
+
+    // Changes of second and of threshold
+    std::mutex _mutex;
+    int        _quietSeconds;
+    // Average size of the printed events, to estimate the bytes of the dropped ones
+    uint64_t _averageSize;
+};
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,181 @@
+/*  =========================================================================
+    fty_log_capture - Capture and replay of the logging activity
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_LOG_CAPTURE_H_INCLUDED
+#define FTY_LOG_CAPTURE_H_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// First line of the capture files
+#define FTY_LOG_CAPTURE_MAGIC "# fty-log capture 1"
+
+class Ftylog;
+
+namespace fty::logger {
+
+// Call site of a capture: source location and a sample of its messages (its
+// format for the printf-like call sites)
+struct CaptureSite
+{
+    std::string file;
+    int         line;
+    std::string func;
+    std::string sample;
+};
+
+// One logged event of a capture
+struct CaptureEvent
+{
+    // Microseconds since the start of the capture
+    uint64_t timeUs;
+    // Thread id of the logging thread
+    uint32_t thread;
+    // Index of the call site
+    uint32_t site;
+    int      level;
+    // Size of the formatted message
+    uint32_t size;
+};
+
+// Content of a capture file
+struct Capture
+{
+    std::string               agent;
+    std::vector<CaptureSite>  sites;
+    std::vector<CaptureEvent> events;
+};
+
+/*! \brief LogCapture
+  Records a trace of the logging activity of a logger to a text file: the
+  call sites (file, line, function and a sample), then for each printed
+  event its time, thread, call site, level and message size. The sample of
+  a printf-like call site is its format; the messages are not recorded,
+  except for the other call sites (fmt, streams, dumps) which have no format:
+  the first SAMPLE_SIZE bytes of their first message are the sample. Events
+  with the same file and line but another function or format (a format
+  built at run time) have a call site of their own. Only the total size of
+  a message is recorded, not the sizes of its arguments.
+
+  The events are buffered per thread and written by blocks, so the logging
+  threads do not wait for each other: the events of the threads are not in
+  time order in the file (readCapture sorts them). The trace is written by
+  blocks of BUFFER_SIZE, on flush() and when the capture is destroyed.
+
+  File format (fields separated by tabs, texts escaped as by sanitize()):
+    # fty-log capture 1<TAB>agent
+    S<TAB>index<TAB>file<TAB>line<TAB>function<TAB>sample
+    E<TAB>time (us)<TAB>thread<TAB>site index<TAB>level<TAB>size
+ */
+class LogCapture
+{
+public:
+    // Start a capture (an existing file is replaced); nullptr if the file can't be created
+    static std::unique_ptr<LogCapture> create(const std::string& path, const std::string& agent);
+
+    ~LogCapture();
+    LogCapture(const LogCapture&) = delete;
+    LogCapture& operator=(const LogCapture&) = delete;
+
+    // Record a printed event; format is the printf-like format of the message, if any
+    void record(
+        int level, const char* file, int line, const char* func, const std::string& message, const char* format);
+
+    // Write the buffered trace
+    void flush();
+
+    const std::string& path() const;
+
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+    // Size of the per-thread buffers of events
+    static constexpr size_t THREAD_BUFFER_SIZE = 4 * 1024;
+    // Longest sample of the messages of a call site
+    static constexpr size_t SAMPLE_SIZE = 256;
+
+    struct ThreadBuffer;
+
+private:
+    LogCapture(const std::string& path, FILE* file);
+
+    // Index of a call site, its description added to the trace if new (under the lock)
+    uint32_t siteIndex(const char* file, int line, const char* func, const std::string& message, const char* format);
+    // Move the events buffered by the threads to the trace (under the lock)
+    void collect();
+    void writeBuffer();
+
+    const uint64_t                        _id;
+    std::string                           _path;
+    FILE*                                 _file;
+    std::chrono::steady_clock::time_point _start;
+
+    std::mutex _mutex;
+    // Call sites by file, line, function and format
+    std::map<std::tuple<std::string, int, std::string, std::string>, uint32_t> _sites;
+    std::string                                                                _buffer;
+    // Buffers of the threads which recorded events
+    std::vector<std::shared_ptr<ThreadBuffer>> _threads;
+};
+
+/*! \brief readCapture
+  Read a capture file: the texts are unescaped, the events sorted by time.
+  \return false if the file can't be read or is not a capture
+ */
+bool readCapture(const std::string& path, Capture& capture);
+
+struct ReplayOptions
+{
+    // Issue the events at the pace they were captured instead of as fast as possible
+    bool paced = false;
+    // Number of times the capture is replayed
+    unsigned repeat = 1;
+};
+
+// Measures of a replay
+struct ReplayResult
+{
+    uint64_t events  = 0;
+    uint64_t bytes   = 0;
+    double   seconds = 0;
+    // Durations of the logging calls, in nanoseconds, sorted
+    std::vector<uint64_t> latenciesNs;
+
+    // Duration of the logging calls below which the given percentage of them are
+    uint64_t percentile(double percent) const;
+};
+
+/*! \brief replayCapture
+  Issue the events of a capture again with a logger: one thread per captured
+  thread, each logging the events of its thread in order with the captured
+  level and call site, and a message of the captured size built from the
+  sample of the call site.
+ */
+ReplayResult replayCapture(Ftylog& log, const Capture& capture, const ReplayOptions& options = ReplayOptions());
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,52 @@
+/*  =========================================================================
+    fty_log_dump - Hex dumps of binary buffers
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_LOG_DUMP_H_INCLUDED
+#define FTY_LOG_DUMP_H_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+namespace fty::logger {
+
+/*! \brief hexEncode
+  Write the lower case hexadecimal form of data (2 * size characters, not
+  null-terminated) to out.
+ */
+void hexEncode(const void* data, size_t size, char* out);
+
+/*! \brief appendHexDump
+  Append to out the dump of the first maxBytes bytes of data, 16 bytes per
+  line (offset, bytes by groups of 4, printable ASCII), lines separated by
+  newlines, followed by a "[truncated: N more bytes]" line if data is larger.
+ */
+void appendHexDump(std::string& out, const void* data, size_t size, size_t maxBytes);
+
+/*! \brief payloadChunkEnd
+  End of the chunk of text starting at start, with at most chunkSize bytes:
+  after the last newline of the second half of the chunk if any, not in
+  the middle of a UTF-8 sequence otherwise.
+ */
+size_t payloadChunkEnd(const char* text, size_t size, size_t start, size_t chunkSize);
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,197 @@
+/*  =========================================================================
+    fty_log_filter - Filter rules evaluated before the messages are formatted
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_LOG_FILTER_H_INCLUDED
+#define FTY_LOG_FILTER_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include "fty-log/fty_log_reclaim.h"
+#include <log4cplus/loglevel.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace log4cplus::helpers {
+class Properties;
+}
+
+namespace fty::logger {
+
+/*! \brief FilterRule
+  Rule of a log filter, matching the events of a logger (or of its children)
+  up to a level, from a source file and function, logged with a MDC value.
+  Empty fields match any event.
+ */
+struct FilterRule
+{
+    std::string logger;
+    // Events of this level and of the lower levels
+    log4cplus::LogLevel level = log4cplus::FATAL_LOG_LEVEL;
+    // Path of the source file (__FILE__), or its end after a '/' (e.g. "nut_polling.cc")
+    std::string file;
+    std::string function;
+    std::string mdcKey;
+    std::string mdcValue;
+    // The matched events are printed instead of dropped
+    bool accept = false;
+};
+
+/*! \brief readFilterRules
+  Read the filter rules of a log configuration file:
+    ftylog.filter.default=accept|deny       (events matched by no rule, accept by default)
+    ftylog.filter.<N>.logger=<logger name>
+    ftylog.filter.<N>.level=<TRACE|DEBUG|INFO|WARN|ERROR|FATAL>
+    ftylog.filter.<N>.file=<source file>
+    ftylog.filter.<N>.function=<function>
+    ftylog.filter.<N>.mdc=<key>=<value>
+    ftylog.filter.<N>.action=accept|deny    (deny by default)
+  The rules are ordered by their number N.
+  \return false if the file holds no filter option
+ */
+bool readFilterRules(const log4cplus::helpers::Properties& properties, std::vector<FilterRule>& rules,
+    bool& acceptByDefault);
+
+/*! \brief LogFilter
+  Filter rules of a logger, evaluated before the message of an event is
+  formatted: the first rule matching the event decides whether it is
+  printed, the default decision applies when no rule matches.
+
+  The rules are compiled for the logger (rules of other loggers are left
+  out) into bits of 64-bit masks: the candidate rules of an event are the
+  rules matching the source file and function of its call site, a mask
+  cached by address of the __FILE__ and __func__ literals in a lock-free
+  table, so only the level and MDC conditions of the candidates are
+  evaluated per event. The texts are compared too, as an address which is
+  not a literal may be reused for other texts. A call site missing from
+  the table has its candidates computed again, without lock; the table
+  caches at most CALL_SITES_CACHED call sites, so texts at ever new
+  addresses never fill it up.
+  The events above the level of all the rules only cost a comparison.
+
+  The rules can be replaced at any time (e.g. by the watch of the log
+  configuration file); the previous compiled rules are deleted once no
+  thread evaluates them anymore (see ProtectedPointer).
+ */
+class LogFilter
+{
+public:
+    // Rules beyond this count are ignored
+    static constexpr size_t MAX_RULES = 64;
+
+    LogFilter(const std::string& logger, const std::vector<FilterRule>& rules, bool acceptByDefault = true);
+    ~LogFilter();
+    LogFilter(const LogFilter&) = delete;
+    LogFilter& operator=(const LogFilter&) = delete;
+
+    // Whether an event of a call site is printed
+    bool accepts(log4cplus::LogLevel level, const char* file, const char* func) const
+    {
+        ProtectedPointer<Rules> rules(_rules);
+        if (level > rules->maxLevel) {
+            return rules->acceptByDefault;
+        }
+        return decide(*rules.get(), level, file, func);
+    }
+
+    // Replace the rules, with hit counters starting from 0
+    void setRules(const std::vector<FilterRule>& rules, bool acceptByDefault = true);
+
+    std::vector<FilterRule> rules() const;
+    bool                    acceptByDefault() const;
+
+    // Events decided by each rule since the rules were set
+    std::vector<uint64_t> hits() const;
+
+    /*! \brief watchConfigFile
+      Read the rules of a log configuration file again when it is modified,
+      checking it every periodMs milliseconds.
+     */
+    void watchConfigFile(const std::string& path, unsigned periodMs = 60000);
+
+    // Stop reading the rules of the log configuration file again
+    void stopWatch();
+
+private:
+    struct CompiledRule
+    {
+        const FilterRule*   rule;
+        log4cplus::LogLevel level;
+        bool                accept;
+        bool                mdc;
+        // Index of the rule as given
+        size_t source;
+    };
+
+    // Candidate rules of a call site
+    struct CallSite
+    {
+        const char* file;
+        const char* func;
+        std::string fileText;
+        std::string funcText;
+        uint64_t    mask;
+    };
+
+    // Slots of the call sites table, and slots probed for a call site
+    static constexpr size_t CALL_SITES       = 1024;
+    static constexpr size_t CALL_SITE_PROBES = 16;
+    // Call sites cached at most in the table (the probes stay short)
+    static constexpr size_t CALL_SITES_CACHED = CALL_SITES / 2;
+
+    struct Rules
+    {
+        bool acceptByDefault;
+        // Highest level of the compiled rules (-1 if none)
+        log4cplus::LogLevel maxLevel;
+        // Rules as given, with their hit counters
+        std::vector<FilterRule>                  source;
+        std::unique_ptr<std::atomic<uint64_t>[]> hits;
+        // Compiled rules, bit i of the masks is compiled[i]
+        std::vector<CompiledRule> compiled;
+        // Call sites table (open addressing, call sites are only deleted with the rules)
+        std::unique_ptr<std::atomic<const CallSite*>[]> callSites;
+        std::atomic<size_t>                             callSitesCached{0};
+
+        ~Rules();
+    };
+
+    static bool     decide(Rules& rules, log4cplus::LogLevel level, const char* file, const char* func);
+    static uint64_t callSiteMask(Rules& rules, const char* file, const char* func);
+
+    const std::string   _logger;
+    std::atomic<Rules*> _rules;
+    // Serializes the replacements of the rules
+    std::mutex _mutex;
+
+    // Watch of the log configuration file
+    std::thread             _watch;
+    std::mutex              _watchMutex;
+    std::condition_variable _watchCondition;
+    bool                    _stopWatch = false;
+};
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,364 @@
+/*  =========================================================================
+    fty_log_format - Pre-parsed printf-like formats of the log_* macros
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_LOG_FORMAT_H_INCLUDED
+#define FTY_LOG_FORMAT_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace fty::logger {
+
+// Category of an argument of a printf-like format, after the default promotions
+enum class FormatArgKind : uint8_t
+{
+    None, // not supported by the pre-parsed formats
+    Signed,
+    Unsigned,
+    Double,
+    LongDouble,
+    String,
+    Pointer
+};
+
+template <typename T>
+constexpr FormatArgKind formatArgKind()
+{
+    using Type = std::decay_t<T>;
+    if constexpr (std::is_same_v<Type, bool>) {
+        return FormatArgKind::Signed;
+    } else if constexpr (std::is_enum_v<Type>) {
+        return formatArgKind<std::underlying_type_t<Type>>();
+    } else if constexpr (std::is_integral_v<Type>) {
+        return std::is_signed_v<Type> ? FormatArgKind::Signed : FormatArgKind::Unsigned;
+    } else if constexpr (std::is_same_v<Type, float> || std::is_same_v<Type, double>) {
+        return FormatArgKind::Double;
+    } else if constexpr (std::is_same_v<Type, long double>) {
+        return FormatArgKind::LongDouble;
+    } else if constexpr (std::is_same_v<Type, std::nullptr_t>) {
+        return FormatArgKind::Pointer;
+    } else if constexpr (std::is_pointer_v<Type>) {
+        using Pointee = std::remove_cv_t<std::remove_pointer_t<Type>>;
+        if constexpr (std::is_same_v<Pointee, char>) {
+            return FormatArgKind::String;
+        } else if constexpr (std::is_function_v<Pointee>) {
+            return FormatArgKind::None;
+        } else {
+            return FormatArgKind::Pointer;
+        }
+    } else {
+        return FormatArgKind::None;
+    }
+}
+
+// Argument of a pre-parsed format
+struct FormatArg
+{
+    FormatArgKind kind = FormatArgKind::None;
+    union
+    {
+        long long          i;
+        unsigned long long u;
+        double             d;
+        // Points to the argument, which outlives the logging call
+        const long double* ld;
+        const char*        s;
+        const void*        p;
+    };
+};
+
+template <typename T>
+FormatArg formatArg(const T& value)
+{
+    constexpr FormatArgKind kind = formatArgKind<T>();
+    static_assert(kind != FormatArgKind::None, "argument not supported by the pre-parsed formats");
+
+    FormatArg arg;
+    arg.kind = kind;
+    if constexpr (kind == FormatArgKind::Signed) {
+        arg.i = static_cast<long long>(value);
+    } else if constexpr (kind == FormatArgKind::Unsigned) {
+        arg.u = static_cast<unsigned long long>(value);
+    } else if constexpr (kind == FormatArgKind::Double) {
+        arg.d = value;
+    } else if constexpr (kind == FormatArgKind::LongDouble) {
+        arg.ld = &value;
+    } else if constexpr (kind == FormatArgKind::String) {
+        arg.s = value;
+    } else {
+        arg.p = value;
+    }
+    return arg;
+}
+
+/*! \brief FormatPiece
+  Conversion of a pre-parsed format with the literal text before it: the
+  text is at literalOffset in the format, the conversion specification
+  (from its '%', specSize characters) follows it.
+ */
+struct FormatPiece
+{
+    uint16_t literalOffset = 0;
+    uint16_t literalSize   = 0;
+    uint8_t  specSize      = 0;
+    // Conversion character, '%' for "%%" (no argument)
+    char conversion = 0;
+    // Length modifier: 0, 'H' (hh), 'h', 'l', 'q' (ll), 'L', 'j', 'z' or 't'
+    char length = 0;
+    // Neither flag, nor width nor precision
+    bool simple = false;
+};
+
+// Pre-parsed format as used by the renderer
+struct FormatView
+{
+    const char*        text;
+    const FormatPiece* pieces;
+    size_t             count;
+    // Literal text after the last conversion
+    size_t tailOffset;
+    size_t tailSize;
+};
+
+/*! \brief PreparsedFormat
+  printf-like format of N characters (with the terminating null) parsed in
+  its conversions, checked against the types of the arguments. Formats which
+  are not valid (unsupported conversion, e.g. "%n", "%m", "%*d" or "%1$d",
+  or an argument which does not match its conversion) are formatted by
+  vsnprintf as before. The format is copied: the one of a call is only
+  rendered with the pieces if it matches the copy, as the same call site
+  may be given other formats (template wrapper, array on the stack).
+ */
+template <size_t N>
+struct PreparsedFormat
+{
+    static constexpr bool PREPARSED = true;
+
+    bool        valid      = false;
+    char        text[N]    = {};
+    size_t      count      = 0;
+    size_t      tailOffset = 0;
+    size_t      tailSize   = 0;
+    // Each conversion takes two characters at least
+    FormatPiece pieces[N / 2 + 1] = {};
+
+    constexpr FormatView view() const
+    {
+        return {text, pieces, count, tailOffset, tailSize};
+    }
+
+    // Whether a format is the pre-parsed one
+    bool matches(const char (&format)[N]) const
+    {
+        return memcmp(text, format, N) == 0;
+    }
+};
+
+// Format which can't be pre-parsed: not a character array, or arguments not supported
+struct NotPreparsedFormat
+{
+    static constexpr bool PREPARSED = false;
+};
+
+// Length of the longest conversion specification of the pre-parsed formats
+constexpr size_t FORMAT_SPEC_MAX = 32;
+
+constexpr bool isFormatDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Whether a conversion with a length modifier takes an argument of a kind
+constexpr bool formatAccepts(char conversion, char length, FormatArgKind kind)
+{
+    bool integer = kind == FormatArgKind::Signed || kind == FormatArgKind::Unsigned;
+    switch (conversion) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            return integer && length != 'L';
+        case 'c':
+            return integer && length == 0;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (length == 'L') {
+                return kind == FormatArgKind::LongDouble;
+            }
+            return kind == FormatArgKind::Double && (length == 0 || length == 'l');
+        case 's':
+            return kind == FormatArgKind::String && length == 0;
+        case 'p':
+            return (kind == FormatArgKind::Pointer || kind == FormatArgKind::String) && length == 0;
+        default:
+            return false;
+    }
+}
+
+/*! \brief preparseFormat
+  Parse a printf-like format for arguments of types Args. Meant to be
+  evaluated at compile time, see log_macro.
+ */
+template <typename... Args, size_t N>
+constexpr PreparsedFormat<N> preparseFormat(const char (&text)[N])
+{
+    constexpr FormatArgKind kinds[] = {formatArgKind<Args>()..., FormatArgKind::None};
+    constexpr size_t        argCount = sizeof...(Args);
+
+    PreparsedFormat<N> format;
+    for (size_t c = 0; c < N; c++) {
+        format.text[c] = text[c];
+    }
+    if (N > UINT16_MAX) {
+        return format;
+    }
+
+    size_t arg     = 0;
+    size_t literal = 0;
+    size_t i       = 0;
+    while (i < N && text[i] != '\0') {
+        if (text[i] != '%') {
+            i++;
+            continue;
+        }
+
+        FormatPiece piece;
+        piece.literalOffset = uint16_t(literal);
+        piece.literalSize   = uint16_t(i - literal);
+        size_t spec         = i++;
+
+        bool flags = false;
+        while (i < N && (text[i] == '-' || text[i] == '+' || text[i] == ' ' || text[i] == '#' || text[i] == '0' ||
+                         text[i] == '\'')) {
+            flags = true;
+            i++;
+        }
+        bool width = false;
+        while (i < N && isFormatDigit(text[i])) {
+            width = true;
+            i++;
+        }
+        bool precision = false;
+        if (i < N && text[i] == '.') {
+            precision = true;
+            i++;
+            while (i < N && isFormatDigit(text[i])) {
+                i++;
+            }
+        }
+
+        if (i + 1 < N && text[i] == 'h' && text[i + 1] == 'h') {
+            piece.length = 'H';
+            i += 2;
+        } else if (i + 1 < N && text[i] == 'l' && text[i + 1] == 'l') {
+            piece.length = 'q';
+            i += 2;
+        } else if (i < N && (text[i] == 'h' || text[i] == 'l' || text[i] == 'L' || text[i] == 'q' || text[i] == 'j' ||
+                                text[i] == 'z' || text[i] == 't')) {
+            piece.length = text[i];
+            i++;
+        }
+
+        if (i >= N || text[i] == '\0') {
+            return format;
+        }
+        piece.conversion = text[i++];
+        piece.specSize   = uint8_t(i - spec < FORMAT_SPEC_MAX ? i - spec : FORMAT_SPEC_MAX);
+        piece.simple     = !flags && !width && !precision;
+
+        if (piece.conversion == '%') {
+            // "%%" only, glibc would accept "%5%" but it is not standard
+            if (i - spec != 2) {
+                return format;
+            }
+        } else {
+            // '*' and '$' (and %n, %m, wide characters...) land here
+            if (i - spec >= FORMAT_SPEC_MAX || arg >= argCount ||
+                !formatAccepts(piece.conversion, piece.length, kinds[arg])) {
+                return format;
+            }
+            arg++;
+        }
+        format.pieces[format.count++] = piece;
+        literal                       = i;
+    }
+
+    format.tailOffset = literal;
+    format.tailSize   = i - literal;
+    format.valid      = arg == argCount;
+    return format;
+}
+
+// Types of the arguments of a log_* macro, only used with decltype
+template <typename... Types>
+struct FormatTypes
+{
+};
+
+// The format keeps its array type; the arguments are taken by value (decayed),
+// so bit-fields and packed members, which no reference binds to, are accepted
+template <typename Text, typename... Types>
+FormatTypes<Text, Types...> formatTypes(Text&&, Types...);
+
+template <typename Types>
+struct PreparsedFormatOf;
+
+/*! \brief PreparsedFormatOf
+  Pre-parsed format of a log_* macro call with arguments of types Args, if
+  its format is a character array (usually a literal); text() returns the
+  format and is only called in that case.
+ */
+template <typename Text, typename... Args>
+struct PreparsedFormatOf<FormatTypes<Text, Args...>>
+{
+    template <typename TextOf>
+    static constexpr auto make(TextOf text)
+    {
+        using Array = std::remove_reference_t<Text>;
+        if constexpr (std::is_array_v<Array> && std::is_same_v<std::remove_extent_t<Array>, const char> &&
+                      ((formatArgKind<Args>() != FormatArgKind::None) && ...)) {
+            return preparseFormat<Args...>(text());
+        } else {
+            return NotPreparsedFormat();
+        }
+    }
+};
+
+/*! \brief renderFormat
+  Append a pre-parsed format with its arguments to out, as vsnprintf would
+  have formatted it.
+ */
+void renderFormat(std::string& out, const FormatView& format, const FormatArg* args);
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,191 @@
+/*  =========================================================================
+    fty_log_index - Sidecar time/level index of the log files
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_LOG_INDEX_H_INCLUDED
+#define FTY_LOG_INDEX_H_INCLUDED
+
+#include "fty-log/fty_shm_transport.h"
+#include "fty-log/fty_string_streambuf.h"
+#include <climits>
+#include <cstdint>
+#include <log4cplus/appender.h>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Default number of events described by one block of an index
+#define FTY_LOG_INDEX_DEFAULT_BLOCK_SIZE 256
+
+namespace fty::logger {
+
+// Path of the index of a log file
+std::string logIndexPath(const std::string& logPath);
+
+/*! \brief LogIndexWriter
+  Writes the sidecar index of a log file: a dictionary of the logger names
+  and blocks of consecutive events, each block holding its file offset, its
+  time span, a bitmap of the levels and of the loggers it contains, then the
+  size, timestamp, level and logger of each of its events. A reader skips
+  whole blocks out of the queried time range, levels or loggers.
+ */
+class LogIndexWriter
+{
+public:
+    explicit LogIndexWriter(const std::string& path, unsigned blockSize = FTY_LOG_INDEX_DEFAULT_BLOCK_SIZE);
+    ~LogIndexWriter();
+    LogIndexWriter(const LogIndexWriter&) = delete;
+    LogIndexWriter& operator=(const LogIndexWriter&) = delete;
+
+    // Describe an event written at offset in the log file
+    void add(uint64_t offset, uint32_t size, int64_t timestampUs, int level, const std::string& loggerName);
+    // Write the pending block
+    void flush();
+    // Write the pending block and start a new empty index (after a rotation)
+    void reopen();
+
+private:
+    struct Entry
+    {
+        uint32_t size;
+        uint16_t loggerId;
+        uint8_t  level;
+        int64_t  timestampUs;
+    };
+
+    void     open();
+    void     close();
+    uint16_t loggerId(const std::string& loggerName);
+    void     writeChunk(uint32_t type, const std::string& payload);
+
+    std::string                     _path;
+    unsigned                        _blockSize;
+    int                             _fd;
+    std::map<std::string, uint16_t> _loggers;
+    std::vector<Entry>              _entries;
+    uint64_t                        _blockOffset;
+    uint64_t                        _nextOffset;
+    int64_t                         _firstUs;
+    int64_t                         _lastUs;
+    std::string                     _chunk;
+};
+
+// Selection of the events of a log file
+struct LogIndexQuery
+{
+    int64_t fromUs   = INT64_MIN;
+    int64_t toUs     = INT64_MAX;
+    int     minLevel = 0;
+    // Empty: all the loggers
+    std::vector<std::string> loggers;
+};
+
+// Byte range of a log file
+struct LogIndexRange
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Part of a log file not described by its index (events not indexed yet, or
+// whose block was lost in a crash), with the time range its events can be in
+struct LogIndexGap
+{
+    uint64_t offset;
+    uint64_t size;
+    int64_t  fromUs;
+    int64_t  toUs;
+};
+
+// Append to ranges the parts of a log file selected by a query, read from the
+// index of the file. If gaps is set, append to it the parts of the first
+// fileSize bytes of the file not described by the index and which may hold
+// events of the query time range. Return false if the index can't be read.
+bool queryLogIndex(const std::string& indexPath, const LogIndexQuery& query, std::vector<LogIndexRange>& ranges,
+    std::vector<LogIndexGap>* gaps = nullptr, uint64_t fileSize = 0);
+
+/*! \brief IndexedRotatingFile
+  RotatingFile maintaining the index of the current file and of its backups
+  (file.idx, file.1.idx, ...), when indexing is enabled.
+ */
+class IndexedRotatingFile : public RotatingFile
+{
+public:
+    IndexedRotatingFile(const std::string& path, uint64_t maxFileSize, unsigned maxBackups, bool index,
+        unsigned blockSize = FTY_LOG_INDEX_DEFAULT_BLOCK_SIZE);
+    ~IndexedRotatingFile() override;
+
+    // Buffer an event and describe it in the index
+    void append(const char* data, size_t size, int64_t timestampUs, int level, const std::string& loggerName);
+    // Also write the pending block of the index
+    void flush() override;
+    void sync() override;
+
+protected:
+    void onRotate() override;
+
+private:
+    unsigned                        _maxBackups;
+    std::unique_ptr<LogIndexWriter> _index;
+};
+
+/*! \brief IndexedFileAppender
+  Size-rotated file appender writing the index of its files, to query them by
+  time range, level or logger with fty-log-query. With ImmediateFlush (the
+  default), each event is described in the index as soon as it is written;
+  otherwise the index is written by blocks of IndexBlockSize events (or of
+  one second), fty-log-query scanning the events not indexed yet.
+
+  In a configuration file:
+    log4cplus.appender.file=fty::logger::IndexedFileAppender
+    log4cplus.appender.file.File=/var/log/agent.log
+    log4cplus.appender.file.MaxFileSize=10MB
+    log4cplus.appender.file.MaxBackupIndex=3
+    log4cplus.appender.file.ImmediateFlush=true
+    log4cplus.appender.file.Index=true
+    log4cplus.appender.file.IndexBlockSize=256
+ */
+class IndexedFileAppender : public log4cplus::Appender
+{
+public:
+    explicit IndexedFileAppender(const log4cplus::helpers::Properties& properties);
+    ~IndexedFileAppender() override;
+
+    void close() override;
+
+    // Make the appender available to log4cplus configuration files
+    static void registerFactory();
+
+protected:
+    void append(const log4cplus::spi::InternalLoggingEvent& event) override;
+
+private:
+    std::unique_ptr<IndexedRotatingFile> _file;
+    bool                                 _immediateFlush;
+    std::string                          _line;
+    StringStreamBuf                      _streamBuf;
+    std::ostream                         _stream;
+};
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,129 @@
+/*  =========================================================================
+    fty_log_reclaim - Reclamation of the state read by the logging threads
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_LOG_RECLAIM_H_INCLUDED
+#define FTY_LOG_RECLAIM_H_INCLUDED
+
+#include <atomic>
+
+namespace fty::logger {
+
+// Free slot of the calling thread to protect a (non-null) pointer, nullptr if
+// it has none left (the protection is then counted for all the threads); a
+// slot is released by storing nullptr to it
+std::atomic<const void*>* acquireProtectionSlot();
+void                      releaseProtectionSlot(std::atomic<const void*>* slot);
+
+/*! \brief waitUnprotected
+  Wait until no thread protects pointer anymore. The pointer must have been
+  unpublished first (with a sequentially consistent store or exchange): it
+  can then be deleted.
+ */
+void waitUnprotected(const void* pointer);
+
+/*! \brief ProtectedPointer
+  Pointer loaded from an atomic the logging threads read without lock, and
+  which a writer may replace at any time: the object stays alive as long as
+  the ProtectedPointer does. Protecting costs a store to a slot of the
+  thread (hazard pointer), the writer replacing the object waits with
+  waitUnprotected() before deleting it. A thread may hold a few of them at
+  once.
+ */
+template <typename T>
+class ProtectedPointer
+{
+public:
+    explicit ProtectedPointer(const std::atomic<T*>& source)
+        : _pointer(source.load(std::memory_order_acquire))
+        , _slot(nullptr)
+        , _protected(false)
+    {
+        if (!_pointer) {
+            return;
+        }
+        _slot      = acquireProtectionSlot();
+        _protected = true;
+        if (!_slot) {
+            // Counted protection: read again once counted
+            _pointer = source.load(std::memory_order_seq_cst);
+            return;
+        }
+        // Still published once protected: the writer sees the protection
+        for (T* current; _pointer; _pointer = current) {
+            _slot->store(_pointer, std::memory_order_seq_cst);
+            current = source.load(std::memory_order_seq_cst);
+            if (current == _pointer) {
+                break;
+            }
+        }
+    }
+
+    ~ProtectedPointer()
+    {
+        if (_slot) {
+            _slot->store(nullptr, std::memory_order_release);
+        } else if (_protected) {
+            releaseProtectionSlot(nullptr);
+        }
+    }
+
+    ProtectedPointer(const ProtectedPointer&) = delete;
+    ProtectedPointer& operator=(const ProtectedPointer&) = delete;
+
+    T* get() const
+    {
+        return _pointer;
+    }
+
+    T* operator->() const
+    {
+        return _pointer;
+    }
+
+    explicit operator bool() const
+    {
+        return _pointer != nullptr;
+    }
+
+private:
+    T*                        _pointer;
+    std::atomic<const void*>* _slot;
+    bool                      _protected;
+};
+
+/*! \brief replaceProtected
+  Publish replacement in place of the current object of target, wait until
+  no thread protects the former one, and return it (to be deleted by the
+  caller). Writers are serialized by the caller.
+ */
+template <typename T>
+T* replaceProtected(std::atomic<T*>& target, T* replacement)
+{
+    T* former = target.exchange(replacement, std::memory_order_seq_cst);
+    if (former) {
+        waitUnprotected(former);
+    }
+    return former;
+}
+
+} // namespace fty::logger
+
+#endif
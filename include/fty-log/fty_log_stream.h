@@ -0,0 +1,134 @@
+/*  =========================================================================
+    fty_log_stream - Streaming logging API
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_LOG_STREAM_H_INCLUDED
+#define FTY_LOG_STREAM_H_INCLUDED
+
+#include <fmt/format.h>
+#include <iterator>
+#include <log4cplus/loglevel.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+class Ftylog;
+
+// Streaming logging with an explicit logger:
+//   FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylogger) << "device " << name << " replied " << code;
+// Nothing after the macro is evaluated when the level is disabled.
+#define FTY_LOG_STREAM_LOG(level, ftylogger)                                                                           \
+    !(ftylogger)->isLogLevel(level, __FILE__, __func__)                                                                \
+        ? (void)0                                                                                                      \
+        : fty::logger::LogStreamVoidify() & fty::logger::LogStream((ftylogger), (level), __FILE__, __LINE__, __func__)
+
+// Streaming logging with the default logger
+#define FTY_LOG_STREAM_TRACE FTY_LOG_STREAM_LOG(log4cplus::TRACE_LOG_LEVEL, ftylog_getInstance())
+#define FTY_LOG_STREAM_DEBUG FTY_LOG_STREAM_LOG(log4cplus::DEBUG_LOG_LEVEL, ftylog_getInstance())
+#define FTY_LOG_STREAM_INFO FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog_getInstance())
+#define FTY_LOG_STREAM_WARNING FTY_LOG_STREAM_LOG(log4cplus::WARN_LOG_LEVEL, ftylog_getInstance())
+#define FTY_LOG_STREAM_ERROR FTY_LOG_STREAM_LOG(log4cplus::ERROR_LOG_LEVEL, ftylog_getInstance())
+#define FTY_LOG_STREAM_FATAL FTY_LOG_STREAM_LOG(log4cplus::FATAL_LOG_LEVEL, ftylog_getInstance())
+
+namespace fty::logger {
+
+// True if a T can be written to a std::ostream
+template <typename T, typename = void>
+struct IsStreamable : std::false_type
+{
+};
+
+template <typename T>
+struct IsStreamable<T, std::void_t<decltype(std::declval<std::ostream&>() << std::declval<const T&>())>>
+    : std::true_type
+{
+};
+
+/*! \brief LogStream
+  Message of the streaming logging macros, built with operator<< into a
+  per-thread buffer (no stream is constructed per message) and printed when
+  the LogStream is destroyed, at the end of the logging statement.
+  Values are written with their operator<< if any, with their fmt formatter
+  otherwise. The formatting state of the stream (std::hex, precision, ...)
+  is reset for every message.
+ */
+class LogStream
+{
+public:
+    LogStream(Ftylog* log, log4cplus::LogLevel level, const char* file, int line, const char* func);
+    ~LogStream();
+
+    LogStream(const LogStream&) = delete;
+    LogStream& operator=(const LogStream&) = delete;
+
+    template <typename T>
+    LogStream& operator<<(const T& value)
+    {
+        if constexpr (IsStreamable<T>::value) {
+            *_stream << value;
+        } else {
+            static_assert(fmt::has_formatter<T, fmt::format_context>::value,
+                "the type has neither an operator<< nor a fmt formatter");
+            fmt::format_to(std::back_inserter(*_buffer), "{}", value);
+        }
+        return *this;
+    }
+
+    // Manipulators (std::endl, std::hex, ...)
+    LogStream& operator<<(std::ostream& (*manipulator)(std::ostream&))
+    {
+        manipulator(*_stream);
+        return *this;
+    }
+
+    LogStream& operator<<(std::ios_base& (*manipulator)(std::ios_base&))
+    {
+        manipulator(*_stream);
+        return *this;
+    }
+
+    struct Buffer;
+
+private:
+    Ftylog*             _log;
+    log4cplus::LogLevel _level;
+    const char*         _file;
+    int                 _line;
+    const char*         _func;
+    Buffer*             _used;
+    std::string*        _buffer;
+    std::ostream*       _stream;
+    // Buffer of a message built while another one is (an operator<< which logs)
+    std::unique_ptr<Buffer> _nested;
+};
+
+// Turns the streaming expression into void, for the level test of FTY_LOG_STREAM_LOG
+struct LogStreamVoidify
+{
+    void operator&(const LogStream&)
+    {
+    }
+};
+
+} // namespace fty::logger
+
+#endif
@@ -47,10 +47,18 @@
 
 #ifdef __cplusplus
 
+// The format, when it is a literal, is parsed at compile time for the types
+// of the arguments (see fty::logger::preparseFormat) and kept by the call site;
+// a call with another format (template wrapper, array on the stack) goes to insertLog
 #define log_macro(level, ftylogger, ...)                                                                               \
     do {                                                                                                               \
-        ftylogger->insertLog((level), __FILE__, __LINE__, __func__, __VA_ARGS__);                                      \
+        static const auto fty_log_preparsed_format_ =                                                                  \
+            ::fty::logger::PreparsedFormatOf<decltype(::fty::logger::formatTypes(__VA_ARGS__))>::make(                 \
+                [&]() -> decltype(auto) { return (FTY_LOG_FORMAT_OF(__VA_ARGS__, 0)); });                              \
+        ftylogger->insertLogPrintf(fty_log_preparsed_format_, (level), __FILE__, __LINE__, __func__, __VA_ARGS__);      \
     } while (0)
+
+#define FTY_LOG_FORMAT_OF(format, ...) format
 #else
 #define log_macro(level, ftylogger, ...)                                                                               \
     do {                                                                                                               \
@@ -96,6 +104,45 @@
 /* Prints message with FATAL level. 50000 <=> log4cplus::FATAL_LOG_LEVEL*/
 #define log_fatal(...) log_macro(50000, ftylog_getInstance(), __VA_ARGS__)
 
+// Dumps of binary buffers and large text payloads (see Ftylog::insertLogHexDump
+// and Ftylog::insertLogPayload); nothing is done when the level is disabled
+
+// Default limit of the bytes shown by a dump
+#define FTY_LOG_DUMP_DEFAULT_MAX (64 * 1024)
+
+// Size of the events a large text payload is split into
+#define FTY_LOG_PAYLOAD_CHUNK 4000
+
+#ifdef __cplusplus
+#define log_hexdump_log(level, ftylogger, title, data, size, maxBytes)                                                 \
+    do {                                                                                                               \
+        (ftylogger)->insertLogHexDump((level), __FILE__, __LINE__, __func__, (title), (data), (size), (maxBytes));     \
+    } while (0)
+#define log_payload_log(level, ftylogger, title, text, size, maxBytes)                                                 \
+    do {                                                                                                               \
+        (ftylogger)->insertLogPayload((level), __FILE__, __LINE__, __func__, (title), (text), (size), (maxBytes));     \
+    } while (0)
+#else
+#define log_hexdump_log(level, ftylogger, title, data, size, maxBytes)                                                 \
+    do {                                                                                                               \
+        ftylog_insertLogHexDump(ftylogger, (level), __FILE__, __LINE__, __func__, (title), (data), (size), (maxBytes)); \
+    } while (0)
+#define log_payload_log(level, ftylogger, title, text, size, maxBytes)                                                 \
+    do {                                                                                                               \
+        ftylog_insertLogPayload(ftylogger, (level), __FILE__, __LINE__, __func__, (title), (text), (size), (maxBytes)); \
+    } while (0)
+#endif
+
+/* Prints a hex dump of size bytes of data with the default logger */
+#define log_trace_hexdump(title, data, size) log_hexdump_log(0, ftylog_getInstance(), title, data, size, FTY_LOG_DUMP_DEFAULT_MAX)
+#define log_debug_hexdump(title, data, size) log_hexdump_log(10000, ftylog_getInstance(), title, data, size, FTY_LOG_DUMP_DEFAULT_MAX)
+#define log_info_hexdump(title, data, size) log_hexdump_log(20000, ftylog_getInstance(), title, data, size, FTY_LOG_DUMP_DEFAULT_MAX)
+
+/* Prints size bytes of text, split in several events if large, with the default logger */
+#define log_trace_payload(title, text, size) log_payload_log(0, ftylog_getInstance(), title, text, size, FTY_LOG_DUMP_DEFAULT_MAX)
+#define log_debug_payload(title, text, size) log_payload_log(10000, ftylog_getInstance(), title, text, size, FTY_LOG_DUMP_DEFAULT_MAX)
+#define log_info_payload(title, text, size) log_payload_log(20000, ftylog_getInstance(), title, text, size, FTY_LOG_DUMP_DEFAULT_MAX)
+
 #define LOG_START log_debug("start")
 
 #define LOG_END log_debug("end::normal")
@@ -107,7 +154,11 @@
 
 //  @interface
 #ifdef __cplusplus
+#include <atomic>
 #include <fmt/format.h>
+#include <memory>
+#include <vector>
+#include "fty-log/fty_log_format.h"
 // Log class
 
 #define logError(...)\
@@ -129,7 +180,7 @@
     fmtlog(log4cplus::TRACE_LOG_LEVEL, __VA_ARGS__)
 
 #define fmtlog(level, ...) \
-    ftylog_getInstance()->insertLog(level, __FILE__, __LINE__, __func__, fty::logger::format(__VA_ARGS__).c_str())
+    ftylog_getInstance()->insertLogFmt(level, __FILE__, __LINE__, __func__, __VA_ARGS__)
 
 namespace fty::logger {
 
@@ -146,6 +197,18 @@ inline std::string format(const std::string& str, const Args&... args)
 
 }
 
+namespace fty::logger {
+class LogStream;
+// Optional features, declared in their own headers
+class LogBudget;
+class LogCapture;
+class LogFilter;
+class SegmentFiles;
+class ShmTransport;
+struct FilterRule;
+struct LogOutputs;
+}
+
 class Ftylog
 {
 private:
@@ -159,17 +222,59 @@ private:
     log4cplus::Logger _logger;
     // Thread for watching modification of the log configuration file if any
     log4cplus::ConfigureAndWatchThread* _watchConfigFile;
+    // Outputs besides the appenders: shared memory transport to the log collector,
+    // per-thread segment files, layout of their lines and trace of the logging
+    // activity, nullptr if none is enabled (replaced as a whole while other
+    // threads log: read with fty::logger::ProtectedPointer, see fty_log_reclaim.h)
+    std::atomic<fty::logger::LogOutputs*> _outputs{nullptr};
+    // Console appenders never block on a stalled stdout/stderr
+    std::atomic<bool> _consoleNonBlocking{false};
+    // Messages are escaped for single-line output (read by the logging threads without lock)
+    std::atomic<bool> _sanitize{false};
+    // Volume budget raising the threshold of the events when exceeded, if any
+    // (created once and then changed in place: the logging threads read it without lock)
+    std::atomic<fty::logger::LogBudget*> _budget{nullptr};
+    // Filter rules evaluated before formatting, if any
+    // (created once and then changed in place: the logging threads read it without lock)
+    std::atomic<fty::logger::LogFilter*> _filter{nullptr};
 
     // Initialize the Ftylog object
     void init(std::string _component, std::string logConfigFile = "");
 
-    // Return true if level is included in the logger level
-    bool isLogLevel(log4cplus::LogLevel level);
+    // Format a fmt-style message (verbatim if args is null) and print it in the appenders;
+    // the level was checked by the caller
+    void insertLogFmtImpl(log4cplus::LogLevel level, const char* file, int line, const char* func,
+        fmt::string_view format, const fmt::format_args* args);
+
+    // Render a pre-parsed printf-like format and print it in the appenders
+    void insertLogPreparsed(log4cplus::LogLevel level, const char* file, int line, const char* func,
+        const fty::logger::FormatView& format, const fty::logger::FormatArg* args);
+
+    // Print a built message in the appenders (or send it to the log collector);
+    // format is the printf-like format of the message, if any, for the capture
+    void insertLogMessage(log4cplus::LogLevel level, const char* file, int line, const char* func,
+        const std::string& message, const char* format = nullptr);
+
+    // Print a final message (sanitized, accounted in the budget)
+    void printLogMessage(
+        log4cplus::LogLevel level, const char* file, int line, const char* func, const std::string& message);
+
+    // Enable the shared memory transport if BIOS_LOG_SHM_TRANSPORT is set
+    void setShmTransportFromEnv();
+
+    // Enable the segment files if BIOS_LOG_SEGMENT_DIR is set
+    void setSegmentFilesFromEnv();
+
+    // Capture the logging activity if BIOS_LOG_CAPTURE is set
+    void setCaptureFromEnv();
 
     // Set the console appender
     void setConsoleAppender();
 
-    // Remove instances of log4cplus::ConsoleAppender from a given logger
+    // Create a console appender of the current console mode
+    log4cplus::SharedAppenderPtr createConsoleAppender(bool logToStdErr);
+
+    // Remove instances of console appenders from a given logger
     static void removeConsoleAppenders(log4cplus::Logger logger);
 
     // Set log level with level from syslog.h
@@ -188,6 +293,12 @@ private:
     // Set needed variables from env
     void setLogLevelFromEnv();
     void setPatternFromEnv();
+    void setConsoleModeFromEnv();
+    void setSanitizeFromEnv();
+    void setBudgetFromEnv();
+
+    // Set the options of the logger found in the config file
+    void setOptionsFromConfigFile();
 
     // Load appenders from the config file
     // or set the default console appender if no can't load from the config file
@@ -219,6 +330,12 @@ public:
     void setLogLevelFatal();
     void setLogLevelOff();
 
+    // Return true if level is included in the logger level
+    bool isLogLevel(log4cplus::LogLevel level);
+
+    // Return true if level is included in the logger level and the filter rules print the events of the call site
+    bool isLogLevel(log4cplus::LogLevel level, const char* file, const char* func);
+
     // Check the log level
     bool isLogTrace();
     bool isLogDebug();
@@ -241,6 +358,79 @@ public:
     void insertLog(
         log4cplus::LogLevel level, const char* file, int line, const char* func, const char* format, va_list args);
 
+    /*! \brief insertLogPrintf
+      An internal logging function, used by the log_* macros: a pre-parsed
+      format is rendered without vsnprintf, other formats (including a format
+      not matching the pre-parsed one of the call site) go to insertLog.
+      \param preparsed - format pre-parsed for the arguments, see fty::logger::PreparsedFormatOf
+     */
+    template <typename Preparsed, typename Format, typename... Args>
+    void insertLogPrintf(const Preparsed& preparsed, log4cplus::LogLevel level, const char* file, int line,
+        const char* func, const Format& format, const Args&... args)
+    {
+        if constexpr (Preparsed::PREPARSED) {
+            if (preparsed.valid && preparsed.matches(format)) {
+                if (!isLogLevel(level, file, func)) {
+                    return;
+                }
+                const fty::logger::FormatArg values[] = {fty::logger::formatArg(args)..., fty::logger::FormatArg()};
+                insertLogPreparsed(level, file, line, func, preparsed.view(), values);
+                return;
+            }
+        }
+        insertLog(level, file, line, func, format, args...);
+    }
+
+    /*! \brief insertLogFmt
+      An internal logging function for fmt-style messages, use specific logError, logDebug macros!
+      The message is formatted into a reusable per-thread buffer and handed to log4cplus as is,
+      so no heap allocation happens for typical messages and the result is never reinterpreted
+      as a printf format.
+      \param level - level for message, see \ref log4cplus::logLevel
+      \param file - name of file issued print, usually content of __FILE__ macro
+      \param line - number of line, usually content of __LINE__ macro
+      \param func - name of function issued log, usually content of __func__ macro
+      \param format - fmt-like format string (printed verbatim when no argument is given)
+     */
+    template <typename... Args>
+    void insertLogFmt(log4cplus::LogLevel level, const char* file, int line, const char* func, fmt::string_view format,
+        const Args&... args)
+    {
+        // Check the level before building the arguments store
+        if (!isLogLevel(level, file, func)) {
+            return;
+        }
+        const auto       store = fmt::make_format_args(args...);
+        fmt::format_args formatArgs(store);
+        insertLogFmtImpl(level, file, line, func, format, &formatArgs);
+    }
+
+    void insertLogFmt(log4cplus::LogLevel level, const char* file, int line, const char* func, fmt::string_view message);
+
+    void vinsertLogFmt(log4cplus::LogLevel level, const char* file, int line, const char* func, fmt::string_view format,
+        fmt::format_args args);
+
+    /*! \brief insertLogHexDump
+      Print a hex dump of a binary buffer as one event: a "title (size bytes):"
+      line followed by lines of 16 bytes (offset, bytes by groups of 4,
+      printable ASCII). Only the first maxBytes bytes are dumped, a
+      "[truncated: N more bytes]" line ends the dump of larger buffers.
+      Nothing is done when the level is disabled. Use log_hexdump_log macros!
+     */
+    void insertLogHexDump(log4cplus::LogLevel level, const char* file, int line, const char* func, const char* title,
+        const void* data, size_t size, size_t maxBytes = FTY_LOG_DUMP_DEFAULT_MAX);
+
+    /*! \brief insertLogPayload
+      Print a large text (JSON document, ...) as "title: text", split in events
+      of at most FTY_LOG_PAYLOAD_CHUNK bytes ("title [2/5]: ...") cut after a
+      newline when possible, never in a UTF-8 sequence. Only the first
+      maxBytes bytes are printed, the last event of a larger text ends with
+      " [truncated: N more bytes]". Nothing is done when the level is
+      disabled. Use log_payload_log macros!
+     */
+    void insertLogPayload(log4cplus::LogLevel level, const char* file, int line, const char* func, const char* title,
+        const char* text, size_t size, size_t maxBytes = FTY_LOG_DUMP_DEFAULT_MAX);
+
     // Load a specific appender if verbose mode is set to true :
     // -Save the logger logging level and set it to TRACE logging level
     // -Remove an already existing ConsoleAppender
@@ -250,6 +440,113 @@ public:
     void setVerboseMode();
     void setVeboseMode() { setVerboseMode(); } // legacy misnomer
 
+    /**
+     * Send the events to the log collector (fty-log-collector) through a
+     * per-process shared memory ring instead of the appenders. Logging never
+     * blocks on the collector: the events are printed in the appenders when
+     * the collector is missing, late or does not keep up.
+     * The lines are rendered with the default layout pattern.
+     * @param prefix Prefix of the ring name, must match the collector one
+     *               (FTY_LOG_SHM_DEFAULT_PREFIX when not given)
+     * @return false if the ring can't be created
+     */
+    bool setShmTransport();
+    bool setShmTransport(const std::string& prefix);
+
+    /**
+     * Print the events in the appenders again.
+     */
+    void unsetShmTransport();
+
+    /**
+     * Write the events to per-thread segment files in a directory instead of
+     * the appenders: logging threads never wait for each other on a shared
+     * file. The records carry a sequence number and a timestamp, fty-log-merge
+     * merges the segments into one ordered log. The lines are rendered with
+     * the default layout pattern; the events are printed in the appenders
+     * when a segment can't be created. Also set by BIOS_LOG_SEGMENT_DIR.
+     * @param directory Directory of the segment files
+     * @return false if the directory is not writable
+     */
+    bool setSegmentFiles(const std::string& directory);
+
+    /**
+     * Print the events in the appenders again (the segments are flushed).
+     */
+    void unsetSegmentFiles();
+
+    /**
+     * Make the console appenders (default one and verbose mode one) write
+     * without ever blocking the logging threads on a stalled stdout/stderr:
+     * the output the console can't take is buffered (up to 256KiB), what
+     * does not fit is dropped and reported once the console flows again.
+     * FATAL events wait for the console (1 second at most), then take the
+     * room of the oldest buffered events. Also set by BIOS_LOG_CONSOLE_NONBLOCKING=true.
+     * @param nonBlocking true for non-blocking console appenders
+     */
+    void setConsoleNonBlocking(bool nonBlocking);
+
+    /**
+     * Escape the messages for single-line output: newlines, control
+     * characters and invalid UTF-8 bytes are printed as \n, \r, \t or \xHH.
+     * Messages without any of them are not copied. Also set by
+     * BIOS_LOG_SANITIZE=true or ftylog.sanitize=true in the config file.
+     * @param sanitize true to escape the messages
+     */
+    void setSanitize(bool sanitize);
+
+    /**
+     * Limit the volume of events printed per second. When the budget is
+     * exceeded, the events below the current threshold level are dropped
+     * (DEBUG first, then INFO, WARN, and up to ERROR: ERROR and FATAL events
+     * are always printed); the threshold is lowered back one level at a time
+     * once the volume stayed under half the budget for a few seconds. A
+     * notice is printed on every change. Dropped events cost nothing: they
+     * are not even formatted. Also set by BIOS_LOG_BUDGET_EVENTS and
+     * BIOS_LOG_BUDGET_BYTES, or ftylog.budget.events and ftylog.budget.bytes
+     * in the config file.
+     * @param eventsPerSecond Limit of events per second, 0 for no limit
+     * @param bytesPerSecond Limit of message bytes per second, 0 for no limit
+     */
+    void setBudget(uint64_t eventsPerSecond, uint64_t bytesPerSecond);
+
+    /**
+     * Record a trace of the logging activity to a file: call sites, then the
+     * time, thread, call site, level and message size of each printed event
+     * (not the messages). fty-log-replay issues the same activity again with
+     * any configuration and measures its throughput and latencies. Also set
+     * by BIOS_LOG_CAPTURE=<directory> (file <directory>/<agent>.<pid>.capture).
+     * @param path Capture file, replaced if it exists
+     * @return false if the file can't be created
+     */
+    bool setCapture(const std::string& path);
+
+    /**
+     * Stop the capture (the trace is written).
+     */
+    void unsetCapture();
+
+    /**
+     * Filter the events with rules on their logger, level, source file,
+     * function and MDC values, evaluated before the messages are formatted:
+     * the first matching rule decides whether an event is printed. Also set
+     * by the ftylog.filter.* options of the config file, read again when the
+     * file is modified (see fty::logger::readFilterRules).
+     * @param rules Rules in evaluation order
+     * @param acceptByDefault Whether the events matched by no rule are printed
+     */
+    void setFilter(const std::vector<fty::logger::FilterRule>& rules, bool acceptByDefault = true);
+
+    /**
+     * Remove the filter rules.
+     */
+    void unsetFilter();
+
+    /**
+     * Number of events decided by each filter rule since the rules were set.
+     */
+    std::vector<uint64_t> filterHits();
+
     /**
      * Set a context for a mapped diagnostic context (MDC)
      * @param contextParam The context params mapped.
@@ -260,6 +557,8 @@ public:
      * Clear the mapped diagnostic context.
      */
     static void clearContext();
+
+    friend class fty::logger::LogStream;
 };
 
 // singleton for logger managment
@@ -280,6 +579,8 @@ public:
     static void setInstanceFtylog(std::string componentName, std::string logConfigFile = "");
 };
 
+#include "fty-log/fty_log_stream.h"
+
 #else
 typedef struct Ftylog Ftylog;
 #endif
@@ -322,6 +623,12 @@ bool ftylog_isLogFatal(Ftylog* log);
 // Procedure to print the log in the appenders
 void ftylog_insertLog(Ftylog* log, int level, const char* file, int line, const char* func, const char* format, ...);
 
+// Procedures to print hex dumps and large text payloads in the appenders
+void ftylog_insertLogHexDump(Ftylog* log, int level, const char* file, int line, const char* func, const char* title,
+    const void* data, size_t size, size_t maxBytes);
+void ftylog_insertLogPayload(Ftylog* log, int level, const char* file, int line, const char* func, const char* title,
+    const char* text, size_t size, size_t maxBytes);
+
 // Load a specific appender if verbose mode is set to true :
 // -Save the logger logging level and set it to TRACE logging level
 // -Remove an already existing ConsoleAppender
@@ -0,0 +1,49 @@
+/*  =========================================================================
+    fty_sanitize - Escaping of message text for single-line output
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_SANITIZE_H_INCLUDED
+#define FTY_SANITIZE_H_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+namespace fty::logger {
+
+/*! \brief sanitizeOffset
+  Find the first byte of data which sanitize() escapes: control characters
+  (newlines included), backslashes, DEL, and bytes which are not part of a
+  valid UTF-8 sequence.
+  \return offset of the byte, size if the text has nothing to escape
+ */
+size_t sanitizeOffset(const char* data, size_t size);
+
+/*! \brief sanitize
+  Escape the text for single-line output: '\n', '\r', '\t' and '\\' become
+  "\\n", "\\r", "\\t" and "\\\\", the other bytes to escape "\\xHH", so the
+  escaping can be reversed. Valid UTF-8 is kept.
+  \return false if the text has nothing to escape (out is left untouched,
+          the text can be used as is), true if out was set to the escaped text
+ */
+bool sanitize(const char* data, size_t size, std::string& out);
+
+} // namespace fty::logger
+
+#endif
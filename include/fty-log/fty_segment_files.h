@@ -0,0 +1,184 @@
+/*  =========================================================================
+    fty_segment_files - Per-thread log segment files and their merge
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_SEGMENT_FILES_H_INCLUDED
+#define FTY_SEGMENT_FILES_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Magic starting the segment files
+#define FTY_LOG_SEGMENT_MAGIC "FTYSEG01"
+
+// Extension of the segment files
+#define FTY_LOG_SEGMENT_EXTENSION ".seg"
+
+namespace fty::logger {
+
+// One event read from a segment file
+struct SegmentRecord
+{
+    uint64_t    runId;
+    uint64_t    sequence;
+    int64_t     timestampUs;
+    int         level;
+    std::string line;
+};
+
+/*! \brief SegmentFiles
+  Writes the rendered events of each thread to its own segment file
+  (<directory>/<name>.<pid>.<serial>.seg), so that logging threads never
+  wait for each other on a shared file. Each segment starts with a header
+  (magic, run identifier, pid, tid) followed by records of a header of four
+  native-endian integers (line size, level, sequence, timestamp in
+  microseconds) and the rendered line. The sequence is shared by all the
+  threads of a run and gives the order of the events, which fty-log-merge
+  (or SegmentMerger) restores.
+
+  The records are buffered per thread and written when the buffer is full,
+  at once for ERROR and FATAL events, when the thread exits and at least
+  every FLUSH_INTERVAL_MS by a flusher thread: a crash loses at most the
+  last second of events below ERROR.
+
+  The child of a fork starts a new run, with its own segments: the
+  segments and the buffered records of the parent are left to it.
+ */
+class SegmentFiles
+{
+public:
+    // Start the segments of a run in a directory; nullptr if the directory is not writable
+    static std::shared_ptr<SegmentFiles> create(const std::string& directory, const std::string& name);
+
+    ~SegmentFiles();
+    SegmentFiles(const SegmentFiles&) = delete;
+    SegmentFiles& operator=(const SegmentFiles&) = delete;
+
+    // Append a rendered line to the segment of the calling thread, return
+    // false if it must be logged elsewhere (segment can't be created)
+    bool write(int64_t timestampUs, int level, const char* line, size_t size);
+
+    // Write the buffered records of all the threads
+    void flush();
+
+    const std::string& directory() const;
+    uint64_t           runId() const;
+
+    // Size of the per-thread buffers
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+    // Maximum delay before the buffered records are written
+    static constexpr int FLUSH_INTERVAL_MS = 1000;
+
+    struct Writer;
+
+private:
+    SegmentFiles(const std::string& directory, const std::string& name);
+
+    std::shared_ptr<Writer> createWriter();
+    void                    flusher();
+
+    // Handlers of fork(), for all the instances
+    static void prepareFork();
+    static void parentAfterFork();
+    static void childAfterFork();
+
+    const uint64_t _id;
+    std::string    _directory;
+    std::string    _name;
+    uint64_t       _runId;
+
+    std::atomic<uint64_t> _sequence{0};
+
+    // Writers of the threads, flushed by the flusher thread
+    std::mutex                           _mutex;
+    std::condition_variable              _wakeUp;
+    std::vector<std::shared_ptr<Writer>> _writers;
+    unsigned                             _serial;
+    bool                                 _stop;
+    std::thread                          _flusher;
+};
+
+/*! \brief SegmentReader
+  Sequential reader of the records of a segment file. Reading stops at the
+  first incomplete record (segment of a crashed process, or being written).
+ */
+class SegmentReader
+{
+public:
+    explicit SegmentReader(const std::string& path);
+    ~SegmentReader();
+    SegmentReader(const SegmentReader&) = delete;
+    SegmentReader& operator=(const SegmentReader&) = delete;
+
+    // False if the file can't be read or is not a segment
+    bool     valid() const;
+    uint64_t runId() const;
+    // Read the next record, false at the end of the segment
+    bool next(SegmentRecord& record);
+    // True if the segment ends with an incomplete record
+    bool truncated() const;
+
+private:
+    FILE*    _file;
+    uint64_t _runId;
+    bool     _valid;
+    bool     _truncated;
+};
+
+/*! \brief SegmentMerger
+  Merges segment files into one ordered stream of events: the events of a
+  run are given in sequence order, the runs (several processes, or restarts
+  of a process, writing to the same directory) are interleaved by timestamp.
+ */
+class SegmentMerger
+{
+public:
+    SegmentMerger();
+    ~SegmentMerger();
+    SegmentMerger(const SegmentMerger&) = delete;
+    SegmentMerger& operator=(const SegmentMerger&) = delete;
+
+    // Add a segment file, return false if it is not a readable segment
+    bool add(const std::string& path);
+    // Read the next event in order, false when all the segments are read
+    bool next(SegmentRecord& record);
+    // Paths of the segments ending with an incomplete record (known once read)
+    std::vector<std::string> truncated() const;
+
+private:
+    struct Input;
+    bool fill(Input& input);
+
+    std::vector<std::unique_ptr<Input>> _inputs;
+};
+
+// Segment files of a directory, sorted by name
+std::vector<std::string> segmentFiles(const std::string& directory);
+
+} // namespace fty::logger
+
+#endif
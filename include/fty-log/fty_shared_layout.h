@@ -0,0 +1,75 @@
+/*  =========================================================================
+    fty_shared_layout - Pattern layout rendering each event once per pattern
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_SHARED_LAYOUT_H_INCLUDED
+#define FTY_SHARED_LAYOUT_H_INCLUDED
+
+#include <cstdint>
+#include <log4cplus/layout.h>
+#include <memory>
+
+namespace fty::logger {
+
+/*! \brief SharedPatternLayout
+  A PatternLayout whose rendering is shared between all the layouts using the
+  same conversion pattern: when several appenders of a logger use it with an
+  identical pattern, an event is rendered once (by the first appender) and the
+  same bytes are written by the others. Only the events announced with
+  newEvent() (all the events of Ftylog) are shared, the other ones are
+  rendered by each layout.
+
+  In a configuration file:
+    log4cplus.appender.console.layout=fty::logger::SharedPatternLayout
+    log4cplus.appender.console.layout.ConversionPattern=[%-5p][%d] %m%n
+ */
+class SharedPatternLayout : public log4cplus::Layout
+{
+public:
+    explicit SharedPatternLayout(const log4cplus::tstring& pattern);
+    explicit SharedPatternLayout(const log4cplus::helpers::Properties& properties);
+    ~SharedPatternLayout() override;
+
+    void formatAndAppend(log4cplus::tostream& output, const log4cplus::spi::InternalLoggingEvent& event) override;
+
+    // Number of renderings really done by the calling thread
+    static uint64_t renderCount();
+
+    // Announce a new event (or new content of a reused event object) about to
+    // be given to the appenders by the calling thread
+    static void newEvent(const log4cplus::spi::InternalLoggingEvent& event);
+
+    // Make the layout available to log4cplus configuration files
+    static void registerFactory();
+
+private:
+    struct Pattern;
+
+    // Interned pattern, shared by all the layouts with the same conversion pattern
+    std::shared_ptr<const Pattern> _pattern;
+    // Renderer of this layout (used under the lock of its appender)
+    std::unique_ptr<log4cplus::Layout> _renderer;
+
+    void init(const log4cplus::tstring& pattern);
+};
+
+} // namespace fty::logger
+
+#endif
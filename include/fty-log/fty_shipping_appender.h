@@ -0,0 +1,153 @@
+/*  =========================================================================
+    fty_shipping_appender - Batched and compressed shipping of the logs
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_SHIPPING_APPENDER_H_INCLUDED
+#define FTY_SHIPPING_APPENDER_H_INCLUDED
+
+#include "fty-log/fty_string_streambuf.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <log4cplus/appender.h>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Magic of the batch frames ("FTYB")
+#define FTY_LOG_SHIPPING_MAGIC 0x46545942
+
+// Largest uncompressed batch of a frame (the queue of an appender is bounded by it)
+#define FTY_LOG_SHIPPING_MAX_BATCH (64 * 1024 * 1024)
+
+namespace fty::logger {
+
+/*! \brief decodeShippingFrame
+  Decode the first batch frame of data: a header of four 32-bit big-endian
+  integers (magic, compressed size, uncompressed size, number of events)
+  followed by the zlib-compressed rendered events.
+  \return size of the frame (lines and events are set), 0 if data does not
+          hold a whole frame yet, -1 if data is not a valid frame (or holds
+          a batch larger than FTY_LOG_SHIPPING_MAX_BATCH)
+ */
+long decodeShippingFrame(const char* data, size_t size, std::string& lines, uint32_t& events);
+
+/*! \brief ShippingAppender
+  Ships the rendered events to a remote collector over a persistent TCP
+  connection, by compressed batches. Logging never blocks: events are queued
+  in memory (dropped when the queue is full) and a sender thread builds the
+  batches, sends them, and spools them in a bounded local file while the
+  collector can't be reached, replaying the spool once reconnected. A batch
+  which can't be compressed is dropped. Spooled
+  batches are delivered at least once (a replay interrupted by a new
+  disconnection is started again); when the spool is full, its oldest half
+  is discarded.
+
+  In a configuration file:
+    log4cplus.appender.ship=fty::logger::ShippingAppender
+    log4cplus.appender.ship.Host=collector.local
+    log4cplus.appender.ship.Port=9555
+    log4cplus.appender.ship.BatchSize=256
+    log4cplus.appender.ship.BatchDelayMs=1000
+    log4cplus.appender.ship.QueueSize=1048576
+    log4cplus.appender.ship.SpoolFile=/var/spool/fty-log/agent.spool
+    log4cplus.appender.ship.SpoolMaxSize=16777216
+    log4cplus.appender.ship.ReconnectDelayMs=1000
+    log4cplus.appender.ship.CompressionLevel=6
+    log4cplus.appender.ship.layout=log4cplus::PatternLayout
+    log4cplus.appender.ship.layout.ConversionPattern=%D{%Y-%m-%dT%H:%M:%S.%q} %h %c [%p] %m%n
+ */
+class ShippingAppender : public log4cplus::Appender
+{
+public:
+    explicit ShippingAppender(const log4cplus::helpers::Properties& properties);
+    ~ShippingAppender() override;
+
+    void close() override;
+
+    // Counters of events since the creation of the appender (dropped: queue
+    // or spool full, compression failed)
+    uint64_t sentEvents() const;
+    uint64_t spooledEvents() const;
+    uint64_t droppedEvents() const;
+    bool     connected() const;
+
+    // Make the appender available to log4cplus configuration files
+    static void registerFactory();
+
+    // Limit of the connection and of each write to the collector
+    static constexpr int NETWORK_TIMEOUT_MS = 1000;
+
+protected:
+    void append(const log4cplus::spi::InternalLoggingEvent& event) override;
+
+private:
+    void        sender();
+    bool        buildFrame(const std::string& lines, uint32_t events);
+    bool        connect();
+    void        disconnect();
+    bool        sendAll(const char* data, size_t size);
+    bool        peerClosed();
+    void        ship(uint32_t events);
+    void        spool(uint32_t events);
+    bool        replaySpool();
+
+    // Configuration
+    std::string _host;
+    std::string _port;
+    size_t      _batchSize;
+    int         _batchDelayMs;
+    size_t      _queueSize;
+    std::string _spoolFile;
+    uint64_t    _spoolMaxSize;
+    int         _reconnectDelayMs;
+    int         _compressionLevel;
+
+    // Queue of rendered events, filled by append() and taken by the sender
+    std::mutex                            _mutex;
+    std::condition_variable               _wakeUp;
+    std::string                           _queue;
+    uint32_t                              _queueEvents;
+    std::chrono::steady_clock::time_point _queueSince;
+    bool                                  _stop;
+
+    // Sender state
+    std::thread                           _sender;
+    int                                   _socket;
+    std::chrono::steady_clock::time_point _nextConnect;
+    bool                                  _spoolPending;
+    std::string                           _frame;
+
+    std::atomic<uint64_t> _sentEvents;
+    std::atomic<uint64_t> _spooledEvents;
+    std::atomic<uint64_t> _droppedEvents;
+    std::atomic<bool>     _connected;
+
+    // Rendering of the current event (under the appender lock)
+    std::string     _line;
+    StringStreamBuf _streamBuf;
+    std::ostream    _stream;
+};
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,257 @@
+/*  =========================================================================
+    fty_shm_transport - Shared memory transport of the logs to a collector
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_SHM_TRANSPORT_H_INCLUDED
+#define FTY_SHM_TRANSPORT_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// Default prefix of the shared memory rings (/dev/shm/<prefix>.<pid>)
+#define FTY_LOG_SHM_DEFAULT_PREFIX "fty-log"
+
+// Default size of the ring of a process
+#define FTY_LOG_SHM_DEFAULT_CAPACITY (1024 * 1024)
+
+namespace fty::logger {
+
+struct ShmRingHeader;
+class IndexedRotatingFile;
+
+// One event read from a ring
+struct ShmRecord
+{
+    int64_t     timestampUs;
+    int         level;
+    std::string loggerName;
+    std::string line;
+};
+
+/*! \brief ShmRing
+  Single producer / single consumer ring buffer of rendered log lines in a
+  POSIX shared memory object. The producer is a logging process (callers
+  serialize the writes), the consumer is the collector. Both sides only use
+  atomics of the mapped header, neither of them ever blocks the other.
+ */
+class ShmRing
+{
+public:
+    // Create the ring of a producer (an existing ring of the same name is replaced)
+    static std::unique_ptr<ShmRing> create(const std::string& name, size_t capacity);
+    // Open the ring of a producer from the collector; nullptr if not a valid ring
+    static std::unique_ptr<ShmRing> open(const std::string& name);
+
+    ~ShmRing();
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    // Producer: append a record, return false if there is not enough room
+    bool write(int64_t timestampUs, int level, const std::string& loggerName, const char* line, size_t size);
+    // Consumer: move all the available records to out, return their number
+    size_t read(std::vector<ShmRecord>& out);
+
+    // Consumer: tell the producer that the collector is alive
+    void heartbeat();
+    // Producer: true if the collector gave a heartbeat in the last staleMs milliseconds
+    bool collectorAlive(uint64_t staleMs) const;
+
+    bool               empty() const;
+    pid_t              pid() const;
+    const std::string& name() const;
+    // Inode of the shared memory object, which differs for a re-created ring of the same name
+    ino_t              inode() const;
+    // Remove the shared memory object (the mapping stays valid)
+    void unlink();
+
+private:
+    ShmRing(const std::string& name, ino_t inode, void* mapping, size_t mappingSize);
+
+    std::string    _name;
+    ino_t          _inode;
+    void*          _mapping;
+    size_t         _mappingSize;
+    ShmRingHeader* _header;
+    char*          _data;
+};
+
+/*! \brief ShmTransport
+  Producer side of the transport: the ring of this process for a given
+  prefix, shared by all the Ftylog objects using it. Writes never block:
+  they fail when the collector is missing, late or not draining fast enough,
+  and the caller then falls back to its local appenders. In the child of a
+  fork() the transport is detached from the ring of the parent and always
+  fails: the child gets its own ring from get().
+ */
+class ShmTransport
+{
+public:
+    // Return the transport of this process for a prefix, creating its ring if needed
+    static std::shared_ptr<ShmTransport> get(
+        const std::string& prefix = FTY_LOG_SHM_DEFAULT_PREFIX, size_t capacity = FTY_LOG_SHM_DEFAULT_CAPACITY);
+
+    // Name of the ring of the process for a prefix
+    static std::string ringName(const std::string& prefix, pid_t pid);
+
+    ~ShmTransport();
+
+    // Send a rendered log line, return false if it must be logged locally
+    bool write(int64_t timestampUs, int level, const std::string& loggerName, const char* line, size_t size);
+
+    // True if the collector drains the ring
+    bool connected() const;
+
+    // Number of events which could not be sent and were logged locally
+    uint64_t fallbacks() const;
+
+    // Delay after which a collector not giving heartbeats is considered gone
+    static constexpr uint64_t COLLECTOR_TIMEOUT_MS = 3000;
+
+private:
+    explicit ShmTransport(std::unique_ptr<ShmRing> ring);
+
+    // Handlers of fork(), for all the transports
+    static void prepareFork();
+    static void parentAfterFork();
+    static void childAfterFork();
+
+    std::mutex               _mutex;
+    std::unique_ptr<ShmRing> _ring;
+    std::atomic<bool>        _detached{false};
+    std::atomic<uint64_t>    _fallbacks{0};
+};
+
+/*! \brief RotatingFile
+  Append-only log file written with batched I/O and rotated by size
+  (file -> file.1 -> ... -> file.<maxBackups>).
+ */
+class RotatingFile
+{
+public:
+    RotatingFile(const std::string& path, uint64_t maxFileSize, unsigned maxBackups);
+    virtual ~RotatingFile();
+    RotatingFile(const RotatingFile&) = delete;
+    RotatingFile& operator=(const RotatingFile&) = delete;
+
+    // Buffer data (rotating first if it does not fit in the current file),
+    // return its offset in the current file
+    uint64_t append(const char* data, size_t size);
+    // Write the buffered data
+    virtual void flush();
+    // Write the buffered data and commit it to the storage
+    virtual void sync();
+
+    bool               isOpen() const;
+    const std::string& path() const;
+    // Offset in the current file of the next appended byte
+    uint64_t           offset() const;
+
+protected:
+    // Called once the current file has been renamed to path.1 (and its backups
+    // shifted), before the new file is opened
+    virtual void onRotate();
+
+private:
+    void open();
+    void rotate();
+
+    std::string _path;
+    uint64_t    _maxFileSize;
+    unsigned    _maxBackups;
+    int         _fd;
+    uint64_t    _fileSize;
+    std::string _buffer;
+};
+
+/*! \brief ShmCollector
+  Collector side of the transport: discovers the rings of the producers,
+  drains them, merges their events in timestamp order and writes them to one
+  rotating store. Rings of dead processes are removed once drained, rings
+  removed or re-created by their producer are dropped once drained (the
+  re-created one is then attached on the same discovery).
+ */
+class ShmCollector
+{
+public:
+    struct Options
+    {
+        // Prefix of the rings to collect
+        std::string prefix = FTY_LOG_SHM_DEFAULT_PREFIX;
+        // Directory where POSIX shared memory objects are visible
+        std::string shmDirectory = "/dev/shm";
+        // Rotating store
+        std::string output      = "/var/log/fty-log-collector.log";
+        uint64_t    maxFileSize = 16 * 1024 * 1024;
+        unsigned    maxBackups  = 5;
+        // Events are held this long to be merged with late events of other processes
+        unsigned reorderWindowMs = 100;
+        // Maximum delay between two commits of the store to the storage
+        unsigned syncIntervalMs = 1000;
+        // Maintain the index of the store (see fty-log-query)
+        bool index = false;
+    };
+
+    explicit ShmCollector(const Options& options);
+    ~ShmCollector();
+
+    // One collection pass: discover rings, give heartbeats, drain and write
+    // the events older than the reorder window; return the number written
+    size_t poll();
+    // Write all the pending events, whatever their age
+    size_t flush();
+    // Poll every intervalMs until stop is set, then flush
+    void run(const std::atomic<bool>& stop, unsigned intervalMs = 50);
+
+    // Number of rings currently attached
+    size_t ringCount() const;
+
+private:
+    struct Pending
+    {
+        int64_t  timestampUs;
+        uint64_t sequence;
+        ShmRecord record;
+    };
+
+    void   discover();
+    void   drain();
+    // Move the available records of a ring to the pending events
+    void   read(ShmRing& ring);
+    size_t write(int64_t upToUs);
+
+    Options                                         _options;
+    std::unique_ptr<IndexedRotatingFile>            _store;
+    std::map<std::string, std::unique_ptr<ShmRing>> _rings;
+    std::vector<ShmRecord>                          _records;
+    std::vector<Pending>                            _pending;
+    uint64_t                                        _sequence;
+    uint64_t                                        _lastDiscoveryMs;
+    uint64_t                                        _lastSyncMs;
+};
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,61 @@
+/*  =========================================================================
+    fty_string_streambuf - Stream buffer appending to a std::string
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+#ifndef FTY_STRING_STREAMBUF_H_INCLUDED
+#define FTY_STRING_STREAMBUF_H_INCLUDED
+
+#include <streambuf>
+#include <string>
+
+namespace fty::logger {
+
+// Stream buffer appending what is written to a target std::string, which
+// keeps its memory from one use to the next (unlike std::ostringstream)
+class StringStreamBuf : public std::streambuf
+{
+public:
+    void setTarget(std::string* target)
+    {
+        _target = target;
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (c != traits_type::eof()) {
+            _target->push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override
+    {
+        _target->append(s, size_t(n));
+        return n;
+    }
+
+private:
+    std::string* _target = nullptr;
+};
+
+} // namespace fty::logger
+
+#endif
@@ -0,0 +1,355 @@
+/*  =========================================================================
+    fty_console_appender - Console appender never blocking the logging threads
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_console_appender - Console appender never blocking the logging threads
+@discuss
+    Setting O_NONBLOCK on stdout/stderr would change the open file
+    description shared with the rest of the process (and with the other
+    processes writing to the same pipe). Instead a pipe is opened again
+    through /proc/self/fd, which gives a non-blocking description of the
+    same pipe, a socket is written with MSG_DONTWAIT, and other files are
+    written by chunks of at most PIPE_BUF bytes once poll() tells they are
+    writable.
+    A flusher thread writes the buffered output when the console is ready
+    again, so that it does not wait for the next event.
+@end
+ */
+#include "fty-log/fty_console_appender.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <fcntl.h>
+#include <log4cplus/helpers/property.h>
+#include <log4cplus/layout.h>
+#include <log4cplus/loglevel.h>
+#include <log4cplus/spi/factory.h>
+#include <log4cplus/spi/loggingevent.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fty::logger {
+
+// Delay between two attempts of the flusher on a stalled console
+static constexpr int FLUSHER_POLL_MS = 100;
+
+// Line reporting the dropped output
+static constexpr const char* DROPPED_NOTICE = "fty-log: console output stalled, %llu bytes (%llu events) dropped\n";
+
+NonBlockingConsoleAppender::NonBlockingConsoleAppender(int fd, size_t bufferSize)
+    : _stream(&_streamBuf)
+{
+    open(fd, bufferSize);
+}
+
+NonBlockingConsoleAppender::NonBlockingConsoleAppender(const log4cplus::helpers::Properties& properties)
+    : log4cplus::Appender(properties)
+    , _stream(&_streamBuf)
+{
+    bool logToStdErr = false;
+    int  bufferSize  = FTY_LOG_CONSOLE_DEFAULT_BUFFER;
+    properties.getBool(logToStdErr, LOG4CPLUS_TEXT("logToStdErr"));
+    properties.getInt(bufferSize, LOG4CPLUS_TEXT("BufferSize"));
+    open(logToStdErr ? STDERR_FILENO : STDOUT_FILENO, size_t(std::max(bufferSize, 0)));
+}
+
+NonBlockingConsoleAppender::~NonBlockingConsoleAppender()
+{
+    destructorImpl();
+}
+
+void NonBlockingConsoleAppender::open(int fd, size_t bufferSize)
+{
+    _fd               = fd;
+    _ownFd            = -1;
+    _mode             = Mode::Polled;
+    _bufferSize       = bufferSize;
+    _stop             = false;
+    _unreportedBytes  = 0;
+    _unreportedEvents = 0;
+    _droppedBytes     = 0;
+    _droppedEvents    = 0;
+    _streamBuf.setTarget(&_line);
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        if (S_ISFIFO(st.st_mode)) {
+            std::string path  = "/proc/self/fd/" + std::to_string(fd);
+            int         ownFd = ::open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+            if (ownFd != -1) {
+                _fd    = ownFd;
+                _ownFd = ownFd;
+                _mode  = Mode::Reopened;
+            }
+        } else if (S_ISSOCK(st.st_mode)) {
+            _mode = Mode::Socket;
+        }
+    }
+
+    _flusher = std::thread(&NonBlockingConsoleAppender::flusher, this);
+}
+
+void NonBlockingConsoleAppender::close()
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_stop) {
+            return;
+        }
+        waitFlushed(lock, CLOSE_TIMEOUT_MS);
+        _stop = true;
+    }
+    _wakeUp.notify_all();
+    _flusher.join();
+    if (_ownFd != -1) {
+        ::close(_ownFd);
+        _ownFd = -1;
+    }
+    closed = true;
+}
+
+size_t NonBlockingConsoleAppender::writeSome(const char* data, size_t size)
+{
+    size_t written = 0;
+    while (written < size) {
+        ssize_t r = -1;
+        switch (_mode) {
+            case Mode::Reopened:
+                r = ::write(_fd, data + written, size - written);
+                break;
+            case Mode::Socket:
+                r = send(_fd, data + written, size - written, MSG_DONTWAIT | MSG_NOSIGNAL);
+                break;
+            case Mode::Polled: {
+                struct pollfd ready = {_fd, POLLOUT, 0};
+                if (poll(&ready, 1, 0) != 1 || !(ready.revents & POLLOUT)) {
+                    return written;
+                }
+                r = ::write(_fd, data + written, std::min<size_t>(size - written, PIPE_BUF));
+                break;
+            }
+        }
+        if (r > 0) {
+            written += size_t(r);
+        } else if (r == -1 && errno == EINTR) {
+            continue;
+        } else if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return written;
+        } else {
+            // Nobody will ever read it (closed pipe, ...): the output is lost
+            return size;
+        }
+    }
+    return written;
+}
+
+void NonBlockingConsoleAppender::flushPending()
+{
+    if (_pending.empty()) {
+        return;
+    }
+    size_t written = writeSome(_pending.data(), _pending.size());
+    _pending.erase(0, written);
+
+    auto left = _fatalEvents.begin();
+    for (auto& event : _fatalEvents) {
+        if (event.second > written) {
+            *left++ = {event.first > written ? event.first - written : 0, event.second - written};
+        }
+    }
+    _fatalEvents.erase(left, _fatalEvents.end());
+}
+
+void NonBlockingConsoleAppender::waitFlushed(std::unique_lock<std::mutex>& lock, int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (flushPending(); !_pending.empty(); flushPending()) {
+        auto left =
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            return;
+        }
+        int waitMs = int(std::min<int64_t>(left, FLUSHER_POLL_MS));
+        lock.unlock();
+        struct pollfd ready = {_fd, POLLOUT, 0};
+        poll(&ready, 1, waitMs);
+        lock.lock();
+    }
+}
+
+void NonBlockingConsoleAppender::trimPending()
+{
+    if (_pending.size() <= _bufferSize) {
+        return;
+    }
+
+    // Events of the buffer: its lines, a FATAL event being one whatever its lines
+    struct Event
+    {
+        size_t start;
+        size_t end;
+        bool   fatal;
+        bool   dropped;
+    };
+    std::vector<Event> events;
+    auto               fatal = _fatalEvents.begin();
+    for (size_t start = 0, end; start < _pending.size(); start = end) {
+        while (fatal != _fatalEvents.end() && fatal->second <= start) {
+            ++fatal;
+        }
+        bool isFatal = fatal != _fatalEvents.end() && fatal->first <= start;
+        if (isFatal) {
+            end = fatal->second;
+        } else {
+            end = _pending.find('\n', start);
+            end = end == std::string::npos ? _pending.size() : end + 1;
+        }
+        events.push_back(Event{start, end, isFatal, false});
+    }
+
+    // The oldest events make room, the FATAL ones only when the others are not enough
+    size_t size = _pending.size();
+    for (bool dropFatal : {false, true}) {
+        for (size_t i = 1; i + 1 < events.size() && size > _bufferSize; i++) {
+            Event& event = events[i];
+            if (event.fatal == dropFatal && !event.dropped) {
+                event.dropped = true;
+                size -= event.end - event.start;
+            }
+        }
+    }
+
+    std::string kept;
+    kept.reserve(size);
+    _fatalEvents.clear();
+    for (const Event& event : events) {
+        if (!event.dropped) {
+            if (event.fatal) {
+                _fatalEvents.emplace_back(kept.size(), kept.size() + event.end - event.start);
+            }
+            kept.append(_pending, event.start, event.end - event.start);
+            continue;
+        }
+        unsigned long long noticeBytes, noticeEvents;
+        if (sscanf(_pending.c_str() + event.start, DROPPED_NOTICE, &noticeBytes, &noticeEvents) == 2) {
+            // A dropped notice is reported again with the next one
+            _unreportedBytes += noticeBytes;
+            _unreportedEvents += noticeEvents;
+        } else {
+            _unreportedBytes += event.end - event.start;
+            _unreportedEvents++;
+            _droppedBytes += event.end - event.start;
+            _droppedEvents++;
+        }
+    }
+    _pending.swap(kept);
+}
+
+void NonBlockingConsoleAppender::flusher()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        flushPending();
+        if (_pending.empty()) {
+            _wakeUp.wait(lock);
+            continue;
+        }
+        lock.unlock();
+        struct pollfd ready = {_fd, POLLOUT, 0};
+        poll(&ready, 1, FLUSHER_POLL_MS);
+        lock.lock();
+    }
+}
+
+void NonBlockingConsoleAppender::append(const log4cplus::spi::InternalLoggingEvent& event)
+{
+    _line.clear();
+    layout->formatAndAppend(_stream, event);
+    const bool fatal = event.getLogLevel() >= log4cplus::FATAL_LOG_LEVEL;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_stop) {
+        return;
+    }
+    flushPending();
+
+    if (_unreportedBytes && (fatal || _pending.size() + _line.size() < _bufferSize)) {
+        char notice[128];
+        int  size = snprintf(notice, sizeof(notice), DROPPED_NOTICE, static_cast<unsigned long long>(_unreportedBytes),
+            static_cast<unsigned long long>(_unreportedEvents));
+        _pending.append(notice, size_t(std::max(size, 0)));
+        _unreportedBytes  = 0;
+        _unreportedEvents = 0;
+    }
+
+    if (_pending.empty() && !_unreportedBytes) {
+        // The rest of a partially written line is always kept
+        size_t written = writeSome(_line.data(), _line.size());
+        _pending.append(_line, written, std::string::npos);
+        if (fatal && !_pending.empty()) {
+            _fatalEvents.emplace_back(0, _pending.size());
+        }
+    } else if (fatal || _pending.size() + _line.size() <= _bufferSize) {
+        if (fatal) {
+            _fatalEvents.emplace_back(_pending.size(), _pending.size() + _line.size());
+        }
+        _pending.append(_line);
+        flushPending();
+    } else {
+        _unreportedBytes += _line.size();
+        _unreportedEvents++;
+        _droppedBytes += _line.size();
+        _droppedEvents++;
+    }
+
+    if (fatal) {
+        // A console stalled for good must not freeze the logging threads
+        waitFlushed(lock, FATAL_TIMEOUT_MS);
+        trimPending();
+    }
+    if (!_pending.empty()) {
+        _wakeUp.notify_one();
+    }
+}
+
+uint64_t NonBlockingConsoleAppender::droppedBytes() const
+{
+    return _droppedBytes.load();
+}
+
+uint64_t NonBlockingConsoleAppender::droppedEvents() const
+{
+    return _droppedEvents.load();
+}
+
+void NonBlockingConsoleAppender::registerFactory()
+{
+    log4cplus::spi::getAppenderFactoryRegistry().put(std::unique_ptr<log4cplus::spi::AppenderFactory>(
+        new log4cplus::spi::FactoryTempl<NonBlockingConsoleAppender, log4cplus::spi::AppenderFactory>(
+            LOG4CPLUS_TEXT("fty::logger::NonBlockingConsoleAppender"))));
+}
+
+} // namespace fty::logger
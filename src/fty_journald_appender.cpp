@@ -0,0 +1,318 @@
+/*  =========================================================================
+    fty_journald_appender - Native journald appender
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_journald_appender - Native journald appender
+@discuss
+    Implements the client side of the native journal protocol: an entry is
+    one datagram sent to the journal socket, holding one field per line as
+    NAME=value, or, for the values containing a newline, as NAME, a newline,
+    the size of the value as a 64-bit little-endian integer, the value and a
+    newline. The protocol has no batching: each event is its own datagram.
+    An entry larger than what the socket accepts is written to a memfd,
+    sealed, and its descriptor is sent instead.
+@end
+ */
+#include "fty-log/fty_journald_appender.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <log4cplus/helpers/property.h>
+#include <log4cplus/loglevel.h>
+#include <log4cplus/spi/factory.h>
+#include <log4cplus/spi/loggingevent.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace fty::logger {
+
+// Longest field name accepted by journald
+static constexpr size_t FIELD_NAME_MAX = 64;
+
+// Fields set by the appender itself, not overridden by the context
+static const char* const RESERVED_FIELDS[] = {
+    "MESSAGE", "PRIORITY", "CODE_FILE", "CODE_LINE", "CODE_FUNC", "SYSLOG_IDENTIFIER", "FTY_LOGGER"};
+
+std::string journaldFieldName(const std::string& key)
+{
+    std::string name;
+    for (char c : key) {
+        if (c >= 'a' && c <= 'z') {
+            c = char(c - 'a' + 'A');
+        } else if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+            c = '_';
+        }
+        // Names starting with an underscore are trusted fields set by journald
+        if (name.empty() && (c == '_' || (c >= '0' && c <= '9'))) {
+            continue;
+        }
+        name += c;
+    }
+    if (name.size() > FIELD_NAME_MAX) {
+        name.resize(FIELD_NAME_MAX);
+    }
+    return name;
+}
+
+// Syslog priority of a log4cplus level
+static int priority(log4cplus::LogLevel level)
+{
+    if (level >= log4cplus::FATAL_LOG_LEVEL) {
+        return 2;
+    }
+    if (level >= log4cplus::ERROR_LOG_LEVEL) {
+        return 3;
+    }
+    if (level >= log4cplus::WARN_LOG_LEVEL) {
+        return 4;
+    }
+    if (level >= log4cplus::INFO_LOG_LEVEL) {
+        return 6;
+    }
+    return 7;
+}
+
+JournaldAppender::JournaldAppender(const std::string& identifier, const std::string& socketPath)
+{
+    open(identifier, socketPath);
+}
+
+JournaldAppender::JournaldAppender(const log4cplus::helpers::Properties& properties)
+    : log4cplus::Appender(properties)
+{
+    open(properties.getProperty(LOG4CPLUS_TEXT("Identifier")),
+        properties.getProperty(LOG4CPLUS_TEXT("SocketPath"), LOG4CPLUS_TEXT(FTY_LOG_JOURNALD_SOCKET)));
+}
+
+JournaldAppender::~JournaldAppender()
+{
+    destructorImpl();
+}
+
+void JournaldAppender::open(const std::string& identifier, const std::string& socketPath)
+{
+    _socketPath    = socketPath;
+    _identifier    = identifier.empty() ? std::string(program_invocation_short_name) : identifier;
+    _droppedEvents = 0;
+    _droppedErrors = 0;
+    _socket        = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    _sendTimeoutMs = -1;
+}
+
+void JournaldAppender::close()
+{
+    if (_socket != -1) {
+        ::close(_socket);
+        _socket = -1;
+    }
+    closed = true;
+}
+
+void JournaldAppender::addField(const char* fieldName, size_t nameSize, const char* value, size_t valueSize)
+{
+    _entry.append(fieldName, nameSize);
+    if (!memchr(value, '\n', valueSize)) {
+        _entry += '=';
+        _entry.append(value, valueSize);
+        _entry += '\n';
+        return;
+    }
+
+    _entry += '\n';
+    uint64_t size = valueSize;
+    for (int i = 0; i < 8; i++) {
+        _entry += char(size >> (8 * i));
+    }
+    _entry.append(value, valueSize);
+    _entry += '\n';
+}
+
+void JournaldAppender::addField(const std::string& fieldName, const std::string& value)
+{
+    addField(fieldName.data(), fieldName.size(), value.data(), value.size());
+}
+
+int JournaldAppender::waitFlags(int timeoutMs)
+{
+    if (timeoutMs == 0) {
+        return MSG_DONTWAIT;
+    }
+    // A blocking send to a full journal queue waits up to the send timeout of the socket
+    if (timeoutMs != _sendTimeoutMs) {
+        struct timeval timeout = {};
+        timeout.tv_sec         = timeoutMs > 0 ? timeoutMs / 1000 : 0;
+        timeout.tv_usec        = timeoutMs > 0 ? (timeoutMs % 1000) * 1000 : 0;
+        if (setsockopt(_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1) {
+            return MSG_DONTWAIT;
+        }
+        _sendTimeoutMs = timeoutMs;
+    }
+    return 0;
+}
+
+bool JournaldAppender::send(int timeoutMs)
+{
+    struct sockaddr_un address = {};
+    address.sun_family         = AF_UNIX;
+    if (_socket == -1 || _socketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memcpy(address.sun_path, _socketPath.c_str(), _socketPath.size() + 1);
+
+    const int flags = MSG_NOSIGNAL | waitFlags(timeoutMs);
+    ssize_t   r;
+    do {
+        r = sendto(_socket, _entry.data(), _entry.size(), flags, reinterpret_cast<struct sockaddr*>(&address),
+            sizeof(address));
+    } while (r == -1 && errno == EINTR);
+    if (r != -1) {
+        return true;
+    }
+    if (errno == EMSGSIZE || errno == ENOBUFS) {
+        return sendMemfd(flags);
+    }
+    return false;
+}
+
+bool JournaldAppender::sendMemfd(int flags)
+{
+    int fd = memfd_create("fty-log-journal", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        return false;
+    }
+
+    bool   sent    = false;
+    size_t written = 0;
+    while (written < _entry.size()) {
+        ssize_t r = write(fd, _entry.data() + written, _entry.size() - written);
+        if (r <= 0 && errno != EINTR) {
+            break;
+        }
+        written += size_t(std::max<ssize_t>(r, 0));
+    }
+
+    // journald only reads sealed memfds
+    if (written == _entry.size()
+        && fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0) {
+        struct sockaddr_un address = {};
+        address.sun_family         = AF_UNIX;
+        memcpy(address.sun_path, _socketPath.c_str(), _socketPath.size() + 1);
+
+        union
+        {
+            struct cmsghdr header;
+            char           buffer[CMSG_SPACE(sizeof(int))];
+        } control = {};
+        struct msghdr message  = {};
+        message.msg_name       = &address;
+        message.msg_namelen    = sizeof(address);
+        message.msg_control    = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level     = SOL_SOCKET;
+        header->cmsg_type      = SCM_RIGHTS;
+        header->cmsg_len       = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+        ssize_t r;
+        do {
+            r = sendmsg(_socket, &message, flags);
+        } while (r == -1 && errno == EINTR);
+        sent = r != -1;
+    }
+
+    ::close(fd);
+    return sent;
+}
+
+void JournaldAppender::append(const log4cplus::spi::InternalLoggingEvent& event)
+{
+    _entry.clear();
+
+    const std::string& message = event.getMessage();
+    addField("MESSAGE", 7, message.data(), message.size());
+
+    char value[32];
+    int  size = snprintf(value, sizeof(value), "%d", priority(event.getLogLevel()));
+    addField("PRIORITY", 8, value, size_t(size));
+
+    if (!event.getFile().empty()) {
+        addField("CODE_FILE", event.getFile());
+        size = snprintf(value, sizeof(value), "%d", event.getLine());
+        addField("CODE_LINE", 9, value, size_t(size));
+    }
+    if (!event.getFunction().empty()) {
+        addField("CODE_FUNC", event.getFunction());
+    }
+    addField("SYSLOG_IDENTIFIER", _identifier);
+    addField("FTY_LOGGER", event.getLoggerName());
+
+    for (const auto& entry : event.getMDCCopy()) {
+        std::string fieldName = journaldFieldName(entry.first);
+        bool        reserved  = fieldName.empty();
+        for (const char* field : RESERVED_FIELDS) {
+            reserved = reserved || fieldName == field;
+        }
+        if (!reserved) {
+            addField(fieldName, entry.second);
+        }
+    }
+
+    // FATAL events wait for journald, ERROR events for a while, the others not at all
+    int timeoutMs = 0;
+    if (event.getLogLevel() >= log4cplus::FATAL_LOG_LEVEL) {
+        timeoutMs = -1;
+    } else if (event.getLogLevel() >= log4cplus::ERROR_LOG_LEVEL) {
+        timeoutMs = ERROR_TIMEOUT_MS;
+    }
+    if (!send(timeoutMs)) {
+        _droppedEvents++;
+        if (timeoutMs > 0) {
+            _droppedErrors++;
+        }
+    }
+}
+
+uint64_t JournaldAppender::droppedEvents() const
+{
+    return _droppedEvents.load();
+}
+
+uint64_t JournaldAppender::droppedErrors() const
+{
+    return _droppedErrors.load();
+}
+
+void JournaldAppender::registerFactory()
+{
+    log4cplus::spi::getAppenderFactoryRegistry().put(std::unique_ptr<log4cplus::spi::AppenderFactory>(
+        new log4cplus::spi::FactoryTempl<JournaldAppender, log4cplus::spi::AppenderFactory>(
+            LOG4CPLUS_TEXT("fty::logger::JournaldAppender"))));
+}
+
+} // namespace fty::logger
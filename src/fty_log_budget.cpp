@@ -0,0 +1,194 @@
+/*  =========================================================================
+    fty_log_budget - Adaptive log volume budget
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_log_budget - Adaptive log volume budget
+@discuss
+    The printed events are counted with relaxed atomic increments; the
+    mutex is only taken when a second ends or the budget is exceeded, and
+    a thread which can't take it right away does not wait (another one is
+    doing the change). The threshold is checked with the logger level,
+    before the message is built: the dropped events cost a comparison, a
+    relaxed increment and a clock read, which lets the threshold come down
+    when all the events are dropped.
+@end
+ */
+#include "fty-log/fty_log_budget.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace fty::logger {
+
+static const char* levelName(log4cplus::LogLevel level)
+{
+    switch (level) {
+        case log4cplus::DEBUG_LOG_LEVEL:
+            return "DEBUG";
+        case log4cplus::INFO_LOG_LEVEL:
+            return "INFO";
+        case log4cplus::WARN_LOG_LEVEL:
+            return "WARN";
+        case log4cplus::ERROR_LOG_LEVEL:
+            return "ERROR";
+        default:
+            return "TRACE";
+    }
+}
+
+LogBudget::LogBudget(uint64_t eventsPerSecond, uint64_t bytesPerSecond)
+    : _maxEvents(eventsPerSecond)
+    , _maxBytes(bytesPerSecond)
+    , _threshold(log4cplus::TRACE_LOG_LEVEL)
+    , _secondStartMs(0)
+    , _events(0)
+    , _bytes(0)
+    , _droppedBelow(0)
+    , _quietSeconds(0)
+    , _averageSize(0)
+{
+}
+
+void LogBudget::setLimits(uint64_t eventsPerSecond, uint64_t bytesPerSecond)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxEvents     = eventsPerSecond;
+    _maxBytes      = bytesPerSecond;
+    _threshold     = log4cplus::TRACE_LOG_LEVEL;
+    _secondStartMs = 0;
+    _events        = 0;
+    _bytes         = 0;
+    _droppedBelow  = 0;
+    _quietSeconds  = 0;
+}
+
+bool LogBudget::overBudget(uint64_t events, uint64_t bytes) const
+{
+    uint64_t maxEvents = _maxEvents.load(std::memory_order_relaxed);
+    uint64_t maxBytes  = _maxBytes.load(std::memory_order_relaxed);
+    return (maxEvents && events > maxEvents) || (maxBytes && bytes > maxBytes);
+}
+
+bool LogBudget::account(size_t size, log4cplus::LogLevel loggerLevel, std::string& notice)
+{
+    return account(size, loggerLevel, std::chrono::steady_clock::now(), notice);
+}
+
+bool LogBudget::account(
+    size_t size, log4cplus::LogLevel loggerLevel, std::chrono::steady_clock::time_point now, std::string& notice)
+{
+    int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+
+    uint64_t events = _events.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t bytes  = _bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    if (!overBudget(events, bytes) && nowMs < _secondStartMs.load(std::memory_order_relaxed) + 1000) {
+        return false;
+    }
+    return update(loggerLevel, nowMs, notice);
+}
+
+bool LogBudget::admitsDropped(log4cplus::LogLevel level, log4cplus::LogLevel loggerLevel,
+    std::chrono::steady_clock::time_point now, std::string& notice)
+{
+    log4cplus::LogLevel current = threshold();
+    if (level >= current - log4cplus::DEBUG_LOG_LEVEL) {
+        // Would be printed once the threshold is lowered
+        _droppedBelow.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+    if (nowMs >= _secondStartMs.load(std::memory_order_relaxed) + 1000) {
+        update(loggerLevel, nowMs, notice);
+    }
+    return level >= threshold();
+}
+
+bool LogBudget::update(log4cplus::LogLevel loggerLevel, int64_t nowMs, std::string& notice)
+{
+    std::unique_lock<std::mutex> lock(_mutex, std::try_to_lock);
+    if (!lock) {
+        return false;
+    }
+    int64_t  startMs = _secondStartMs.load();
+    uint64_t events  = _events.load();
+    uint64_t bytes   = _bytes.load();
+    bool     over    = overBudget(events, bytes);
+    if (!over && nowMs < startMs + 1000) {
+        // Changed by another thread meanwhile
+        return false;
+    }
+    if (events) {
+        _averageSize = bytes / events;
+    }
+
+    log4cplus::LogLevel previous = threshold();
+    log4cplus::LogLevel current  = previous;
+    if (over) {
+        _quietSeconds = 0;
+        log4cplus::LogLevel base = std::max(loggerLevel, previous);
+        if (base < log4cplus::ERROR_LOG_LEVEL) {
+            current = std::min<log4cplus::LogLevel>(
+                (base / log4cplus::DEBUG_LOG_LEVEL + 1) * log4cplus::DEBUG_LOG_LEVEL, log4cplus::ERROR_LOG_LEVEL);
+        }
+    } else if (previous != log4cplus::TRACE_LOG_LEVEL) {
+        // The dropped events of the level below count: they would be printed with a lower threshold
+        uint64_t dropped = _droppedBelow.load();
+        if (!overBudget(2 * (events + dropped), 2 * (bytes + dropped * _averageSize))) {
+            // The seconds without any event were quiet too
+            _quietSeconds += int(std::min<int64_t>((nowMs - startMs) / 1000, QUIET_SECONDS));
+        } else {
+            _quietSeconds = 0;
+        }
+        if (_quietSeconds >= QUIET_SECONDS) {
+            _quietSeconds = 0;
+            current       = previous - log4cplus::DEBUG_LOG_LEVEL;
+            if (current <= loggerLevel) {
+                current = log4cplus::TRACE_LOG_LEVEL;
+            }
+        }
+    }
+
+    _secondStartMs = nowMs;
+    _events        = 0;
+    _bytes         = 0;
+    _droppedBelow  = 0;
+    if (current == previous) {
+        return false;
+    }
+    _threshold = current;
+
+    char message[256];
+    if (over) {
+        snprintf(message, sizeof(message),
+            "log volume budget exceeded (%llu events, %llu bytes in %lld ms), events below %s are dropped",
+            static_cast<unsigned long long>(events), static_cast<unsigned long long>(bytes),
+            static_cast<long long>(std::min<int64_t>(nowMs - startMs, 1000)), levelName(current));
+    } else if (current != log4cplus::TRACE_LOG_LEVEL) {
+        snprintf(message, sizeof(message), "log volume back under budget, events below %s are dropped",
+            levelName(current));
+    } else {
+        snprintf(message, sizeof(message), "log volume back under budget, no event is dropped anymore");
+    }
+    notice = message;
+    return true;
+}
+
+} // namespace fty::logger
@@ -0,0 +1,475 @@
+/*  =========================================================================
+    fty_log_capture - Capture and replay of the logging activity
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_log_capture - Capture and replay of the logging activity
+@discuss
+    The capture is taken in Ftylog::insertLogMessage, so it sees the events
+    of all the logging paths (printf-like, fmt, streams, dumps) once their
+    level was checked; the events of disabled levels are not captured.
+    Each thread formats its events in a buffer of its own, and knows the
+    call sites it already used: the lock of the capture is only taken for a
+    new call site and to move a full buffer to the trace. The buffers of the
+    threads are found like the writers of the segment files: a thread-local
+    cache of buffers keyed by the never reused id of the capture.
+@end
+ */
+#include "fty-log/fty_log_capture.h"
+#include "fty-log/fty_logger.h"
+#include "fty-log/fty_sanitize.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fty::logger {
+
+struct LogCapture::ThreadBuffer
+{
+    std::mutex  mutex;
+    std::string events;
+    // Call sites already used by the thread, by the pointers of their texts,
+    // with a copy of the texts (only accessed by the thread)
+    struct KnownSite
+    {
+        std::string file;
+        std::string func;
+        std::string format;
+        uint32_t    index;
+    };
+    std::map<std::tuple<const char*, int, const char*, const char*>, KnownSite> sites;
+    // Set when the thread exits, or the capture is destroyed
+    std::atomic<bool> exited{false};
+    std::atomic<bool> closed{false};
+};
+
+namespace {
+
+// Event buffers of the calling thread
+struct CaptureCache
+{
+    struct Entry
+    {
+        uint64_t                                  owner;
+        std::shared_ptr<LogCapture::ThreadBuffer> buffer;
+    };
+    std::vector<Entry> entries;
+
+    ~CaptureCache();
+};
+
+// Set once the cache of the thread is destroyed (events logged later by other
+// thread-local destructors are added to the trace directly)
+thread_local bool         captureCacheDestroyed = false;
+thread_local CaptureCache captureCache;
+
+CaptureCache::~CaptureCache()
+{
+    // The events left are collected by the next flush of their capture
+    for (Entry& entry : entries) {
+        entry.buffer->exited = true;
+    }
+    captureCacheDestroyed = true;
+}
+
+// Identifiers of the LogCapture instances, never reused (unlike their addresses)
+std::atomic<uint64_t> nextCaptureId{1};
+
+} // namespace
+
+// Append a text as a field of the capture file
+static void appendField(std::string& out, const char* data, size_t size)
+{
+    std::string escaped;
+    if (sanitize(data, size, escaped)) {
+        // Tabs are escaped too, the fields stay separated
+        out += escaped;
+    } else {
+        out.append(data, size);
+    }
+}
+
+static uint32_t currentThreadId()
+{
+    thread_local uint32_t id = uint32_t(syscall(SYS_gettid));
+    return id;
+}
+
+static const char* orEmpty(const char* text)
+{
+    return text ? text : "";
+}
+
+// Reverse the escaping of a field by sanitize()
+static std::string unescapeField(const std::string& field)
+{
+    std::string text;
+    text.reserve(field.size());
+    for (size_t i = 0; i < field.size(); i++) {
+        if (field[i] != '\\' || i + 1 == field.size()) {
+            text += field[i];
+            continue;
+        }
+        char escaped = field[++i];
+        if (escaped == 'n') {
+            text += '\n';
+        } else if (escaped == 'r') {
+            text += '\r';
+        } else if (escaped == 't') {
+            text += '\t';
+        } else if (escaped == 'x' && i + 2 < field.size() && isxdigit(uint8_t(field[i + 1]))
+                   && isxdigit(uint8_t(field[i + 2]))) {
+            text += char(strtoul(field.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            text += escaped;
+        }
+    }
+    return text;
+}
+
+std::unique_ptr<LogCapture> LogCapture::create(const std::string& path, const std::string& agent)
+{
+    FILE* file = fopen(path.c_str(), "we");
+    if (!file) {
+        fprintf(stderr, "[ERROR]: %s:%d (%s) can't create %s: %s\n", __FILE__, __LINE__, __func__, path.c_str(),
+            strerror(errno));
+        return nullptr;
+    }
+    std::unique_ptr<LogCapture> capture(new LogCapture(path, file));
+    capture->_buffer += FTY_LOG_CAPTURE_MAGIC "\t";
+    appendField(capture->_buffer, agent.data(), agent.size());
+    capture->_buffer += '\n';
+    return capture;
+}
+
+LogCapture::LogCapture(const std::string& path, FILE* file)
+    : _id(nextCaptureId++)
+    , _path(path)
+    , _file(file)
+    , _start(std::chrono::steady_clock::now())
+{
+    _buffer.reserve(BUFFER_SIZE + 1024);
+}
+
+LogCapture::~LogCapture()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    collect();
+    for (const std::shared_ptr<ThreadBuffer>& buffer : _threads) {
+        buffer->closed = true;
+    }
+    writeBuffer();
+    fclose(_file);
+}
+
+const std::string& LogCapture::path() const
+{
+    return _path;
+}
+
+void LogCapture::record(
+    int level, const char* file, int line, const char* func, const std::string& message, const char* format)
+{
+    uint64_t timeUs = uint64_t(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count());
+
+    if (captureCacheDestroyed) {
+        // Logging from a thread-local destructor
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint32_t                    site = siteIndex(file, line, func, message, format);
+        char                        event[128];
+        int size = snprintf(event, sizeof(event), "E\t%llu\t%u\t%u\t%d\t%zu\n", static_cast<unsigned long long>(timeUs),
+            currentThreadId(), site, level, message.size());
+        _buffer.append(event, size_t(size));
+        return;
+    }
+
+    ThreadBuffer* buffer = nullptr;
+    for (const CaptureCache::Entry& entry : captureCache.entries) {
+        if (entry.owner == _id) {
+            buffer = entry.buffer.get();
+            break;
+        }
+    }
+    if (!buffer) {
+        // Forget the buffers of destroyed captures
+        auto& entries = captureCache.entries;
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                          [](const CaptureCache::Entry& entry) {
+                              return entry.buffer->closed.load();
+                          }),
+            entries.end());
+
+        std::shared_ptr<ThreadBuffer> created = std::make_shared<ThreadBuffer>();
+        created->events.reserve(THREAD_BUFFER_SIZE + 128);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _threads.push_back(created);
+        }
+        entries.push_back({_id, created});
+        buffer = created.get();
+    }
+
+    // The same pointer may be a reused buffer with another content: the texts
+    // are compared too
+    auto     key   = std::make_tuple(file, line, func, format);
+    auto     known = buffer->sites.find(key);
+    uint32_t site;
+    if (known != buffer->sites.end() && known->second.file == orEmpty(file) && known->second.func == orEmpty(func)
+        && known->second.format == orEmpty(format)) {
+        site = known->second.index;
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            site = siteIndex(file, line, func, message, format);
+        }
+        buffer->sites[key] = {orEmpty(file), orEmpty(func), orEmpty(format), site};
+    }
+
+    char event[128];
+    int  size = snprintf(event, sizeof(event), "E\t%llu\t%u\t%u\t%d\t%zu\n", static_cast<unsigned long long>(timeUs),
+        currentThreadId(), site, level, message.size());
+    {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        buffer->events.append(event, size_t(size));
+        if (buffer->events.size() < THREAD_BUFFER_SIZE) {
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        _buffer += buffer->events;
+        buffer->events.clear();
+    }
+    if (_buffer.size() >= BUFFER_SIZE) {
+        writeBuffer();
+    }
+}
+
+uint32_t LogCapture::siteIndex(
+    const char* file, int line, const char* func, const std::string& message, const char* format)
+{
+    auto inserted =
+        _sites.emplace(std::make_tuple(std::string(orEmpty(file)), line, std::string(orEmpty(func)),
+                           std::string(orEmpty(format))),
+            uint32_t(_sites.size()));
+    uint32_t site     = inserted.first->second;
+    if (inserted.second) {
+        _buffer += "S\t";
+        _buffer += std::to_string(site);
+        _buffer += '\t';
+        appendField(_buffer, file ? file : "", file ? strlen(file) : 0);
+        _buffer += '\t';
+        _buffer += std::to_string(line);
+        _buffer += '\t';
+        appendField(_buffer, func ? func : "", func ? strlen(func) : 0);
+        _buffer += '\t';
+        if (format) {
+            appendField(_buffer, format, std::min(strlen(format), SAMPLE_SIZE));
+        } else {
+            appendField(_buffer, message.data(), std::min(message.size(), SAMPLE_SIZE));
+        }
+        _buffer += '\n';
+    }
+    return site;
+}
+
+void LogCapture::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    collect();
+    writeBuffer();
+    fflush(_file);
+}
+
+void LogCapture::collect()
+{
+    for (const std::shared_ptr<ThreadBuffer>& buffer : _threads) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        _buffer += buffer->events;
+        buffer->events.clear();
+    }
+    // The buffers of exited threads are empty for good
+    _threads.erase(std::remove_if(_threads.begin(), _threads.end(),
+                       [](const std::shared_ptr<ThreadBuffer>& buffer) {
+                           return buffer->exited.load();
+                       }),
+        _threads.end());
+}
+
+void LogCapture::writeBuffer()
+{
+    if (fwrite(_buffer.data(), 1, _buffer.size(), _file) != _buffer.size()) {
+        fprintf(stderr, "[ERROR]: %s:%d (%s) can't write to %s: %s\n", __FILE__, __LINE__, __func__, _path.c_str(),
+            strerror(errno));
+    }
+    _buffer.clear();
+}
+
+// Split a line of the capture file in its tab separated fields
+static std::vector<std::string> splitFields(const std::string& line)
+{
+    std::vector<std::string> fields;
+    size_t                   start = 0;
+    for (size_t tab; (tab = line.find('\t', start)) != std::string::npos; start = tab + 1) {
+        fields.push_back(line.substr(start, tab - start));
+    }
+    fields.push_back(line.substr(start));
+    return fields;
+}
+
+bool readCapture(const std::string& path, Capture& capture)
+{
+    std::ifstream input(path);
+    std::string   line;
+    if (!std::getline(input, line) || line.compare(0, strlen(FTY_LOG_CAPTURE_MAGIC), FTY_LOG_CAPTURE_MAGIC) != 0) {
+        return false;
+    }
+    capture = Capture();
+    if (line.size() > strlen(FTY_LOG_CAPTURE_MAGIC)) {
+        capture.agent = unescapeField(line.substr(strlen(FTY_LOG_CAPTURE_MAGIC) + 1));
+    }
+
+    while (std::getline(input, line)) {
+        std::vector<std::string> fields = splitFields(line);
+        if (fields[0] == "S" && fields.size() == 6) {
+            if (strtoul(fields[1].c_str(), nullptr, 10) != capture.sites.size()) {
+                return false;
+            }
+            capture.sites.push_back({unescapeField(fields[2]), atoi(fields[3].c_str()), unescapeField(fields[4]),
+                unescapeField(fields[5])});
+        } else if (fields[0] == "E" && fields.size() == 6) {
+            CaptureEvent event;
+            event.timeUs = strtoull(fields[1].c_str(), nullptr, 10);
+            event.thread = uint32_t(strtoul(fields[2].c_str(), nullptr, 10));
+            event.site   = uint32_t(strtoul(fields[3].c_str(), nullptr, 10));
+            event.level  = atoi(fields[4].c_str());
+            event.size   = uint32_t(strtoul(fields[5].c_str(), nullptr, 10));
+            if (event.site >= capture.sites.size()) {
+                return false;
+            }
+            capture.events.push_back(event);
+        } else if (!line.empty()) {
+            // The last line of a capture still being written may be incomplete
+            if (input.peek() != EOF) {
+                return false;
+            }
+            break;
+        }
+    }
+    // The events are written by blocks per thread
+    std::stable_sort(capture.events.begin(), capture.events.end(),
+        [](const CaptureEvent& a, const CaptureEvent& b) {
+            return a.timeUs < b.timeUs;
+        });
+    return true;
+}
+
+uint64_t ReplayResult::percentile(double percent) const
+{
+    if (latenciesNs.empty()) {
+        return 0;
+    }
+    // Nearest rank
+    size_t rank = size_t(std::ceil(percent / 100 * double(latenciesNs.size())));
+    return latenciesNs[std::min(std::max<size_t>(rank, 1), latenciesNs.size()) - 1];
+}
+
+// Message of size bytes made of repetitions of a sample
+static void buildMessage(std::string& message, const std::string& sample, size_t size)
+{
+    message.clear();
+    if (sample.empty()) {
+        message.assign(size, 'x');
+        return;
+    }
+    while (message.size() < size) {
+        message.append(sample, 0, std::min(sample.size(), size - message.size()));
+    }
+}
+
+ReplayResult replayCapture(Ftylog& log, const Capture& capture, const ReplayOptions& options)
+{
+    // Events of each captured thread, in order
+    std::map<uint32_t, std::vector<const CaptureEvent*>> threads;
+    for (const CaptureEvent& event : capture.events) {
+        threads[event.thread].push_back(&event);
+    }
+    auto duration = std::chrono::microseconds(capture.events.empty() ? 0 : capture.events.back().timeUs + 1);
+
+    std::vector<std::vector<uint64_t>> latencies(threads.size());
+    std::vector<uint64_t>              bytes(threads.size(), 0);
+    std::vector<std::thread>           workers;
+    auto                               start = std::chrono::steady_clock::now();
+    size_t                             index = 0;
+    for (const auto& thread : threads) {
+        const std::vector<const CaptureEvent*>& events = thread.second;
+        workers.emplace_back([&, index] {
+            std::vector<uint64_t>& measured = latencies[index];
+            measured.reserve(events.size() * options.repeat);
+            std::string message;
+            for (unsigned round = 0; round < options.repeat; round++) {
+                for (const CaptureEvent* event : events) {
+                    const CaptureSite& site = capture.sites[event->site];
+                    buildMessage(message, site.sample, event->size);
+                    if (options.paced) {
+                        std::this_thread::sleep_until(
+                            start + duration * round + std::chrono::microseconds(event->timeUs));
+                    }
+
+                    auto before = std::chrono::steady_clock::now();
+                    log.insertLog(event->level, site.file.c_str(), site.line, site.func.c_str(), "%s", message.c_str());
+                    auto after = std::chrono::steady_clock::now();
+
+                    measured.push_back(
+                        uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()));
+                    bytes[index] += event->size;
+                }
+            }
+        });
+        index++;
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    ReplayResult result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (size_t i = 0; i < latencies.size(); i++) {
+        result.latenciesNs.insert(result.latenciesNs.end(), latencies[i].begin(), latencies[i].end());
+        result.bytes += bytes[i];
+    }
+    result.events = result.latenciesNs.size();
+    std::sort(result.latenciesNs.begin(), result.latenciesNs.end());
+    return result;
+}
+
+} // namespace fty::logger
@@ -0,0 +1,150 @@
+/*  =========================================================================
+    fty_log_dump - Hex dumps of binary buffers
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_log_dump - Hex dumps of binary buffers
+@discuss
+    The dump is written in place in the message buffer, which is resized
+    once to the final size. The bytes are hex encoded 16 at a time with SSE2
+    on x86-64 and NEON on AArch64 (nibbles turned into digits with a
+    comparison instead of a table lookup), with a table elsewhere.
+@end
+ */
+#include "fty-log/fty_log_dump.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace fty::logger {
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Bytes shown per line of a dump
+static constexpr size_t DUMP_LINE_BYTES = 16;
+// "00000000  00112233 44556677 8899aabb ccddeeff  |................|"
+static constexpr size_t DUMP_LINE_SIZE = 8 + 2 + 35 + 2 + 18;
+
+void hexEncode(const void* data, size_t size, char* out)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t         i     = 0;
+#if defined(__SSE2__)
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i nine   = _mm_set1_epi8(9);
+    const __m128i zero   = _mm_set1_epi8('0');
+    const __m128i letter = _mm_set1_epi8('a' - '0' - 10);
+    auto          digits = [&](__m128i values) {
+        return _mm_add_epi8(_mm_add_epi8(values, zero), _mm_and_si128(_mm_cmpgt_epi8(values, nine), letter));
+    };
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+        __m128i high  = digits(_mm_and_si128(_mm_srli_epi16(chunk, 4), nibble));
+        __m128i low   = digits(_mm_and_si128(chunk, nibble));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t nibble = vdupq_n_u8(0x0f);
+    const uint8x16_t nine   = vdupq_n_u8(9);
+    const uint8x16_t zero   = vdupq_n_u8('0');
+    const uint8x16_t letter = vdupq_n_u8('a' - '0' - 10);
+    auto             digits = [&](uint8x16_t values) {
+        return vaddq_u8(vaddq_u8(values, zero), vandq_u8(vcgtq_u8(values, nine), letter));
+    };
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t  chunk = vld1q_u8(bytes + i);
+        uint8x16x2_t pairs = {{digits(vshrq_n_u8(chunk, 4)), digits(vandq_u8(chunk, nibble))}};
+        vst2q_u8(reinterpret_cast<uint8_t*>(out + 2 * i), pairs);
+    }
+#endif
+    for (; i < size; i++) {
+        out[2 * i]     = HEX_DIGITS[bytes[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[bytes[i] & 0x0f];
+    }
+}
+
+void appendHexDump(std::string& out, const void* data, size_t size, size_t maxBytes)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t         shown = std::min(size, maxBytes);
+    size_t         lines = (shown + DUMP_LINE_BYTES - 1) / DUMP_LINE_BYTES;
+
+    size_t start = out.size();
+    out.resize(start + lines * (DUMP_LINE_SIZE + 1));
+    char* p = &out[start];
+    for (size_t offset = 0; offset < shown; offset += DUMP_LINE_BYTES) {
+        size_t count = std::min(DUMP_LINE_BYTES, shown - offset);
+        *p++         = '\n';
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            *p++ = HEX_DIGITS[(offset >> shift) & 0x0f];
+        }
+        *p++ = ' ';
+
+        char hex[2 * DUMP_LINE_BYTES];
+        hexEncode(bytes + offset, count, hex);
+        memset(hex + 2 * count, ' ', sizeof(hex) - 2 * count);
+        for (size_t group = 0; group < 4; group++) {
+            *p++ = ' ';
+            memcpy(p, hex + 8 * group, 8);
+            p += 8;
+        }
+
+        *p++ = ' ';
+        *p++ = ' ';
+        *p++ = '|';
+        for (size_t i = 0; i < DUMP_LINE_BYTES; i++) {
+            uint8_t c = i < count ? bytes[offset + i] : ' ';
+            *p++      = c >= 0x20 && c < 0x7f ? char(c) : '.';
+        }
+        *p++ = '|';
+    }
+
+    if (shown < size) {
+        out += "\n[truncated: ";
+        out += std::to_string(size - shown);
+        out += " more bytes]";
+    }
+}
+
+size_t payloadChunkEnd(const char* text, size_t size, size_t start, size_t chunkSize)
+{
+    size_t end = start + chunkSize;
+    if (end >= size) {
+        return size;
+    }
+    const void* newline = memrchr(text + start + chunkSize / 2, '\n', chunkSize - chunkSize / 2);
+    if (newline) {
+        return size_t(static_cast<const char*>(newline) - text) + 1;
+    }
+    while (end > start + 1 && (uint8_t(text[end]) & 0xc0) == 0x80) {
+        end--;
+    }
+    return end;
+}
+
+} // namespace fty::logger
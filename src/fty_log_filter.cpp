@@ -0,0 +1,304 @@
+/*  =========================================================================
+    fty_log_filter - Filter rules evaluated before the messages are formatted
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_log_filter - Filter rules evaluated before the messages are formatted
+@discuss
+    log4cplus filters see the events once their message was formatted; these
+    rules are evaluated by Ftylog::isLogLevel(level, file, func) first.
+@end
+ */
+#include "fty-log/fty_log_filter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <log4cplus/helpers/property.h>
+#include <log4cplus/mdc.h>
+#include <map>
+#include <sys/stat.h>
+
+namespace fty::logger {
+
+namespace {
+
+// path is file, or ends with "/file"
+bool fileMatches(const char* path, const std::string& file)
+{
+    size_t size = strlen(path);
+    if (size < file.size() || memcmp(path + size - file.size(), file.data(), file.size()) != 0) {
+        return false;
+    }
+    return size == file.size() || path[size - file.size() - 1] == '/';
+}
+
+bool mdcMatches(const FilterRule& rule)
+{
+    const log4cplus::MappedDiagnosticContextMap& context = log4cplus::getMDC().getContext();
+    auto                                         found   = context.find(rule.mdcKey);
+    return found != context.end() && found->second == rule.mdcValue;
+}
+
+std::string lowerCase(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) {
+        return char(std::tolower(c));
+    });
+    return text;
+}
+
+} // namespace
+
+bool readFilterRules(
+    const log4cplus::helpers::Properties& properties, std::vector<FilterRule>& rules, bool& acceptByDefault)
+{
+    log4cplus::helpers::Properties options = properties.getPropertySubset(LOG4CPLUS_TEXT("ftylog.filter."));
+    std::vector<log4cplus::tstring> names  = options.propertyNames();
+
+    rules.clear();
+    acceptByDefault = lowerCase(options.getProperty(LOG4CPLUS_TEXT("default"), LOG4CPLUS_TEXT("accept"))) != "deny";
+
+    std::map<unsigned long, FilterRule> numbered;
+    for (const log4cplus::tstring& name : names) {
+        size_t dot = name.find('.');
+        if (dot == 0 || dot == std::string::npos || name.find_first_not_of("0123456789") != dot) {
+            continue;
+        }
+        FilterRule&        rule  = numbered[strtoul(name.c_str(), nullptr, 10)];
+        std::string        key   = name.substr(dot + 1);
+        const std::string& value = options.getProperty(name);
+        if (key == "logger") {
+            rule.logger = value;
+        } else if (key == "level") {
+            std::string upper = value;
+            std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char c) {
+                return char(std::toupper(c));
+            });
+            log4cplus::LogLevel level = log4cplus::getLogLevelManager().fromString(LOG4CPLUS_TEXT(upper));
+            if (level == log4cplus::NOT_SET_LOG_LEVEL) {
+                fprintf(stderr, "[ERROR]: %s:%d (%s) invalid level of ftylog.filter.%s: %s\n", __FILE__, __LINE__,
+                    __func__, name.c_str(), value.c_str());
+            } else {
+                rule.level = level;
+            }
+        } else if (key == "file") {
+            rule.file = value;
+        } else if (key == "function") {
+            rule.function = value;
+        } else if (key == "mdc") {
+            size_t equal  = value.find('=');
+            rule.mdcKey   = value.substr(0, equal);
+            rule.mdcValue = equal == std::string::npos ? std::string() : value.substr(equal + 1);
+        } else if (key == "action") {
+            rule.accept = lowerCase(value) == "accept";
+        }
+    }
+    for (auto& rule : numbered) {
+        rules.push_back(rule.second);
+    }
+    return !names.empty();
+}
+
+LogFilter::LogFilter(const std::string& logger, const std::vector<FilterRule>& rules, bool acceptByDefault)
+    : _logger(logger)
+    , _rules(nullptr)
+{
+    setRules(rules, acceptByDefault);
+}
+
+LogFilter::~LogFilter()
+{
+    stopWatch();
+    delete _rules.load();
+}
+
+LogFilter::Rules::~Rules()
+{
+    for (size_t i = 0; i < CALL_SITES; i++) {
+        delete callSites[i].load();
+    }
+}
+
+void LogFilter::setRules(const std::vector<FilterRule>& rules, bool acceptByDefault)
+{
+    std::unique_ptr<Rules> compiled(new Rules());
+    compiled->callSites.reset(new std::atomic<const CallSite*>[CALL_SITES]);
+    for (size_t i = 0; i < CALL_SITES; i++) {
+        compiled->callSites[i] = nullptr;
+    }
+    compiled->acceptByDefault = acceptByDefault;
+    compiled->maxLevel        = -1;
+    compiled->source          = rules;
+    compiled->hits.reset(new std::atomic<uint64_t>[rules.size()]);
+
+    for (size_t i = 0; i < compiled->source.size(); i++) {
+        compiled->hits[i]      = 0;
+        const FilterRule& rule = compiled->source[i];
+        // Rules of the logger or of one of its parents
+        if (!rule.logger.empty() && _logger != rule.logger &&
+            _logger.compare(0, rule.logger.size() + 1, rule.logger + ".") != 0) {
+            continue;
+        }
+        if (compiled->compiled.size() == MAX_RULES) {
+            fprintf(stderr, "[ERROR]: %s:%d (%s) more than %zu filter rules for %s, the others are ignored\n",
+                __FILE__, __LINE__, __func__, MAX_RULES, _logger.c_str());
+            break;
+        }
+        compiled->compiled.push_back({&rule, rule.level, rule.accept, !rule.mdcKey.empty(), i});
+        compiled->maxLevel = std::max(compiled->maxLevel, rule.level);
+    }
+
+    // The events being filtered by other threads keep the former rules until they are decided
+    std::lock_guard<std::mutex> lock(_mutex);
+    delete replaceProtected(_rules, compiled.release());
+}
+
+// Candidate rules of a call site, cached on first use
+uint64_t LogFilter::callSiteMask(Rules& rules, const char* file, const char* func)
+{
+    auto candidates = [&rules, file, func]() {
+        uint64_t mask = 0;
+        for (size_t i = 0; i < rules.compiled.size(); i++) {
+            const FilterRule& rule = *rules.compiled[i].rule;
+            if ((rule.file.empty() || fileMatches(file, rule.file)) &&
+                (rule.function.empty() || rule.function == func)) {
+                mask |= uint64_t(1) << i;
+            }
+        }
+        return mask;
+    };
+
+    uintptr_t hash = (reinterpret_cast<uintptr_t>(file) >> 3) * 31 + (reinterpret_cast<uintptr_t>(func) >> 3);
+    hash ^= hash >> 10;
+    std::atomic<const CallSite*>* empty = nullptr;
+    for (size_t probe = 0; probe < CALL_SITE_PROBES; probe++) {
+        std::atomic<const CallSite*>& slot = rules.callSites[(hash + probe) % CALL_SITES];
+        const CallSite*               site = slot.load(std::memory_order_acquire);
+        if (!site) {
+            empty = &slot;
+            break;
+        }
+        if (site->file == file && site->func == func && strcmp(site->fileText.c_str(), file) == 0 &&
+            strcmp(site->funcText.c_str(), func) == 0) {
+            return site->mask;
+        }
+    }
+
+    // New call site, or texts at another address: cached if the table has room
+    uint64_t mask = candidates();
+    if (empty && rules.callSitesCached.load(std::memory_order_relaxed) < CALL_SITES_CACHED &&
+        rules.callSitesCached.fetch_add(1, std::memory_order_relaxed) < CALL_SITES_CACHED) {
+        // The slot may have been taken by another thread meanwhile
+        std::unique_ptr<CallSite> site(new CallSite{file, func, file, func, mask});
+        const CallSite*           expected = nullptr;
+        if (empty->compare_exchange_strong(expected, site.get(), std::memory_order_release, std::memory_order_relaxed)) {
+            site.release();
+        }
+    }
+    return mask;
+}
+
+bool LogFilter::decide(Rules& rules, log4cplus::LogLevel level, const char* file, const char* func)
+{
+    file = file ? file : "";
+    func = func ? func : "";
+
+    for (uint64_t candidates = callSiteMask(rules, file, func); candidates; candidates &= candidates - 1) {
+        const CompiledRule& rule = rules.compiled[size_t(__builtin_ctzll(candidates))];
+        if (level > rule.level || (rule.mdc && !mdcMatches(*rule.rule))) {
+            continue;
+        }
+        rules.hits[rule.source].fetch_add(1, std::memory_order_relaxed);
+        return rule.accept;
+    }
+    return rules.acceptByDefault;
+}
+
+std::vector<FilterRule> LogFilter::rules() const
+{
+    ProtectedPointer<Rules> rules(_rules);
+    return rules->source;
+}
+
+bool LogFilter::acceptByDefault() const
+{
+    ProtectedPointer<Rules> rules(_rules);
+    return rules->acceptByDefault;
+}
+
+std::vector<uint64_t> LogFilter::hits() const
+{
+    ProtectedPointer<Rules> rules(_rules);
+    std::vector<uint64_t> hits(rules->source.size());
+    for (size_t i = 0; i < hits.size(); i++) {
+        hits[i] = rules->hits[i].load(std::memory_order_relaxed);
+    }
+    return hits;
+}
+
+// Modification time and size of a file, to notice its changes
+static std::pair<int64_t, int64_t> fileVersion(const std::string& path)
+{
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) {
+        return {0, -1};
+    }
+    return {int64_t(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec, int64_t(status.st_size)};
+}
+
+void LogFilter::watchConfigFile(const std::string& path, unsigned periodMs)
+{
+    stopWatch();
+    _stopWatch = false;
+    _watch     = std::thread([this, path, periodMs, version = fileVersion(path)]() mutable {
+        std::unique_lock<std::mutex> lock(_watchMutex);
+        while (!_watchCondition.wait_for(lock, std::chrono::milliseconds(periodMs), [this] {
+            return _stopWatch;
+        })) {
+            auto current = fileVersion(path);
+            if (current == version || current.second < 0) {
+                continue;
+            }
+            version = current;
+
+            std::vector<FilterRule> rules;
+            bool                    acceptByDefault;
+            readFilterRules(log4cplus::helpers::Properties(LOG4CPLUS_TEXT(path)), rules, acceptByDefault);
+            setRules(rules, acceptByDefault);
+        }
+    });
+}
+
+void LogFilter::stopWatch()
+{
+    if (!_watch.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_watchMutex);
+        _stopWatch = true;
+    }
+    _watchCondition.notify_all();
+    _watch.join();
+}
+
+} // namespace fty::logger
@@ -0,0 +1,245 @@
+/*  =========================================================================
+    fty_log_format - Pre-parsed printf-like formats of the log_* macros
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_log_format - Pre-parsed printf-like formats of the log_* macros
+@discuss
+    The literal text and the simple conversions (%d, %u, %x, %s, %c... with
+    neither flag, width nor precision) are rendered directly; the others,
+    floating point ones in particular, by snprintf with the specification of
+    the single conversion, so the output is the one of vsnprintf with the
+    whole format.
+@end
+ */
+#include "fty-log/fty_log_format.h"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+
+namespace fty::logger {
+
+// Append a single conversion formatted by snprintf
+template <typename T>
+static void appendPrintf(std::string& out, const char* spec, T value)
+{
+    char local[128];
+    int  size = snprintf(local, sizeof(local), spec, value);
+    if (size < 0) {
+        return;
+    }
+    if (size_t(size) < sizeof(local)) {
+        out.append(local, size_t(size));
+        return;
+    }
+    size_t start = out.size();
+    out.resize(start + size_t(size));
+    snprintf(&out[start], size_t(size) + 1, spec, value);
+}
+
+template <typename T>
+static void appendInteger(std::string& out, T value, int base, bool upper)
+{
+    char local[24];
+    auto result = std::to_chars(local, local + sizeof(local), value, base);
+    if (upper) {
+        for (char* c = local; c < result.ptr; c++) {
+            if (*c >= 'a' && *c <= 'f') {
+                *c = char(*c - 'a' + 'A');
+            }
+        }
+    }
+    out.append(local, size_t(result.ptr - local));
+}
+
+// Signed conversion of an integer argument, as the length modifier reads it
+static void renderSigned(std::string& out, const char* spec, const FormatPiece& piece, const FormatArg& arg)
+{
+    long long value = arg.kind == FormatArgKind::Signed ? arg.i : static_cast<long long>(arg.u);
+    switch (piece.length) {
+        case 'H':
+            value = static_cast<signed char>(value);
+            break;
+        case 'h':
+            value = static_cast<short>(value);
+            break;
+        case 0:
+            value = static_cast<int>(value);
+            break;
+        case 'l':
+            value = static_cast<long>(value);
+            break;
+        case 'j':
+            value = static_cast<intmax_t>(value);
+            break;
+        case 'z':
+            value = static_cast<ssize_t>(value);
+            break;
+        case 't':
+            value = static_cast<ptrdiff_t>(value);
+            break;
+        default:
+            break;
+    }
+
+    if (piece.simple) {
+        appendInteger(out, value, 10, false);
+        return;
+    }
+    switch (piece.length) {
+        case 'l':
+            appendPrintf(out, spec, static_cast<long>(value));
+            break;
+        case 'q':
+            appendPrintf(out, spec, value);
+            break;
+        case 'j':
+            appendPrintf(out, spec, static_cast<intmax_t>(value));
+            break;
+        case 'z':
+            appendPrintf(out, spec, static_cast<ssize_t>(value));
+            break;
+        case 't':
+            appendPrintf(out, spec, static_cast<ptrdiff_t>(value));
+            break;
+        default:
+            appendPrintf(out, spec, static_cast<int>(value));
+            break;
+    }
+}
+
+// Unsigned conversion of an integer argument (%u, %o, %x, %X)
+static void renderUnsigned(std::string& out, const char* spec, const FormatPiece& piece, const FormatArg& arg)
+{
+    unsigned long long value = arg.kind == FormatArgKind::Unsigned ? arg.u : static_cast<unsigned long long>(arg.i);
+    switch (piece.length) {
+        case 'H':
+            value = static_cast<unsigned char>(value);
+            break;
+        case 'h':
+            value = static_cast<unsigned short>(value);
+            break;
+        case 0:
+            value = static_cast<unsigned int>(value);
+            break;
+        case 'l':
+            value = static_cast<unsigned long>(value);
+            break;
+        case 'j':
+            value = static_cast<uintmax_t>(value);
+            break;
+        case 'z':
+        case 't':
+            value = static_cast<size_t>(value);
+            break;
+        default:
+            break;
+    }
+
+    if (piece.simple) {
+        int base = piece.conversion == 'u' ? 10 : piece.conversion == 'o' ? 8 : 16;
+        appendInteger(out, value, base, piece.conversion == 'X');
+        return;
+    }
+    switch (piece.length) {
+        case 'l':
+            appendPrintf(out, spec, static_cast<unsigned long>(value));
+            break;
+        case 'q':
+            appendPrintf(out, spec, value);
+            break;
+        case 'j':
+            appendPrintf(out, spec, static_cast<uintmax_t>(value));
+            break;
+        case 'z':
+        case 't':
+            appendPrintf(out, spec, static_cast<size_t>(value));
+            break;
+        default:
+            appendPrintf(out, spec, static_cast<unsigned int>(value));
+            break;
+    }
+}
+
+static void renderConversion(std::string& out, const char* text, const FormatPiece& piece, const FormatArg& arg)
+{
+    char spec[FORMAT_SPEC_MAX + 1];
+    memcpy(spec, text, piece.specSize);
+    spec[piece.specSize] = '\0';
+
+    switch (piece.conversion) {
+        case 'd':
+        case 'i':
+            renderSigned(out, spec, piece, arg);
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            renderUnsigned(out, spec, piece, arg);
+            break;
+        case 'c': {
+            int value = arg.kind == FormatArgKind::Signed ? int(arg.i) : int(arg.u);
+            if (piece.simple) {
+                out += char(static_cast<unsigned char>(value));
+            } else {
+                appendPrintf(out, spec, value);
+            }
+            break;
+        }
+        case 's':
+            if (piece.simple && arg.s) {
+                out += arg.s;
+            } else {
+                // glibc prints null strings as "(null)"
+                appendPrintf(out, spec, arg.s);
+            }
+            break;
+        case 'p':
+            appendPrintf(out, spec, arg.kind == FormatArgKind::String ? static_cast<const void*>(arg.s) : arg.p);
+            break;
+        default:
+            if (arg.kind == FormatArgKind::LongDouble) {
+                appendPrintf(out, spec, *arg.ld);
+            } else {
+                appendPrintf(out, spec, arg.d);
+            }
+            break;
+    }
+}
+
+void renderFormat(std::string& out, const FormatView& format, const FormatArg* args)
+{
+    size_t arg = 0;
+    for (size_t i = 0; i < format.count; i++) {
+        const FormatPiece& piece = format.pieces[i];
+        out.append(format.text + piece.literalOffset, piece.literalSize);
+        if (piece.conversion == '%') {
+            out += '%';
+        } else {
+            renderConversion(out, format.text + piece.literalOffset + piece.literalSize, piece, args[arg++]);
+        }
+    }
+    out.append(format.text + format.tailOffset, format.tailSize);
+}
+
+} // namespace fty::logger
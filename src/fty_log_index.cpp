@@ -0,0 +1,535 @@
+/*  =========================================================================
+    fty_log_index - Sidecar time/level index of the log files
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_log_index - Sidecar time/level index of the log files
+@discuss
+    Index layout: a magic, then chunks (ChunkHeader followed by its
+    payload), appended as the log file grows:
+      - NAME: id of a logger name (uint16) followed by the name, written
+        before the first block using it;
+      - BLOCK: BlockHeader followed by one BlockEntry per event, the events
+        of a block being contiguous in the log file from its offset.
+    Levels are stored as ranks (TRACE = 0 ... FATAL = 5), a logger sets the
+    bit (id % 64) of the logger bitmap of the blocks it appears in.
+    Unknown chunks are skipped by the readers.
+@end
+ */
+#include "fty-log/fty_log_index.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <log4cplus/helpers/loglog.h>
+#include <log4cplus/helpers/property.h>
+#include <log4cplus/layout.h>
+#include <log4cplus/loglevel.h>
+#include <log4cplus/spi/factory.h>
+#include <log4cplus/spi/loggingevent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace fty::logger {
+
+static constexpr char     INDEX_MAGIC[8] = {'F', 'T', 'Y', 'L', 'I', 'D', 'X', '1'};
+static constexpr uint32_t CHUNK_NAME     = 1;
+static constexpr uint32_t CHUNK_BLOCK    = 2;
+
+// Id of the loggers once the dictionary is full (never matched by a query)
+static constexpr uint16_t UNKNOWN_LOGGER = UINT16_MAX;
+
+// A block is closed once its events span this long, so that the index of
+// a quiet file does not lag much behind it
+static constexpr int64_t BLOCK_MAX_SPAN_US = 1000000;
+
+struct ChunkHeader
+{
+    uint32_t type;
+    uint32_t size;
+};
+
+struct BlockHeader
+{
+    uint64_t offset;
+    int64_t  firstUs;
+    int64_t  lastUs;
+    uint64_t loggerMask;
+    uint32_t count;
+    uint8_t  levelMask;
+    uint8_t  reserved[3];
+};
+
+struct BlockEntry
+{
+    uint32_t size;
+    // from BlockHeader::firstUs
+    uint32_t deltaUs;
+    uint16_t loggerId;
+    uint8_t  level;
+    uint8_t  reserved;
+};
+
+static uint8_t levelRank(int level)
+{
+    if (level <= log4cplus::TRACE_LOG_LEVEL) {
+        return 0;
+    }
+    return uint8_t(std::min(level / log4cplus::DEBUG_LOG_LEVEL, 5));
+}
+
+std::string logIndexPath(const std::string& logPath)
+{
+    return logPath + ".idx";
+}
+
+////////////////////////
+// LogIndexWriter section
+////////////////////////
+
+LogIndexWriter::LogIndexWriter(const std::string& path, unsigned blockSize)
+    : _path(path)
+    , _blockSize(std::max(blockSize, 1u))
+    , _fd(-1)
+    , _blockOffset(0)
+    , _nextOffset(0)
+    , _firstUs(0)
+    , _lastUs(0)
+{
+    _entries.reserve(_blockSize);
+    open();
+}
+
+LogIndexWriter::~LogIndexWriter()
+{
+    close();
+}
+
+void LogIndexWriter::open()
+{
+    // An existing index is continued, the logger names being defined again
+    _fd = ::open(_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+    if (_fd == -1) {
+        fprintf(stderr, "[ERROR]: %s:%d (%s) can't open %s: %s\n", __FILE__, __LINE__, __func__, _path.c_str(),
+            strerror(errno));
+        return;
+    }
+    struct stat st;
+    if (fstat(_fd, &st) == 0 && st.st_size == 0
+        && ::write(_fd, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != ssize_t(sizeof(INDEX_MAGIC))) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _loggers.clear();
+}
+
+void LogIndexWriter::close()
+{
+    flush();
+    if (_fd != -1) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+void LogIndexWriter::reopen()
+{
+    close();
+    open();
+}
+
+void LogIndexWriter::writeChunk(uint32_t type, const std::string& payload)
+{
+    if (_fd == -1) {
+        return;
+    }
+    ChunkHeader header{type, uint32_t(payload.size())};
+    struct iovec iov[2] = {{&header, sizeof(header)}, {const_cast<char*>(payload.data()), payload.size()}};
+    // A short write leaves a truncated chunk, ignored by the readers
+    while (writev(_fd, iov, 2) == -1 && errno == EINTR) {
+    }
+}
+
+uint16_t LogIndexWriter::loggerId(const std::string& loggerName)
+{
+    auto it = _loggers.find(loggerName);
+    if (it != _loggers.end()) {
+        return it->second;
+    }
+    if (_loggers.size() >= UNKNOWN_LOGGER) {
+        return UNKNOWN_LOGGER;
+    }
+    uint16_t id = uint16_t(_loggers.size());
+    _loggers.emplace(loggerName, id);
+
+    _chunk.assign(reinterpret_cast<const char*>(&id), sizeof(id));
+    _chunk.append(loggerName);
+    writeChunk(CHUNK_NAME, _chunk);
+    return id;
+}
+
+void LogIndexWriter::add(uint64_t offset, uint32_t size, int64_t timestampUs, int level, const std::string& loggerName)
+{
+    if (!_entries.empty()) {
+        int64_t first = std::min(_firstUs, timestampUs);
+        int64_t last  = std::max(_lastUs, timestampUs);
+        if (offset != _nextOffset || last - first >= BLOCK_MAX_SPAN_US) {
+            flush();
+        }
+    }
+    if (_entries.empty()) {
+        _blockOffset = offset;
+        _firstUs     = timestampUs;
+        _lastUs      = timestampUs;
+    }
+
+    _entries.push_back(Entry{size, loggerId(loggerName), levelRank(level), timestampUs});
+    _firstUs    = std::min(_firstUs, timestampUs);
+    _lastUs     = std::max(_lastUs, timestampUs);
+    _nextOffset = offset + size;
+
+    if (_entries.size() >= _blockSize) {
+        flush();
+    }
+}
+
+void LogIndexWriter::flush()
+{
+    if (_entries.empty()) {
+        return;
+    }
+
+    BlockHeader header{};
+    header.offset  = _blockOffset;
+    header.firstUs = _firstUs;
+    header.lastUs  = _lastUs;
+    header.count   = uint32_t(_entries.size());
+    for (const Entry& entry : _entries) {
+        header.levelMask |= uint8_t(1u << entry.level);
+        header.loggerMask |= uint64_t(1) << (entry.loggerId % 64);
+    }
+
+    _chunk.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const Entry& entry : _entries) {
+        BlockEntry out{};
+        out.size     = entry.size;
+        out.deltaUs  = uint32_t(entry.timestampUs - _firstUs);
+        out.loggerId = entry.loggerId;
+        out.level    = entry.level;
+        _chunk.append(reinterpret_cast<const char*>(&out), sizeof(out));
+    }
+    writeChunk(CHUNK_BLOCK, _chunk);
+    _entries.clear();
+}
+
+////////////////////////
+// Query section
+////////////////////////
+
+// Part of a log file described by one block
+struct IndexedSpan
+{
+    uint64_t offset;
+    uint64_t end;
+    int64_t  firstUs;
+    int64_t  lastUs;
+};
+
+// Parts of the first fileSize bytes not described by the spans; the events of
+// a part are dated between the blocks before and after it
+static void findGaps(std::vector<IndexedSpan>& spans, uint64_t fileSize, const LogIndexQuery& query,
+    std::vector<LogIndexGap>& gaps)
+{
+    std::sort(spans.begin(), spans.end(), [](const IndexedSpan& a, const IndexedSpan& b) {
+        return a.offset < b.offset;
+    });
+
+    uint64_t           position = 0;
+    const IndexedSpan* previous = nullptr;
+    for (const IndexedSpan& span : spans) {
+        if (span.offset > position && position < fileSize) {
+            LogIndexGap gap{position, std::min(span.offset, fileSize) - position,
+                previous ? previous->firstUs : INT64_MIN, span.lastUs};
+            if (gap.fromUs <= query.toUs && gap.toUs >= query.fromUs) {
+                gaps.push_back(gap);
+            }
+        }
+        position = std::max(position, span.end);
+        previous = &span;
+    }
+    if (fileSize > position) {
+        LogIndexGap gap{position, fileSize - position, previous ? previous->firstUs : INT64_MIN, INT64_MAX};
+        if (gap.fromUs <= query.toUs) {
+            gaps.push_back(gap);
+        }
+    }
+}
+
+bool queryLogIndex(const std::string& indexPath, const LogIndexQuery& query, std::vector<LogIndexRange>& ranges,
+    std::vector<LogIndexGap>* gaps, uint64_t fileSize)
+{
+    FILE* file = fopen(indexPath.c_str(), "rbe");
+    if (!file) {
+        return false;
+    }
+    char magic[sizeof(INDEX_MAGIC)];
+    if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    const uint8_t     rank      = levelRank(query.minLevel);
+    const uint8_t     levelMask = uint8_t(0x3f & (0xff << rank));
+    std::vector<bool> wantedIds(query.loggers.empty() ? 0 : size_t(UNKNOWN_LOGGER) + 1, false);
+    uint64_t          loggerMask = query.loggers.empty() ? ~uint64_t(0) : 0;
+
+    std::vector<IndexedSpan> spans;
+
+    std::string             payload;
+    std::vector<BlockEntry> entries;
+    ChunkHeader             chunk;
+    while (fread(&chunk, sizeof(chunk), 1, file) == 1) {
+        if (chunk.type == CHUNK_NAME) {
+            payload.resize(chunk.size);
+            if (chunk.size < sizeof(uint16_t) || fread(&payload[0], chunk.size, 1, file) != 1) {
+                break;
+            }
+            uint16_t id;
+            memcpy(&id, payload.data(), sizeof(id));
+            std::string name = payload.substr(sizeof(id));
+            if (!query.loggers.empty()) {
+                // An index continued after a restart defines the ids again
+                wantedIds[id] = std::find(query.loggers.begin(), query.loggers.end(), name) != query.loggers.end();
+                if (wantedIds[id]) {
+                    loggerMask |= uint64_t(1) << (id % 64);
+                }
+            }
+            continue;
+        }
+        if (chunk.type != CHUNK_BLOCK) {
+            if (fseek(file, long(chunk.size), SEEK_CUR) != 0) {
+                break;
+            }
+            continue;
+        }
+
+        BlockHeader block;
+        if (chunk.size < sizeof(block) || fread(&block, sizeof(block), 1, file) != 1
+            || chunk.size != sizeof(block) + uint64_t(block.count) * sizeof(BlockEntry)) {
+            break;
+        }
+        entries.resize(block.count);
+        if (block.count && fread(entries.data(), sizeof(BlockEntry), block.count, file) != block.count) {
+            break;
+        }
+
+        if (gaps) {
+            uint64_t end = block.offset;
+            for (const BlockEntry& entry : entries) {
+                end += entry.size;
+            }
+            spans.push_back(IndexedSpan{block.offset, end, block.firstUs, block.lastUs});
+        }
+
+        // Whole block out of the query
+        if (block.lastUs < query.fromUs || block.firstUs > query.toUs || !(block.levelMask & levelMask)
+            || !(block.loggerMask & loggerMask)) {
+            continue;
+        }
+
+        uint64_t offset = block.offset;
+        for (const BlockEntry& entry : entries) {
+            int64_t timestampUs = block.firstUs + int64_t(entry.deltaUs);
+            bool    selected    = timestampUs >= query.fromUs && timestampUs <= query.toUs && entry.level >= rank
+                            && (query.loggers.empty() || wantedIds[entry.loggerId]);
+            if (selected) {
+                if (!ranges.empty() && ranges.back().offset + ranges.back().size == offset) {
+                    ranges.back().size += entry.size;
+                } else {
+                    ranges.push_back(LogIndexRange{offset, entry.size});
+                }
+            }
+            offset += entry.size;
+        }
+    }
+    fclose(file);
+
+    if (gaps) {
+        findGaps(spans, fileSize, query, *gaps);
+    }
+    return true;
+}
+
+////////////////////////
+// IndexedRotatingFile section
+////////////////////////
+
+IndexedRotatingFile::IndexedRotatingFile(
+    const std::string& path, uint64_t maxFileSize, unsigned maxBackups, bool index, unsigned blockSize)
+    : RotatingFile(path, maxFileSize, maxBackups)
+    , _maxBackups(maxBackups)
+{
+    if (index) {
+        // An index left beside a new or emptied file describes former content
+        if (offset() == 0) {
+            ::unlink(logIndexPath(path).c_str());
+        }
+        _index.reset(new LogIndexWriter(logIndexPath(path), blockSize));
+    }
+}
+
+IndexedRotatingFile::~IndexedRotatingFile() = default;
+
+void IndexedRotatingFile::append(
+    const char* data, size_t size, int64_t timestampUs, int level, const std::string& loggerName)
+{
+    uint64_t offset = RotatingFile::append(data, size);
+    if (_index) {
+        _index->add(offset, uint32_t(size), timestampUs, level, loggerName);
+    }
+}
+
+void IndexedRotatingFile::flush()
+{
+    RotatingFile::flush();
+    if (_index) {
+        _index->flush();
+    }
+}
+
+void IndexedRotatingFile::sync()
+{
+    RotatingFile::sync();
+    if (_index) {
+        _index->flush();
+    }
+}
+
+void IndexedRotatingFile::onRotate()
+{
+    if (!_index) {
+        return;
+    }
+    // Follow the renames of the log files
+    _index->flush();
+    const std::string& base = path();
+    if (_maxBackups == 0) {
+        ::unlink(logIndexPath(base).c_str());
+    } else {
+        for (unsigned i = _maxBackups; i > 1; i--) {
+            std::string from = logIndexPath(base + "." + std::to_string(i - 1));
+            std::string to   = logIndexPath(base + "." + std::to_string(i));
+            rename(from.c_str(), to.c_str());
+        }
+        rename(logIndexPath(base).c_str(), logIndexPath(base + ".1").c_str());
+    }
+    _index->reopen();
+}
+
+////////////////////////
+// IndexedFileAppender section
+////////////////////////
+
+// Size with an optional KB, MB or GB suffix (as the log4cplus file appenders)
+static uint64_t parseFileSize(const std::string& value)
+{
+    char*    end  = nullptr;
+    uint64_t size = strtoull(value.c_str(), &end, 10);
+    if (end && (strncmp(end, "KB", 2) == 0)) {
+        size *= 1024;
+    } else if (end && (strncmp(end, "MB", 2) == 0)) {
+        size *= 1024 * 1024;
+    } else if (end && (strncmp(end, "GB", 2) == 0)) {
+        size *= 1024 * 1024 * 1024;
+    }
+    return size;
+}
+
+IndexedFileAppender::IndexedFileAppender(const log4cplus::helpers::Properties& properties)
+    : log4cplus::Appender(properties)
+    , _immediateFlush(true)
+    , _stream(&_streamBuf)
+{
+    std::string path = properties.getProperty(LOG4CPLUS_TEXT("File"));
+    if (path.empty()) {
+        log4cplus::helpers::getLogLog().error(LOG4CPLUS_TEXT("IndexedFileAppender: File is not set"));
+        return;
+    }
+
+    uint64_t maxFileSize = 10 * 1024 * 1024;
+    if (properties.exists(LOG4CPLUS_TEXT("MaxFileSize"))) {
+        maxFileSize = parseFileSize(properties.getProperty(LOG4CPLUS_TEXT("MaxFileSize")));
+    }
+    int  maxBackups = 1;
+    int  blockSize  = FTY_LOG_INDEX_DEFAULT_BLOCK_SIZE;
+    bool index      = true;
+    properties.getInt(maxBackups, LOG4CPLUS_TEXT("MaxBackupIndex"));
+    properties.getInt(blockSize, LOG4CPLUS_TEXT("IndexBlockSize"));
+    properties.getBool(index, LOG4CPLUS_TEXT("Index"));
+    properties.getBool(_immediateFlush, LOG4CPLUS_TEXT("ImmediateFlush"));
+
+    _file.reset(new IndexedRotatingFile(
+        path, maxFileSize, unsigned(std::max(maxBackups, 0)), index, unsigned(std::max(blockSize, 1))));
+    _streamBuf.setTarget(&_line);
+}
+
+IndexedFileAppender::~IndexedFileAppender()
+{
+    destructorImpl();
+}
+
+void IndexedFileAppender::close()
+{
+    if (_file) {
+        _file->sync();
+        _file.reset();
+    }
+    closed = true;
+}
+
+void IndexedFileAppender::append(const log4cplus::spi::InternalLoggingEvent& event)
+{
+    if (!_file) {
+        return;
+    }
+    _line.clear();
+    layout->formatAndAppend(_stream, event);
+
+    int64_t timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        event.getTimestamp().time_since_epoch())
+                              .count();
+    _file->append(_line.data(), _line.size(), timestampUs, event.getLogLevel(), event.getLoggerName());
+    if (_immediateFlush) {
+        _file->flush();
+    }
+}
+
+void IndexedFileAppender::registerFactory()
+{
+    log4cplus::spi::getAppenderFactoryRegistry().put(std::unique_ptr<log4cplus::spi::AppenderFactory>(
+        new log4cplus::spi::FactoryTempl<IndexedFileAppender, log4cplus::spi::AppenderFactory>(
+            LOG4CPLUS_TEXT("fty::logger::IndexedFileAppender"))));
+}
+
+} // namespace fty::logger
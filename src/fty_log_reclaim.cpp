@@ -0,0 +1,188 @@
+/*  =========================================================================
+    fty_log_reclaim - Reclamation of the state read by the logging threads
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_log_reclaim - Reclamation of the state read by the logging threads
+@discuss
+    Each thread protecting a pointer gets a record of PROTECTION_SLOTS slots,
+    on its own cache line, linked in a list which only grows: the record of
+    an exited thread is taken again by the next thread needing one. A slot
+    is free while it holds nullptr (a protected pointer is never null), so
+    releasing it is a single store. Readers only write their own record; a
+    writer scans all the records, which is the cost of a replacement, not
+    of the logging.
+    Protections beyond the slots of a thread (or from the thread-local
+    destructors run after the record was given back) are counted in a
+    shared counter, a writer waiting for it to drop to 0.
+@end
+ */
+#include "fty-log/fty_log_reclaim.h"
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+
+namespace fty::logger {
+
+namespace {
+
+constexpr unsigned PROTECTION_SLOTS = 4;
+
+struct alignas(64) ProtectionRecord
+{
+    std::atomic<const void*> slots[PROTECTION_SLOTS];
+    std::atomic<bool>        taken{true};
+    ProtectionRecord*        next = nullptr;
+    // Counted protections of the owner thread
+    unsigned counted = 0;
+};
+
+std::atomic<ProtectionRecord*> records{nullptr};
+std::atomic<unsigned>          countedProtections{0};
+
+void childAfterFork();
+
+// Record of a thread, given back when the thread exits
+struct RecordLease
+{
+    ProtectionRecord* record;
+
+    RecordLease()
+        : record(nullptr)
+    {
+        static std::once_flag forkHandler;
+        std::call_once(forkHandler, [] {
+            pthread_atfork(nullptr, nullptr, &childAfterFork);
+        });
+
+        for (ProtectionRecord* free = records.load(std::memory_order_acquire); free; free = free->next) {
+            bool taken = false;
+            if (!free->taken.load(std::memory_order_relaxed)
+                && free->taken.compare_exchange_strong(taken, true, std::memory_order_acquire)) {
+                record = free;
+                return;
+            }
+        }
+        record = new ProtectionRecord;
+        for (std::atomic<const void*>& slot : record->slots) {
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+        ProtectionRecord* head = records.load(std::memory_order_relaxed);
+        do {
+            record->next = head;
+        } while (!records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    ~RecordLease();
+};
+
+// Record of the thread once leased (without the guard of the lease on the
+// path of every protection)
+thread_local ProtectionRecord* threadRecordCache    = nullptr;
+thread_local bool              recordLeaseDestroyed = false;
+
+RecordLease::~RecordLease()
+{
+    record->counted = 0;
+    record->taken.store(false, std::memory_order_release);
+    threadRecordCache    = nullptr;
+    recordLeaseDestroyed = true;
+}
+
+ProtectionRecord* threadRecord()
+{
+    if (ProtectionRecord* record = threadRecordCache) {
+        return record;
+    }
+    if (recordLeaseDestroyed) {
+        return nullptr;
+    }
+    thread_local RecordLease lease;
+    threadRecordCache = lease.record;
+    return lease.record;
+}
+
+// Only the forking thread is left in the child: the protections of the others are gone
+void childAfterFork()
+{
+    ProtectionRecord* own     = recordLeaseDestroyed ? nullptr : threadRecord();
+    unsigned          counted = 0;
+    for (ProtectionRecord* record = records.load(); record; record = record->next) {
+        if (record == own) {
+            counted = record->counted;
+            continue;
+        }
+        for (std::atomic<const void*>& slot : record->slots) {
+            slot.store(nullptr);
+        }
+        record->counted = 0;
+        record->taken.store(false);
+    }
+    countedProtections.store(counted);
+}
+
+} // namespace
+
+std::atomic<const void*>* acquireProtectionSlot()
+{
+    ProtectionRecord* record = threadRecord();
+    if (!record) {
+        countedProtections.fetch_add(1, std::memory_order_seq_cst);
+        return nullptr;
+    }
+    for (std::atomic<const void*>& slot : record->slots) {
+        if (!slot.load(std::memory_order_relaxed)) {
+            return &slot;
+        }
+    }
+    record->counted++;
+    countedProtections.fetch_add(1, std::memory_order_seq_cst);
+    return nullptr;
+}
+
+void releaseProtectionSlot(std::atomic<const void*>* slot)
+{
+    if (slot) {
+        slot->store(nullptr, std::memory_order_release);
+        return;
+    }
+    ProtectionRecord* record = threadRecord();
+    if (record && record->counted) {
+        record->counted--;
+    }
+    countedProtections.fetch_sub(1, std::memory_order_release);
+}
+
+void waitUnprotected(const void* pointer)
+{
+    for (ProtectionRecord* record = records.load(std::memory_order_acquire); record; record = record->next) {
+        for (std::atomic<const void*>& slot : record->slots) {
+            while (slot.load(std::memory_order_seq_cst) == pointer) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    while (countedProtections.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+} // namespace fty::logger
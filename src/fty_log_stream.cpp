@@ -0,0 +1,90 @@
+/*  =========================================================================
+    fty_log_stream - Streaming logging API
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_log_stream - Streaming logging API
+@discuss
+    The messages are built in a per-thread string through a per-thread
+    std::ostream, both kept from one message to the next: a message costs
+    no stream construction and, once the string is large enough, no
+    allocation.
+@end
+ */
+#include "fty-log/fty_log_stream.h"
+#include "fty-log/fty_logger.h"
+#include "fty-log/fty_string_streambuf.h"
+
+namespace fty::logger {
+
+// Do not keep huge messages' memory alive in every logging thread
+static constexpr size_t STREAM_BUFFER_MAX_KEPT = 64 * 1024;
+
+struct LogStream::Buffer
+{
+    Buffer()
+    {
+        streamBuf.setTarget(&message);
+    }
+
+    std::string     message;
+    StringStreamBuf streamBuf;
+    std::ostream    stream{&streamBuf};
+    bool            inUse = false;
+};
+
+static thread_local LogStream::Buffer streamBuffer;
+
+LogStream::LogStream(Ftylog* log, log4cplus::LogLevel level, const char* file, int line, const char* func)
+    : _log(log)
+    , _level(level)
+    , _file(file)
+    , _line(line)
+    , _func(func)
+{
+    if (streamBuffer.inUse) {
+        _nested.reset(new Buffer);
+        _used = _nested.get();
+    } else {
+        _used = &streamBuffer;
+    }
+    _used->inUse = true;
+    _buffer      = &_used->message;
+    _stream      = &_used->stream;
+
+    _buffer->clear();
+    _stream->clear();
+    _stream->flags(std::ios_base::dec | std::ios_base::skipws);
+    _stream->precision(6);
+    _stream->width(0);
+    _stream->fill(' ');
+}
+
+LogStream::~LogStream()
+{
+    _log->insertLogMessage(_level, _file, _line, _func, *_buffer);
+    if (_buffer->capacity() > STREAM_BUFFER_MAX_KEPT) {
+        std::string().swap(*_buffer);
+    }
+    _used->inUse = false;
+}
+
+} // namespace fty::logger
@@ -26,16 +26,35 @@
 @end
  */
 #include "fty-log/fty_logger.h"
+#include "fty-log/fty_console_appender.h"
+#include "fty-log/fty_journald_appender.h"
+#include "fty-log/fty_log_budget.h"
+#include "fty-log/fty_log_capture.h"
+#include "fty-log/fty_log_dump.h"
+#include "fty-log/fty_log_filter.h"
+#include "fty-log/fty_log_index.h"
+#include "fty-log/fty_log_reclaim.h"
+#include "fty-log/fty_sanitize.h"
+#include "fty-log/fty_segment_files.h"
+#include "fty-log/fty_shared_layout.h"
+#include "fty-log/fty_shipping_appender.h"
+#include "fty-log/fty_shm_transport.h"
+#include "fty-log/fty_string_streambuf.h"
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <log4cplus/configurator.h>
 #include <log4cplus/consoleappender.h>
+#include <log4cplus/helpers/property.h>
 #include <log4cplus/hierarchy.h>
 #include <log4cplus/loggingmacros.h>
 #include <log4cplus/loglevel.h>
 #include <log4cplus/mdc.h>
+#include <mutex>
 #include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <thread>
 #include <typeinfo>
 #include <unistd.h>
@@ -46,6 +65,53 @@ using namespace log4cplus::helpers;
 // Ftylog section
 ////////////////////////
 
+// Creation of the state the logging threads read without lock
+static std::mutex lockFreeStateMutex;
+
+namespace fty::logger {
+// Outputs of a Ftylog besides its appenders, enabled if not null
+struct LogOutputs
+{
+    std::shared_ptr<ShmTransport>      shmTransport;
+    std::shared_ptr<SegmentFiles>      segmentFiles;
+    std::shared_ptr<log4cplus::Layout> lineLayout;
+    std::shared_ptr<LogCapture>        capture;
+};
+}
+
+// Publish a changed copy of the outputs; the former ones are deleted once
+// no logging thread uses them anymore (flushing the segments or writing the
+// trace they no longer share with the new outputs)
+template <typename Change>
+static void changeOutputs(std::atomic<fty::logger::LogOutputs*>& outputs, Change change)
+{
+    std::unique_ptr<fty::logger::LogOutputs> former;
+    {
+        std::lock_guard<std::mutex>              lock(lockFreeStateMutex);
+        fty::logger::LogOutputs*                 current = outputs.load();
+        std::unique_ptr<fty::logger::LogOutputs> changed(
+            current ? new fty::logger::LogOutputs(*current) : new fty::logger::LogOutputs);
+        change(*changed);
+        if (!changed->shmTransport && !changed->segmentFiles && !changed->capture) {
+            changed.reset();
+        }
+        former.reset(fty::logger::replaceProtected(outputs, changed.release()));
+    }
+}
+
+// Make the fty appenders and layouts available to log4cplus configuration files
+static void registerFactories()
+{
+    static std::once_flag once;
+    std::call_once(once, [] {
+        fty::logger::SharedPatternLayout::registerFactory();
+        fty::logger::IndexedFileAppender::registerFactory();
+        fty::logger::NonBlockingConsoleAppender::registerFactory();
+        fty::logger::ShippingAppender::registerFactory();
+        fty::logger::JournaldAppender::registerFactory();
+    });
+}
+
 Ftylog::Ftylog(std::string component, std::string configFile)
 {
     _watchConfigFile = nullptr;
@@ -75,6 +141,7 @@ void Ftylog::init(std::string component, std::string configFile)
 
     // initialize log4cplus
     log4cplus::initialize();
+    registerFactories();
 
     // Create logger
     auto log = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT(component));
@@ -87,8 +154,32 @@ void Ftylog::init(std::string component, std::string configFile)
     // Get pattern layout from env
     setPatternFromEnv();
 
+    // Get console mode from env
+    setConsoleModeFromEnv();
+
+    // Get message sanitizing from env
+    setSanitizeFromEnv();
+
+    // Get volume budget from env
+    setBudgetFromEnv();
+
+    // Filter rules of the previous name, if any, do not apply (the config file sets them again)
+    unsetFilter();
+
     // load appenders
     loadAppenders();
+
+    // Send the logs to the collector if requested
+    unsetShmTransport();
+    setShmTransportFromEnv();
+
+    // Write the logs to per-thread segment files if requested
+    unsetSegmentFiles();
+    setSegmentFilesFromEnv();
+
+    // Capture the logging activity if requested
+    unsetCapture();
+    setCaptureFromEnv();
 }
 
 // Clean objects in destructor
@@ -99,6 +190,9 @@ Ftylog::~Ftylog()
         _watchConfigFile = nullptr;
     }
     _logger.shutdown();
+    delete _budget.load();
+    delete _filter.load();
+    delete _outputs.load();
 }
 
 // getter
@@ -136,17 +230,57 @@ void Ftylog::setPatternFromEnv()
     }
 }
 
+void Ftylog::setConsoleModeFromEnv()
+{
+    // BIOS_LOG_CONSOLE_NONBLOCKING=true makes the console appenders non-blocking
+    const char* varEnv  = getenv("BIOS_LOG_CONSOLE_NONBLOCKING");
+    _consoleNonBlocking = varEnv && (std::string(varEnv) == "true" || std::string(varEnv) == "1");
+}
+
+void Ftylog::setSanitizeFromEnv()
+{
+    // BIOS_LOG_SANITIZE=true escapes the messages for single-line output
+    const char* varEnv = getenv("BIOS_LOG_SANITIZE");
+    _sanitize          = varEnv && (std::string(varEnv) == "true" || std::string(varEnv) == "1");
+}
+
+void Ftylog::setBudgetFromEnv()
+{
+    // BIOS_LOG_BUDGET_EVENTS and BIOS_LOG_BUDGET_BYTES limit the events and bytes per second
+    const char* varEvents = getenv("BIOS_LOG_BUDGET_EVENTS");
+    const char* varBytes  = getenv("BIOS_LOG_BUDGET_BYTES");
+    setBudget(varEvents ? strtoull(varEvents, nullptr, 10) : 0, varBytes ? strtoull(varBytes, nullptr, 10) : 0);
+}
+
+log4cplus::SharedAppenderPtr Ftylog::createConsoleAppender(bool logToStdErr)
+{
+    if (_consoleNonBlocking) {
+        return new fty::logger::NonBlockingConsoleAppender(logToStdErr ? STDERR_FILENO : STDOUT_FILENO);
+    }
+    // Note: the first bool argument controls logging to stderr(true) as output stream
+    return new log4cplus::ConsoleAppender(logToStdErr, true);
+}
+
+// Layout of a console appender: its rendering is shared with the other
+// appenders of the logger, if any (a lone appender has nothing to share)
+static std::unique_ptr<log4cplus::Layout> consoleLayout(const std::string& pattern, bool alone)
+{
+    if (alone) {
+        return std::unique_ptr<log4cplus::Layout>(new log4cplus::PatternLayout(pattern));
+    }
+    return std::unique_ptr<log4cplus::Layout>(new fty::logger::SharedPatternLayout(pattern));
+}
+
 // Add a simple ConsoleAppender to the logger
 void Ftylog::setConsoleAppender()
 {
     _logger.removeAllAppenders();
 
     // create appender
-    // Note: the first bool argument controls logging to stderr(true) as output stream
-    SharedObjectPtr<log4cplus::Appender> append(new log4cplus::ConsoleAppender(true, true));
+    SharedObjectPtr<log4cplus::Appender> append(createConsoleAppender(true));
 
     // Create and affect layout
-    append->setLayout(std::unique_ptr<log4cplus::Layout>(new log4cplus::PatternLayout(_layoutPattern)));
+    append->setLayout(consoleLayout(_layoutPattern, true));
     append.get()->setName(LOG4CPLUS_TEXT("Console" + this->_agentName));
 
     // Add appender to logger
@@ -159,7 +293,8 @@ void Ftylog::removeConsoleAppenders(log4cplus::Logger logger)
     {
         log4cplus::Appender& app = *appenderPtr;
 
-        if (typeid(app) == typeid(log4cplus::ConsoleAppender)) {
+        if (typeid(app) == typeid(log4cplus::ConsoleAppender)
+            || typeid(app) == typeid(fty::logger::NonBlockingConsoleAppender)) {
             // If any, remove it
             logger.removeAppender(appenderPtr);
             break;
@@ -191,15 +326,58 @@ void Ftylog::setVerboseMode()
     }
 
     // create and add the appender
-    SharedObjectPtr<log4cplus::Appender> append(new log4cplus::ConsoleAppender(false, true));
+    SharedObjectPtr<log4cplus::Appender> append(createConsoleAppender(false));
     // Create and affect layout
-    append->setLayout(std::unique_ptr<log4cplus::Layout>(new log4cplus::PatternLayout(_layoutPattern)));
+    append->setLayout(consoleLayout(_layoutPattern, _logger.getAllAppenders().empty()));
     append.get()->setName(LOG4CPLUS_TEXT("Verbose-" + this->_agentName));
 
     // Add verbose appender to logger
     _logger.addAppender(append);
 }
 
+void Ftylog::setConsoleNonBlocking(bool nonBlocking)
+{
+    _consoleNonBlocking = nonBlocking;
+
+    // Replace the console appenders installed by this object
+    for (log4cplus::SharedAppenderPtr& appenderPtr : _logger.getAllAppenders()) {
+        std::string name = appenderPtr->getName();
+        bool        console = name == "Console" + _agentName;
+        if (!console && name != "Verbose-" + _agentName) {
+            continue;
+        }
+        SharedObjectPtr<log4cplus::Appender> append(createConsoleAppender(console));
+        append->setLayout(consoleLayout(_layoutPattern, _logger.getAllAppenders().size() == 1));
+        append->setThreshold(appenderPtr->getThreshold());
+        append->setName(name);
+        _logger.removeAppender(appenderPtr);
+        _logger.addAppender(append);
+    }
+}
+
+void Ftylog::setSanitize(bool sanitize)
+{
+    _sanitize = sanitize;
+}
+
+void Ftylog::setBudget(uint64_t eventsPerSecond, uint64_t bytesPerSecond)
+{
+    fty::logger::LogBudget* budget = _budget.load(std::memory_order_acquire);
+    if (!budget) {
+        if (!eventsPerSecond && !bytesPerSecond) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(lockFreeStateMutex);
+        if (!_budget.load()) {
+            _budget.store(new fty::logger::LogBudget(eventsPerSecond, bytesPerSecond), std::memory_order_release);
+            return;
+        }
+        budget = _budget.load();
+    }
+    // Other threads may be using it: never deleted before the Ftylog object
+    budget->setLimits(eventsPerSecond, bytesPerSecond);
+}
+
 void Ftylog::setContext(const std::map<std::string, std::string>& contextParam)
 {
     log4cplus::getMDC().clear();
@@ -285,6 +463,7 @@ void Ftylog::loadAppenders()
 
         // Load the file
         log4cplus::PropertyConfigurator::doConfigure(LOG4CPLUS_TEXT(_configFile));
+        setOptionsFromConfigFile();
 
         // Start the thread watching the modification of the log config file
         _watchConfigFile = new log4cplus::ConfigureAndWatchThread(_configFile.c_str(), 60000);
@@ -300,6 +479,37 @@ void Ftylog::loadAppenders()
     }
 }
 
+// Options of the logger in the config file, beside the log4cplus ones:
+//   ftylog.sanitize=true|false
+//   ftylog.budget.events=<events per second>
+//   ftylog.budget.bytes=<bytes per second>
+//   ftylog.filter.* (see fty::logger::readFilterRules)
+// They are read when the file is loaded, the filter rules also when it is modified
+void Ftylog::setOptionsFromConfigFile()
+{
+    log4cplus::helpers::Properties properties(LOG4CPLUS_TEXT(_configFile));
+    if (properties.exists(LOG4CPLUS_TEXT("ftylog.sanitize"))) {
+        bool sanitize = false;
+        properties.getBool(sanitize, LOG4CPLUS_TEXT("ftylog.sanitize"));
+        _sanitize = sanitize;
+    }
+    if (properties.exists(LOG4CPLUS_TEXT("ftylog.budget.events"))
+        || properties.exists(LOG4CPLUS_TEXT("ftylog.budget.bytes"))) {
+        setBudget(strtoull(properties.getProperty(LOG4CPLUS_TEXT("ftylog.budget.events")).c_str(), nullptr, 10),
+            strtoull(properties.getProperty(LOG4CPLUS_TEXT("ftylog.budget.bytes")).c_str(), nullptr, 10));
+    }
+
+    // The filter and the watch of its rules only exist when the file has filter options
+    std::vector<fty::logger::FilterRule> rules;
+    bool                                 acceptByDefault;
+    if (fty::logger::readFilterRules(properties, rules, acceptByDefault)) {
+        setFilter(rules, acceptByDefault);
+        _filter.load()->watchConfigFile(_configFile);
+    } else {
+        unsetFilter();
+    }
+}
+
 // Set the logging level corresponding to the BIOS_LOG_LEVEL value
 bool Ftylog::setLogLevelFromEnvDefinite(const std::string& level)
 {
@@ -355,7 +565,30 @@ void Ftylog::setLogLevelOff()     { _logger.setLogLevel(log4cplus::OFF_LOG_LEVEL
 // Return true if the logging level is included in the logger log level
 bool Ftylog::isLogLevel(log4cplus::LogLevel level)
 {
-    return _logger.getLogLevel() <= level;
+    if (_logger.getLogLevel() > level) {
+        return false;
+    }
+    fty::logger::LogBudget* budget = _budget.load(std::memory_order_acquire);
+    if (!budget || budget->threshold() <= level) {
+        return true;
+    }
+
+    // Dropped by the budget, which may find meanwhile that the load subsided
+    std::string notice;
+    bool        admitted = budget->admits(level, _logger.getLogLevel(), notice);
+    if (!notice.empty()) {
+        printLogMessage(log4cplus::WARN_LOG_LEVEL, __FILE__, __LINE__, __func__, notice);
+    }
+    return admitted;
+}
+
+bool Ftylog::isLogLevel(log4cplus::LogLevel level, const char* file, const char* func)
+{
+    if (!isLogLevel(level)) {
+        return false;
+    }
+    fty::logger::LogFilter* filter = _filter.load(std::memory_order_acquire);
+    return !filter || filter->accepts(level, file, func);
 }
 
 bool Ftylog::isLogTrace()   { return isLogLevel(log4cplus::TRACE_LOG_LEVEL); }
@@ -366,38 +599,169 @@ bool Ftylog::isLogError()   { return isLogLevel(log4cplus::ERROR_LOG_LEVEL); }
 bool Ftylog::isLogFatal()   { return isLogLevel(log4cplus::FATAL_LOG_LEVEL); }
 bool Ftylog::isLogOff()     { return _logger.getLogLevel() == log4cplus::OFF_LOG_LEVEL; }
 
-// Call log4cplus system to print logs in logger appenders
-void Ftylog::insertLog(
-    log4cplus::LogLevel level, const char* file, int line, const char* func, const char* format, va_list args)
+namespace {
+
+// Per-thread buffer reused to build the messages
+struct MessageBuffer
 {
-    char* buffer = nullptr;
-    int   r;
+    std::string buffer;
+    bool        inUse = false;
+};
 
-    // Check if the level of this log is included in the log level
-    if (!isLogLevel(level)) {
-        return;
+thread_local MessageBuffer messageBuffer;
+
+// Per-thread buffer reused to escape the messages
+thread_local MessageBuffer sanitizedBuffer;
+
+// Do not keep huge messages' memory alive in every logging thread
+constexpr size_t MESSAGE_BUFFER_MAX_KEPT = 64 * 1024;
+
+// Use of the per-thread message buffer; a message built while another one
+// is being built (e.g. by a formatter which logs) gets its own buffer
+class MessageBufferLease
+{
+public:
+    explicit MessageBufferLease(MessageBuffer& shared = messageBuffer)
+        : _shared(shared)
+        , _reentrant(shared.inUse)
+    {
+        _shared.inUse = true;
+        buffer().clear();
     }
-    // Construct the main log message
-    r = vasprintf(&buffer, format, args);
-    if (r == -1) {
-        fprintf(stderr,
-            "[ERROR]: %s:%d (%s) can't allocate enough memory for message "
-            "string: buffer",
-            __FILE__, __LINE__, __func__);
-        if (buffer) {
-            free(buffer);
+
+    ~MessageBufferLease()
+    {
+        if (!_reentrant) {
+            if (_shared.buffer.capacity() > MESSAGE_BUFFER_MAX_KEPT) {
+                std::string().swap(_shared.buffer);
+            }
+            _shared.inUse = false;
+        }
+    }
+
+    std::string& buffer()
+    {
+        return _reentrant ? _nested : _shared.buffer;
+    }
+
+private:
+    MessageBuffer& _shared;
+    bool           _reentrant;
+    std::string _nested;
+};
+
+// printf-like formatting into a string, reusing its memory
+bool formatPrintf(std::string& out, const char* format, va_list args)
+{
+    va_list copy;
+
+    out.resize(out.capacity());
+    va_copy(copy, args);
+    int size = vsnprintf(&out[0], out.size() + 1, format, copy);
+    va_end(copy);
+    if (size < 0) {
+        return false;
+    }
+
+    if (size_t(size) > out.size()) {
+        out.resize(size_t(size));
+        va_copy(copy, args);
+        vsnprintf(&out[0], out.size() + 1, format, copy);
+        va_end(copy);
+    }
+    out.resize(size_t(size));
+    return true;
+}
+
+// Logging event reused by a thread for all its events: its strings keep
+// their memory from one event to the next, and the file and function, which
+// are __FILE__ and __func__ literals, are only copied when they change
+class PooledEvent : public log4cplus::spi::InternalLoggingEvent
+{
+public:
+    void set(const log4cplus::tstring& logger, log4cplus::LogLevel level, const std::string& text, const char* fileName,
+        int fileLine, const char* funcName)
+    {
+        loggerName = logger;
+        ll         = level;
+        message    = text;
+        timestamp  = log4cplus::helpers::now();
+        // The same pointer may be a reused buffer with another content: it is
+        // compared too, the copy (and its allocation) is only saved for the same text
+        if (!fileName || fileName != _fileName || strcmp(fileName, file.c_str()) != 0) {
+            file      = fileName ? fileName : "";
+            _fileName = fileName;
+        }
+        if (!funcName || funcName != _funcName || strcmp(funcName, function.c_str()) != 0) {
+            function  = funcName ? funcName : "";
+            _funcName = funcName;
         }
+        line          = fileLine;
+        threadCached  = false;
+        thread2Cached = false;
+        ndcCached     = false;
+        mdcCached     = false;
+        fty::logger::SharedPatternLayout::newEvent(*this);
+    }
+
+private:
+    const char* _fileName = nullptr;
+    const char* _funcName = nullptr;
+};
+
+// Per-thread event given to the appenders, also used to render the messages
+// sent to the shared memory transport or written to the segment files
+struct ThreadEvent
+{
+    PooledEvent                  event;
+    std::string                  line;
+    fty::logger::StringStreamBuf streamBuf;
+    std::ostream                 stream{&streamBuf};
+    bool                         inUse = false;
+};
+
+thread_local ThreadEvent threadEvent;
+
+// Use of the event of the thread, released even if an appender throws
+class ThreadEventLease
+{
+public:
+    ThreadEventLease()
+    {
+        threadEvent.inUse = true;
+    }
+
+    ~ThreadEventLease()
+    {
+        threadEvent.inUse = false;
+    }
+
+    ThreadEvent& get()
+    {
+        return threadEvent;
+    }
+};
+
+} // namespace
+
+// Call log4cplus system to print logs in logger appenders
+void Ftylog::insertLog(
+    log4cplus::LogLevel level, const char* file, int line, const char* func, const char* format, va_list args)
+{
+    // Check if the level of this log is included in the log level and not filtered out
+    if (!isLogLevel(level, file, func)) {
         return;
     }
 
-    if (buffer == nullptr) {
-        log_error_log(this, "Buffer == NULL");
+    // Construct the main log message
+    MessageBufferLease lease;
+    std::string&       message = lease.buffer();
+    if (!formatPrintf(message, format, args)) {
+        fprintf(stderr, "[ERROR]: %s:%d (%s) can't format message string: %s\n", file, line, func, format);
         return;
     }
 
-    // Give the printing job to log4cplus
-    log4cplus::detail::macro_forced_log(_logger, level, LOG4CPLUS_TEXT(buffer), file, line, func);
-    free(buffer);
+    insertLogMessage(level, file, line, func, message, format);
 }
 
 void Ftylog::insertLog(log4cplus::LogLevel level, const char* file, int line, const char* func, const char* format, ...)
@@ -408,6 +772,317 @@ void Ftylog::insertLog(log4cplus::LogLevel level, const char* file, int line, co
     va_end(args);
 }
 
+void Ftylog::insertLogPreparsed(log4cplus::LogLevel level, const char* file, int line, const char* func,
+    const fty::logger::FormatView& format, const fty::logger::FormatArg* args)
+{
+    // The level and the filter were checked by insertLogPrintf
+    MessageBufferLease lease;
+    std::string&       message = lease.buffer();
+    fty::logger::renderFormat(message, format, args);
+    insertLogMessage(level, file, line, func, message, format.text);
+}
+
+void Ftylog::insertLogFmt(log4cplus::LogLevel level, const char* file, int line, const char* func, fmt::string_view message)
+{
+    if (!isLogLevel(level, file, func)) {
+        return;
+    }
+    insertLogFmtImpl(level, file, line, func, message, nullptr);
+}
+
+void Ftylog::vinsertLogFmt(
+    log4cplus::LogLevel level, const char* file, int line, const char* func, fmt::string_view format, fmt::format_args args)
+{
+    if (!isLogLevel(level, file, func)) {
+        return;
+    }
+    insertLogFmtImpl(level, file, line, func, format, &args);
+}
+
+// Format a fmt-style message into the per-thread buffer and give it to log4cplus
+void Ftylog::insertLogFmtImpl(log4cplus::LogLevel level, const char* file, int line, const char* func,
+    fmt::string_view format, const fmt::format_args* args)
+{
+    MessageBufferLease lease;
+    std::string&       message = lease.buffer();
+    try {
+        if (args) {
+            fmt::vformat_to(std::back_inserter(message), format, *args);
+        } else {
+            // No argument: print the message verbatim (legacy fty::logger::format behaviour)
+            message.append(format.data(), format.size());
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "[ERROR]: %s:%d (%s) can't format message string: %s\n", file, line, func, e.what());
+        return;
+    }
+
+    insertLogMessage(level, file, line, func, message);
+}
+
+void Ftylog::insertLogHexDump(log4cplus::LogLevel level, const char* file, int line, const char* func,
+    const char* title, const void* data, size_t size, size_t maxBytes)
+{
+    if (!isLogLevel(level, file, func)) {
+        return;
+    }
+
+    MessageBufferLease lease;
+    std::string&       message = lease.buffer();
+    message.append(title ? title : "");
+    message += " (";
+    message += std::to_string(size);
+    message += " bytes):";
+    fty::logger::appendHexDump(message, data, size, maxBytes);
+
+    insertLogMessage(level, file, line, func, message);
+}
+
+void Ftylog::insertLogPayload(log4cplus::LogLevel level, const char* file, int line, const char* func,
+    const char* title, const char* text, size_t size, size_t maxBytes)
+{
+    if (!isLogLevel(level, file, func)) {
+        return;
+    }
+
+    // Do not cut the shown part in a UTF-8 sequence either
+    size_t shown = size;
+    if (size > maxBytes) {
+        for (shown = maxBytes; shown > 0 && (uint8_t(text[shown]) & 0xc0) == 0x80; shown--) {
+        }
+    }
+    size_t parts = 0;
+    for (size_t start = 0; start < shown || parts == 0; parts++) {
+        start = fty::logger::payloadChunkEnd(text, shown, start, FTY_LOG_PAYLOAD_CHUNK);
+    }
+
+    MessageBufferLease lease;
+    std::string&       message = lease.buffer();
+    size_t             start   = 0;
+    for (size_t part = 1; part <= parts; part++) {
+        size_t end = fty::logger::payloadChunkEnd(text, shown, start, FTY_LOG_PAYLOAD_CHUNK);
+
+        message.clear();
+        message.append(title ? title : "");
+        if (parts > 1) {
+            message += " [";
+            message += std::to_string(part);
+            message += '/';
+            message += std::to_string(parts);
+            message += ']';
+        }
+        message += ": ";
+        // The newline a chunk ends with is not printed
+        message.append(text + start, end - start - (end > start && text[end - 1] == '\n'));
+        if (part == parts && shown < size) {
+            message += " [truncated: ";
+            message += std::to_string(size - shown);
+            message += " more bytes]";
+        }
+        insertLogMessage(level, file, line, func, message);
+        start = end;
+    }
+}
+
+// Print a built message once captured, sanitized and accounted in the budget
+void Ftylog::insertLogMessage(log4cplus::LogLevel level, const char* file, int line, const char* func,
+    const std::string& text, const char* format)
+{
+    {
+        fty::logger::ProtectedPointer<fty::logger::LogOutputs> outputs(_outputs);
+        if (outputs && outputs->capture) {
+            outputs->capture->record(level, file, line, func, text, format);
+        }
+    }
+
+    // Escape the message for single-line output; a message with nothing to
+    // escape is used as is
+    MessageBufferLease sanitized(sanitizedBuffer);
+    const bool         escaped = _sanitize.load(std::memory_order_relaxed)
+                         && fty::logger::sanitize(text.data(), text.size(), sanitized.buffer());
+    const std::string& message = escaped ? sanitized.buffer() : text;
+
+    std::string             notice;
+    fty::logger::LogBudget* budget = _budget.load(std::memory_order_acquire);
+    if (budget && budget->account(message.size(), _logger.getLogLevel(), notice)) {
+        printLogMessage(log4cplus::WARN_LOG_LEVEL, __FILE__, __LINE__, __func__, notice);
+    }
+    printLogMessage(level, file, line, func, message);
+}
+
+// Print a final message: through the segment files or the shared memory
+// transport if enabled and available, with the log4cplus appenders otherwise
+void Ftylog::printLogMessage(
+    log4cplus::LogLevel level, const char* file, int line, const char* func, const std::string& message)
+{
+    if (threadEvent.inUse) {
+        // Logging from an appender or a layout: the event of the thread is busy
+        log4cplus::detail::macro_forced_log(_logger, level, message, file, line, func);
+        return;
+    }
+
+    ThreadEventLease lease;
+    ThreadEvent&     current = lease.get();
+    current.event.set(_logger.getName(), level, message, file, line, func);
+
+    {
+        // Released before the appenders: a replacement of the outputs never waits for them
+        fty::logger::ProtectedPointer<fty::logger::LogOutputs> outputs(_outputs);
+        if (outputs && (outputs->segmentFiles || outputs->shmTransport)) {
+            current.line.clear();
+            current.streamBuf.setTarget(&current.line);
+            outputs->lineLayout->formatAndAppend(current.stream, current.event);
+
+            int64_t timestampUs =
+                std::chrono::duration_cast<std::chrono::microseconds>(current.event.getTimestamp().time_since_epoch())
+                    .count();
+            bool written = outputs->segmentFiles
+                               ? outputs->segmentFiles->write(
+                                   timestampUs, level, current.line.data(), current.line.size())
+                               : outputs->shmTransport->write(
+                                   timestampUs, level, _logger.getName(), current.line.data(), current.line.size());
+            if (written) {
+                return;
+            }
+            // Collector missing or late, or no segment: log locally
+        }
+    }
+
+    // Give the printing job to log4cplus
+    _logger.forcedLog(current.event);
+}
+
+// Enable the shared memory transport to the log collector
+bool Ftylog::setShmTransport()
+{
+    return setShmTransport(FTY_LOG_SHM_DEFAULT_PREFIX);
+}
+
+bool Ftylog::setShmTransport(const std::string& prefix)
+{
+    std::shared_ptr<fty::logger::ShmTransport> transport = fty::logger::ShmTransport::get(prefix);
+    if (!transport) {
+        return false;
+    }
+    std::shared_ptr<log4cplus::Layout> lineLayout(new log4cplus::PatternLayout(_layoutPattern));
+    changeOutputs(_outputs, [&](fty::logger::LogOutputs& outputs) {
+        outputs.lineLayout   = lineLayout;
+        outputs.shmTransport = transport;
+    });
+    return true;
+}
+
+void Ftylog::unsetShmTransport()
+{
+    // Returns once the events being logged by other threads are sent
+    changeOutputs(_outputs, [](fty::logger::LogOutputs& outputs) {
+        outputs.shmTransport.reset();
+    });
+}
+
+void Ftylog::setShmTransportFromEnv()
+{
+    // BIOS_LOG_SHM_TRANSPORT=true sends the logs to the collector
+    const char* varEnv = getenv("BIOS_LOG_SHM_TRANSPORT");
+    if (varEnv && (std::string(varEnv) == "true" || std::string(varEnv) == "1")) {
+        setShmTransport();
+    }
+}
+
+// Enable the per-thread segment files
+bool Ftylog::setSegmentFiles(const std::string& directory)
+{
+    std::shared_ptr<fty::logger::SegmentFiles> segmentFiles = fty::logger::SegmentFiles::create(directory, _agentName);
+    if (!segmentFiles) {
+        return false;
+    }
+    std::shared_ptr<log4cplus::Layout> lineLayout(new log4cplus::PatternLayout(_layoutPattern));
+    changeOutputs(_outputs, [&](fty::logger::LogOutputs& outputs) {
+        outputs.lineLayout   = lineLayout;
+        outputs.segmentFiles = segmentFiles;
+    });
+    return true;
+}
+
+void Ftylog::unsetSegmentFiles()
+{
+    // The segments are flushed once the events being logged by other threads are written
+    changeOutputs(_outputs, [](fty::logger::LogOutputs& outputs) {
+        outputs.segmentFiles.reset();
+    });
+}
+
+void Ftylog::setSegmentFilesFromEnv()
+{
+    // BIOS_LOG_SEGMENT_DIR=<directory> writes the logs to per-thread segment files
+    const char* varEnv = getenv("BIOS_LOG_SEGMENT_DIR");
+    if (varEnv && *varEnv) {
+        setSegmentFiles(varEnv);
+    }
+}
+
+// Capture the logging activity
+bool Ftylog::setCapture(const std::string& path)
+{
+    std::shared_ptr<fty::logger::LogCapture> capture = fty::logger::LogCapture::create(path, _agentName);
+    changeOutputs(_outputs, [&](fty::logger::LogOutputs& outputs) {
+        outputs.capture = capture;
+    });
+    return capture != nullptr;
+}
+
+void Ftylog::unsetCapture()
+{
+    // The trace is written once the events being logged by other threads are recorded
+    changeOutputs(_outputs, [](fty::logger::LogOutputs& outputs) {
+        outputs.capture.reset();
+    });
+}
+
+// Filter rules evaluated before formatting
+void Ftylog::setFilter(const std::vector<fty::logger::FilterRule>& rules, bool acceptByDefault)
+{
+    fty::logger::LogFilter* filter = _filter.load(std::memory_order_acquire);
+    if (!filter) {
+        std::lock_guard<std::mutex> lock(lockFreeStateMutex);
+        if (!_filter.load()) {
+            _filter.store(new fty::logger::LogFilter(_agentName, rules, acceptByDefault), std::memory_order_release);
+            return;
+        }
+        filter = _filter.load();
+    }
+    // The events being logged by other threads keep using the previous rules
+    filter->setRules(rules, acceptByDefault);
+}
+
+void Ftylog::unsetFilter()
+{
+    // Other threads may be using it: left without rules (one comparison per
+    // event) and never deleted before the Ftylog object
+    fty::logger::LogFilter* filter = _filter.load(std::memory_order_acquire);
+    if (filter) {
+        filter->stopWatch();
+        filter->setRules({}, true);
+    }
+}
+
+std::vector<uint64_t> Ftylog::filterHits()
+{
+    fty::logger::LogFilter* filter = _filter.load(std::memory_order_acquire);
+    return filter ? filter->hits() : std::vector<uint64_t>();
+}
+
+void Ftylog::setCaptureFromEnv()
+{
+    // BIOS_LOG_CAPTURE=<directory> captures the logging activity in <directory>/<agent>.<pid>.capture
+    const char* varEnv = getenv("BIOS_LOG_CAPTURE");
+    if (varEnv && *varEnv) {
+        std::string name = _agentName;
+        std::replace(name.begin(), name.end(), '/', '_');
+        setCapture(std::string(varEnv) + "/" + name + "." + std::to_string(getpid()) + ".capture");
+    }
+}
+
 ////////////////////////
 // ManageFtyLog section
 ////////////////////////
@@ -517,6 +1192,18 @@ void ftylog_insertLog(Ftylog* log, int level, const char* file, int line, const
     va_end(args);
 }
 
+void ftylog_insertLogHexDump(Ftylog* log, int level, const char* file, int line, const char* func, const char* title,
+    const void* data, size_t size, size_t maxBytes)
+{
+    if (log) log->insertLogHexDump(level, file, line, func, title, data, size, maxBytes);
+}
+
+void ftylog_insertLogPayload(Ftylog* log, int level, const char* file, int line, const char* func, const char* title,
+    const char* text, size_t size, size_t maxBytes)
+{
+    if (log) log->insertLogPayload(level, file, line, func, title, text, size, maxBytes);
+}
+
 // Switch to verbose mode
 void ftylog_setVeboseMode(Ftylog* log) // legacy misnomer
 {
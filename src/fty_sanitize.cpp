@@ -0,0 +1,194 @@
+/*  =========================================================================
+    fty_sanitize - Escaping of message text for single-line output
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_sanitize - Escaping of message text for single-line output
+@discuss
+    Most messages are plain printable ASCII. They are scanned 16 bytes at a
+    time (SSE2 on x86-64, NEON on AArch64, 8 bytes at a time with word
+    operations elsewhere) for bytes below 0x20, '\\', DEL or above 0x7f; only
+    around those bytes is the text looked at byte by byte, to tell valid
+    UTF-8 sequences, kept as is, from the bytes to escape.
+@end
+ */
+#include "fty-log/fty_sanitize.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace fty::logger {
+
+// Printable ASCII byte other than the backslash
+static inline bool plain(uint8_t c)
+{
+    return c >= 0x20 && c < 0x7f && c != '\\';
+}
+
+// Offset of the first byte which is not plain, size if none
+static size_t nextSpecial(const uint8_t* data, size_t size)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Signed comparison: the bytes above 0x7f are negative, below 0x20 too
+    const __m128i space     = _mm_set1_epi8(0x20);
+    const __m128i del       = _mm_set1_epi8(0x7f);
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        int     mask  = _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmplt_epi8(chunk, space), _mm_cmpeq_epi8(chunk, del)), _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask) {
+            return i + size_t(__builtin_ctz(unsigned(mask)));
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t space     = vdupq_n_u8(0x20);
+    const uint8x16_t del       = vdupq_n_u8(0x7f);
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t chunk   = vld1q_u8(data + i);
+        uint8x16_t special = vorrq_u8(vorrq_u8(vcltq_u8(chunk, space), vcgeq_u8(chunk, del)), vceqq_u8(chunk, backslash));
+        if (vmaxvq_u8(special)) {
+            break;
+        }
+    }
+#else
+    // A byte of a word is special when it is below 0x20, above 0x7e or a backslash
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = 0x8080808080808080ULL;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        uint64_t below     = (word - ones * 0x20) & ~word;
+        uint64_t above     = ((word & ~high) + ones * 0x01) | word;
+        uint64_t other     = word ^ (ones * '\\');
+        uint64_t backslash = (other - ones) & ~other;
+        if ((below | above | backslash) & high) {
+            break;
+        }
+    }
+#endif
+    for (; i < size && plain(data[i]); i++) {
+    }
+    return i;
+}
+
+// Size of the valid UTF-8 sequence starting at data, 0 if there is none
+static size_t utf8Sequence(const uint8_t* data, size_t size)
+{
+    uint8_t c = data[0];
+    size_t  length;
+    uint8_t low  = 0x80;
+    uint8_t high = 0xbf;
+    if (c >= 0xc2 && c <= 0xdf) {
+        length = 2;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        length = 3;
+        // No overlong encodings nor surrogates
+        low  = c == 0xe0 ? 0xa0 : 0x80;
+        high = c == 0xed ? 0x9f : 0xbf;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        length = 4;
+        // No overlong encodings nor code points above U+10FFFF
+        low  = c == 0xf0 ? 0x90 : 0x80;
+        high = c == 0xf4 ? 0x8f : 0xbf;
+    } else {
+        return 0;
+    }
+    if (length > size || data[1] < low || data[1] > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; i++) {
+        if (data[i] < 0x80 || data[i] > 0xbf) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+size_t sanitizeOffset(const char* text, size_t size)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(text);
+    size_t         i    = nextSpecial(data, size);
+    while (i < size) {
+        size_t length = data[i] >= 0x80 ? utf8Sequence(data + i, size - i) : 0;
+        if (!length) {
+            return i;
+        }
+        i += length;
+        i += nextSpecial(data + i, size - i);
+    }
+    return size;
+}
+
+bool sanitize(const char* text, size_t size, std::string& out)
+{
+    size_t i = sanitizeOffset(text, size);
+    if (i == size) {
+        return false;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t*    data  = reinterpret_cast<const uint8_t*>(text);
+    out.clear();
+    out.reserve(size + size / 8 + 4);
+    out.append(text, i);
+    while (i < size) {
+        uint8_t c      = data[i];
+        size_t  length = c >= 0x80 ? utf8Sequence(data + i, size - i) : 0;
+        if (length) {
+            out.append(text + i, length);
+            i += length;
+        } else {
+            switch (c) {
+                case '\n':
+                    out.append("\\n", 2);
+                    break;
+                case '\r':
+                    out.append("\\r", 2);
+                    break;
+                case '\t':
+                    out.append("\\t", 2);
+                    break;
+                case '\\':
+                    out.append("\\\\", 2);
+                    break;
+                default: {
+                    char escaped[4] = {'\\', 'x', hex[c >> 4], hex[c & 0xf]};
+                    out.append(escaped, sizeof(escaped));
+                }
+            }
+            i++;
+        }
+        size_t run = nextSpecial(data + i, size - i);
+        out.append(text + i, run);
+        i += run;
+    }
+    return true;
+}
+
+} // namespace fty::logger
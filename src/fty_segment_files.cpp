@@ -0,0 +1,535 @@
+/*  =========================================================================
+    fty_segment_files - Per-thread log segment files and their merge
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_segment_files - Per-thread log segment files and their merge
+@discuss
+    The only state shared by the logging threads is the sequence counter:
+    each thread finds its writer in a thread-local cache (keyed by the
+    SegmentFiles instance, several loggers may write segments) and only
+    shares the writer lock with the flusher thread, which takes it once per
+    second. A writer whose thread exited is flushed and closed by the
+    thread-local cache destructor, and forgotten by the flusher.
+    Before a fork, all the locks are taken so that the child gets them in a
+    consistent state; the child then closes the segments of the parent and
+    starts a new run, its flusher being started with its first segment.
+@end
+ */
+#include "fty-log/fty_segment_files.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <log4cplus/loglevel.h>
+#include <pthread.h>
+#include <random>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fty::logger {
+
+struct SegmentHeader
+{
+    char     magic[8];
+    uint64_t runId;
+    uint32_t pid;
+    uint32_t tid;
+};
+
+struct RecordHeader
+{
+    uint32_t size;
+    int32_t  level;
+    uint64_t sequence;
+    int64_t  timestampUs;
+};
+
+static_assert(sizeof(SegmentHeader) == 24, "unexpected segment header size");
+static_assert(sizeof(RecordHeader) == 24, "unexpected record header size");
+
+// Larger lines are taken for a corrupted segment
+static constexpr uint32_t MAX_LINE_SIZE = 64 * 1024 * 1024;
+
+struct SegmentFiles::Writer
+{
+    std::mutex        mutex;
+    int               fd = -1;
+    std::string       path;
+    std::string       buffer;
+    std::atomic<bool> closed{false};
+
+    // Write the buffered records (under the lock)
+    void flush()
+    {
+        size_t written = 0;
+        while (fd != -1 && written < buffer.size()) {
+            ssize_t r = ::write(fd, buffer.data() + written, buffer.size() - written);
+            if (r == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fprintf(stderr, "[ERROR]: %s:%d (%s) can't write to %s: %s\n", __FILE__, __LINE__, __func__,
+                    path.c_str(), strerror(errno));
+                break;
+            }
+            written += size_t(r);
+        }
+        buffer.clear();
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        flush();
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+        closed = true;
+    }
+};
+
+namespace {
+
+// Writers of the calling thread, closed when it exits
+struct WriterCache
+{
+    struct Entry
+    {
+        uint64_t                              owner;
+        std::shared_ptr<SegmentFiles::Writer> writer;
+    };
+    std::vector<Entry> entries;
+
+    ~WriterCache();
+};
+
+// Set once the cache of the thread is destroyed (events logged later by other
+// thread-local destructors go to the appenders)
+thread_local bool        writerCacheDestroyed = false;
+thread_local WriterCache writerCache;
+
+WriterCache::~WriterCache()
+{
+    for (Entry& entry : entries) {
+        entry.writer->close();
+    }
+    writerCacheDestroyed = true;
+}
+
+// Identifiers of the SegmentFiles instances, never reused (unlike their addresses)
+std::atomic<uint64_t> nextInstanceId{1};
+
+// Instances, for the fork handlers
+std::mutex                              instancesMutex;
+std::vector<fty::logger::SegmentFiles*> instances;
+
+uint64_t newRunId()
+{
+    std::random_device random;
+    uint64_t           id = (uint64_t(random()) << 32) | random();
+    return id ^ uint64_t(std::chrono::system_clock::now().time_since_epoch().count());
+}
+
+} // namespace
+
+std::shared_ptr<SegmentFiles> SegmentFiles::create(const std::string& directory, const std::string& name)
+{
+    if (access(directory.c_str(), W_OK | X_OK) != 0) {
+        fprintf(stderr, "[ERROR]: %s:%d (%s) can't write segments to %s: %s\n", __FILE__, __LINE__, __func__,
+            directory.c_str(), strerror(errno));
+        return nullptr;
+    }
+    return std::shared_ptr<SegmentFiles>(new SegmentFiles(directory, name));
+}
+
+SegmentFiles::SegmentFiles(const std::string& directory, const std::string& name)
+    : _id(nextInstanceId++)
+    , _directory(directory)
+    , _name(name)
+    , _runId(newRunId())
+    , _serial(0)
+    , _stop(false)
+{
+    // The name is used as a file name
+    std::replace(_name.begin(), _name.end(), '/', '_');
+    _flusher = std::thread(&SegmentFiles::flusher, this);
+
+    static std::once_flag forkHandlers;
+    std::call_once(forkHandlers, [] {
+        pthread_atfork(&SegmentFiles::prepareFork, &SegmentFiles::parentAfterFork, &SegmentFiles::childAfterFork);
+    });
+    std::lock_guard<std::mutex> lock(instancesMutex);
+    instances.push_back(this);
+}
+
+SegmentFiles::~SegmentFiles()
+{
+    {
+        std::lock_guard<std::mutex> lock(instancesMutex);
+        instances.erase(std::find(instances.begin(), instances.end(), this));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wakeUp.notify_all();
+    if (_flusher.joinable()) {
+        _flusher.join();
+    }
+
+    // Threads still alive log to the appenders from now on
+    for (const std::shared_ptr<Writer>& writer : _writers) {
+        writer->close();
+    }
+}
+
+const std::string& SegmentFiles::directory() const
+{
+    return _directory;
+}
+
+uint64_t SegmentFiles::runId() const
+{
+    return _runId;
+}
+
+// Create the segment of the calling thread; its file is not opened if that fails
+std::shared_ptr<SegmentFiles::Writer> SegmentFiles::createWriter()
+{
+    auto                        writer = std::make_shared<Writer>();
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Never overwrite the segments of a previous run with the same pid
+    for (int attempts = 0; attempts < 1000 && writer->fd == -1; attempts++) {
+        writer->path = _directory + "/" + _name + "." + std::to_string(getpid()) + "." + std::to_string(_serial++)
+                       + FTY_LOG_SEGMENT_EXTENSION;
+        writer->fd = open(writer->path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0640);
+        if (writer->fd == -1 && errno != EEXIST) {
+            break;
+        }
+    }
+    if (writer->fd == -1) {
+        fprintf(stderr, "[ERROR]: %s:%d (%s) can't create %s: %s\n", __FILE__, __LINE__, __func__,
+            writer->path.c_str(), strerror(errno));
+    }
+
+    SegmentHeader header = {};
+    memcpy(header.magic, FTY_LOG_SEGMENT_MAGIC, sizeof(header.magic));
+    header.runId = _runId;
+    header.pid   = uint32_t(getpid());
+    header.tid   = uint32_t(syscall(SYS_gettid));
+    writer->buffer.reserve(BUFFER_SIZE + 1024);
+    writer->buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    _writers.push_back(writer);
+
+    // First segment of the child of a fork
+    if (!_flusher.joinable()) {
+        _flusher = std::thread(&SegmentFiles::flusher, this);
+    }
+    return writer;
+}
+
+bool SegmentFiles::write(int64_t timestampUs, int level, const char* line, size_t size)
+{
+    if (writerCacheDestroyed || size > MAX_LINE_SIZE) {
+        return false;
+    }
+
+    Writer* writer = nullptr;
+    for (const WriterCache::Entry& entry : writerCache.entries) {
+        // The writers inherited by the child of a fork are closed
+        if (entry.owner == _id && !entry.writer->closed.load()) {
+            writer = entry.writer.get();
+            break;
+        }
+    }
+    if (!writer) {
+        // Forget the writers of destroyed instances
+        auto& entries = writerCache.entries;
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                          [](const WriterCache::Entry& entry) {
+                              return entry.writer->closed.load();
+                          }),
+            entries.end());
+        entries.push_back({_id, createWriter()});
+        writer = entries.back().writer.get();
+    }
+
+    std::lock_guard<std::mutex> lock(writer->mutex);
+    if (writer->fd == -1) {
+        return false;
+    }
+
+    RecordHeader header;
+    header.size        = uint32_t(size);
+    header.level       = int32_t(level);
+    header.sequence    = _sequence.fetch_add(1, std::memory_order_relaxed);
+    header.timestampUs = timestampUs;
+    writer->buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    writer->buffer.append(line, size);
+
+    // Errors are written at once, not to be lost in a crash they may announce
+    if (writer->buffer.size() >= BUFFER_SIZE || level >= log4cplus::ERROR_LOG_LEVEL) {
+        writer->flush();
+    }
+    return true;
+}
+
+void SegmentFiles::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const std::shared_ptr<Writer>& writer : _writers) {
+        std::lock_guard<std::mutex> writerLock(writer->mutex);
+        writer->flush();
+    }
+}
+
+void SegmentFiles::flusher()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        _wakeUp.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+
+        // Writers of exited threads were flushed and closed by them
+        _writers.erase(std::remove_if(_writers.begin(), _writers.end(),
+                           [](const std::shared_ptr<Writer>& writer) {
+                               return writer->closed.load();
+                           }),
+            _writers.end());
+        for (const std::shared_ptr<Writer>& writer : _writers) {
+            std::lock_guard<std::mutex> writerLock(writer->mutex);
+            writer->flush();
+        }
+    }
+}
+
+void SegmentFiles::prepareFork()
+{
+    instancesMutex.lock();
+    for (SegmentFiles* instance : instances) {
+        instance->_mutex.lock();
+        for (const std::shared_ptr<Writer>& writer : instance->_writers) {
+            writer->mutex.lock();
+        }
+    }
+}
+
+void SegmentFiles::parentAfterFork()
+{
+    for (SegmentFiles* instance : instances) {
+        for (const std::shared_ptr<Writer>& writer : instance->_writers) {
+            writer->mutex.unlock();
+        }
+        instance->_mutex.unlock();
+    }
+    instancesMutex.unlock();
+}
+
+void SegmentFiles::childAfterFork()
+{
+    for (SegmentFiles* instance : instances) {
+        // The segments and their buffered records are the parent's
+        for (const std::shared_ptr<Writer>& writer : instance->_writers) {
+            writer->buffer.clear();
+            if (writer->fd != -1) {
+                ::close(writer->fd);
+                writer->fd = -1;
+            }
+            writer->closed = true;
+            writer->mutex.unlock();
+        }
+        instance->_writers.clear();
+        instance->_runId    = newRunId();
+        instance->_sequence = 0;
+        // The flusher thread is not in the child: its handle is dropped without
+        // being joined, the next segment created starts another flusher
+        new (&instance->_flusher) std::thread();
+        instance->_mutex.unlock();
+    }
+    instancesMutex.unlock();
+}
+
+SegmentReader::SegmentReader(const std::string& path)
+    : _runId(0)
+    , _valid(false)
+    , _truncated(false)
+{
+    _file = fopen(path.c_str(), "rbe");
+    if (!_file) {
+        return;
+    }
+    SegmentHeader header;
+    if (fread(&header, sizeof(header), 1, _file) == 1
+        && memcmp(header.magic, FTY_LOG_SEGMENT_MAGIC, sizeof(header.magic)) == 0) {
+        _runId = header.runId;
+        _valid = true;
+    }
+}
+
+SegmentReader::~SegmentReader()
+{
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool SegmentReader::valid() const
+{
+    return _valid;
+}
+
+uint64_t SegmentReader::runId() const
+{
+    return _runId;
+}
+
+bool SegmentReader::truncated() const
+{
+    return _truncated;
+}
+
+bool SegmentReader::next(SegmentRecord& record)
+{
+    if (!_valid || _truncated) {
+        return false;
+    }
+
+    RecordHeader header;
+    size_t       r = fread(&header, 1, sizeof(header), _file);
+    if (r != sizeof(header)) {
+        _truncated = r != 0;
+        return false;
+    }
+    if (header.size > MAX_LINE_SIZE) {
+        _truncated = true;
+        return false;
+    }
+    record.line.resize(header.size);
+    if (fread(&record.line[0], 1, header.size, _file) != header.size) {
+        _truncated = true;
+        return false;
+    }
+    record.runId       = _runId;
+    record.sequence    = header.sequence;
+    record.timestampUs = header.timestampUs;
+    record.level       = header.level;
+    return true;
+}
+
+struct SegmentMerger::Input
+{
+    std::string                    path;
+    std::unique_ptr<SegmentReader> reader;
+    SegmentRecord                  head;
+    bool                           hasHead = false;
+};
+
+SegmentMerger::SegmentMerger() = default;
+
+SegmentMerger::~SegmentMerger() = default;
+
+bool SegmentMerger::add(const std::string& path)
+{
+    auto input    = std::make_unique<Input>();
+    input->path   = path;
+    input->reader = std::make_unique<SegmentReader>(path);
+    if (!input->reader->valid()) {
+        return false;
+    }
+    fill(*input);
+    _inputs.push_back(std::move(input));
+    return true;
+}
+
+bool SegmentMerger::fill(Input& input)
+{
+    input.hasHead = input.reader->next(input.head);
+    return input.hasHead;
+}
+
+bool SegmentMerger::next(SegmentRecord& record)
+{
+    // Head of each run: its input with the smallest sequence
+    std::vector<Input*> runHeads;
+    for (const std::unique_ptr<Input>& input : _inputs) {
+        if (!input->hasHead) {
+            continue;
+        }
+        auto run = std::find_if(runHeads.begin(), runHeads.end(), [&](const Input* head) {
+            return head->head.runId == input->head.runId;
+        });
+        if (run == runHeads.end()) {
+            runHeads.push_back(input.get());
+        } else if (input->head.sequence < (*run)->head.sequence) {
+            *run = input.get();
+        }
+    }
+    if (runHeads.empty()) {
+        return false;
+    }
+
+    // Runs are interleaved by timestamp
+    Input* selected = *std::min_element(runHeads.begin(), runHeads.end(), [](const Input* a, const Input* b) {
+        return a->head.timestampUs < b->head.timestampUs
+               || (a->head.timestampUs == b->head.timestampUs && a->head.runId < b->head.runId);
+    });
+    std::swap(record, selected->head);
+    fill(*selected);
+    return true;
+}
+
+std::vector<std::string> SegmentMerger::truncated() const
+{
+    std::vector<std::string> paths;
+    for (const std::unique_ptr<Input>& input : _inputs) {
+        if (input->reader->truncated()) {
+            paths.push_back(input->path);
+        }
+    }
+    return paths;
+}
+
+std::vector<std::string> segmentFiles(const std::string& directory)
+{
+    std::vector<std::string> paths;
+    DIR*                     dir = opendir(directory.c_str());
+    if (!dir) {
+        return paths;
+    }
+    const size_t extensionSize = strlen(FTY_LOG_SEGMENT_EXTENSION);
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > extensionSize
+            && name.compare(name.size() - extensionSize, extensionSize, FTY_LOG_SEGMENT_EXTENSION) == 0) {
+            paths.push_back(directory + "/" + name);
+        }
+    }
+    closedir(dir);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+} // namespace fty::logger
@@ -0,0 +1,187 @@
+/*  =========================================================================
+    fty_shared_layout - Pattern layout rendering each event once per pattern
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_shared_layout - Pattern layout rendering each event once per pattern
+@discuss
+    The rendering cache is per thread: log4cplus calls the appenders of a
+    logger one after the other from the logging thread, so the appenders
+    sharing a pattern see the same event in a row. The event object being
+    reused from one log to the next, comparing its fields would cost about
+    as much as rendering it: the logging code announces each event instead,
+    which bumps a generation the renderings are kept for.
+@end
+ */
+#include "fty-log/fty_shared_layout.h"
+#include "fty-log/fty_string_streambuf.h"
+#include <log4cplus/helpers/property.h>
+#include <log4cplus/spi/factory.h>
+#include <log4cplus/spi/loggingevent.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace fty::logger {
+
+struct SharedPatternLayout::Pattern
+{
+    uint64_t           id;
+    log4cplus::tstring conversionPattern;
+};
+
+namespace {
+
+    struct RenderedPattern
+    {
+        uint64_t    patternId;
+        uint64_t    generation;
+        std::string text;
+    };
+
+    // Per-thread cache of the renderings of the last announced event
+    struct RenderCache
+    {
+        // Announced event, and its generation
+        const log4cplus::spi::InternalLoggingEvent* event      = nullptr;
+        uint64_t                                    generation = 0;
+
+        // Renderings, one per pattern (of the current generation or stale)
+        std::vector<RenderedPattern> rendered;
+
+        uint64_t        renderCount = 0;
+        StringStreamBuf streamBuf;
+        std::ostream    stream{&streamBuf};
+
+        const std::string* find(uint64_t patternId) const
+        {
+            for (const RenderedPattern& slot : rendered) {
+                if (slot.patternId == patternId && slot.generation == generation) {
+                    return &slot.text;
+                }
+            }
+            return nullptr;
+        }
+
+        // Return a cleared slot for a pattern, keeping the memory of the previous events
+        std::string& add(uint64_t patternId)
+        {
+            RenderedPattern* reused = nullptr;
+            for (RenderedPattern& slot : rendered) {
+                if (slot.patternId == patternId || slot.generation != generation) {
+                    reused = &slot;
+                    break;
+                }
+            }
+            if (!reused) {
+                rendered.emplace_back();
+                reused = &rendered.back();
+            }
+            reused->patternId  = patternId;
+            reused->generation = generation;
+            reused->text.clear();
+            return reused->text;
+        }
+    };
+
+    thread_local RenderCache renderCache;
+
+} // namespace
+
+SharedPatternLayout::SharedPatternLayout(const log4cplus::tstring& pattern)
+{
+    init(pattern);
+}
+
+SharedPatternLayout::SharedPatternLayout(const log4cplus::helpers::Properties& properties)
+    : log4cplus::Layout(properties)
+{
+    init(properties.getProperty(LOG4CPLUS_TEXT("ConversionPattern")));
+}
+
+SharedPatternLayout::~SharedPatternLayout()
+{
+}
+
+void SharedPatternLayout::init(const log4cplus::tstring& pattern)
+{
+    // Registry of the patterns in use
+    static std::mutex                                                patternsMutex;
+    static std::map<log4cplus::tstring, std::weak_ptr<const Pattern>> patterns;
+    static uint64_t                                                  lastPatternId = 0;
+
+    _renderer.reset(new log4cplus::PatternLayout(pattern));
+
+    std::lock_guard<std::mutex> lock(patternsMutex);
+
+    std::weak_ptr<const Pattern>& entry = patterns[pattern];
+    _pattern                             = entry.lock();
+    if (!_pattern) {
+        _pattern = std::make_shared<const Pattern>(Pattern{++lastPatternId, pattern});
+        entry    = _pattern;
+    }
+}
+
+void SharedPatternLayout::formatAndAppend(
+    log4cplus::tostream& output, const log4cplus::spi::InternalLoggingEvent& event)
+{
+    RenderCache& cache = renderCache;
+
+    if (cache.event != &event) {
+        // Not announced: its content may not be the one of a cached rendering
+        cache.renderCount++;
+        _renderer->formatAndAppend(output, event);
+        return;
+    }
+    if (const std::string* text = cache.find(_pattern->id)) {
+        // Already rendered for another appender
+        output.write(text->data(), std::streamsize(text->size()));
+        return;
+    }
+
+    std::string& text = cache.add(_pattern->id);
+    cache.streamBuf.setTarget(&text);
+    _renderer->formatAndAppend(cache.stream, event);
+    cache.renderCount++;
+
+    output.write(text.data(), std::streamsize(text.size()));
+}
+
+uint64_t SharedPatternLayout::renderCount()
+{
+    return renderCache.renderCount;
+}
+
+void SharedPatternLayout::newEvent(const log4cplus::spi::InternalLoggingEvent& event)
+{
+    RenderCache& cache = renderCache;
+    cache.event        = &event;
+    cache.generation++;
+}
+
+void SharedPatternLayout::registerFactory()
+{
+    log4cplus::spi::getLayoutFactoryRegistry().put(std::unique_ptr<log4cplus::spi::LayoutFactory>(
+        new log4cplus::spi::FactoryTempl<SharedPatternLayout, log4cplus::spi::LayoutFactory>(
+            LOG4CPLUS_TEXT("fty::logger::SharedPatternLayout"))));
+}
+
+} // namespace fty::logger
@@ -0,0 +1,453 @@
+/*  =========================================================================
+    fty_shipping_appender - Batched and compressed shipping of the logs
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_shipping_appender - Batched and compressed shipping of the logs
+@discuss
+    The spool is made of two files, <SpoolFile>.1 (older) and <SpoolFile>,
+    each holding frames as sent on the wire: when <SpoolFile> reaches half
+    of SpoolMaxSize it replaces <SpoolFile>.1, which bounds the spool while
+    keeping the most recent batches. Once connected, the spool is replayed
+    before any new batch, so that the collector receives the batches in
+    order, then removed.
+    The collector never writes to the connection: a readable end of stream
+    tells that it closed the connection, which is checked before each batch
+    so that a batch is not lost in a half-closed connection.
+@end
+ */
+#include "fty-log/fty_shipping_appender.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <log4cplus/helpers/loglog.h>
+#include <log4cplus/helpers/property.h>
+#include <log4cplus/layout.h>
+#include <log4cplus/spi/factory.h>
+#include <log4cplus/spi/loggingevent.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace fty::logger {
+
+static constexpr size_t FRAME_HEADER_SIZE = 4 * sizeof(uint32_t);
+
+static void putUint32(char* out, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(out, &value, sizeof(value));
+}
+
+static uint32_t getUint32(const char* in)
+{
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return ntohl(value);
+}
+
+long decodeShippingFrame(const char* data, size_t size, std::string& lines, uint32_t& events)
+{
+    if (size < FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    if (getUint32(data) != FTY_LOG_SHIPPING_MAGIC) {
+        return -1;
+    }
+    uint32_t compressedSize = getUint32(data + 4);
+    uint32_t rawSize        = getUint32(data + 8);
+    // Checked before waiting for the frame or allocating its batch
+    if (rawSize > FTY_LOG_SHIPPING_MAX_BATCH || compressedSize > compressBound(FTY_LOG_SHIPPING_MAX_BATCH)) {
+        return -1;
+    }
+    if (size < FRAME_HEADER_SIZE + compressedSize) {
+        return 0;
+    }
+
+    lines.resize(rawSize);
+    uLongf length = rawSize;
+    if (uncompress(reinterpret_cast<Bytef*>(&lines[0]), &length,
+            reinterpret_cast<const Bytef*>(data + FRAME_HEADER_SIZE), compressedSize)
+            != Z_OK
+        || length != rawSize) {
+        return -1;
+    }
+    events = getUint32(data + 12);
+    return long(FRAME_HEADER_SIZE + compressedSize);
+}
+
+ShippingAppender::ShippingAppender(const log4cplus::helpers::Properties& properties)
+    : log4cplus::Appender(properties)
+    , _queueEvents(0)
+    , _stop(false)
+    , _socket(-1)
+    , _spoolPending(false)
+    , _sentEvents(0)
+    , _spooledEvents(0)
+    , _droppedEvents(0)
+    , _connected(false)
+    , _stream(&_streamBuf)
+{
+    _host = properties.getProperty(LOG4CPLUS_TEXT("Host"), LOG4CPLUS_TEXT("localhost"));
+    _port = properties.getProperty(LOG4CPLUS_TEXT("Port"));
+    if (_port.empty()) {
+        log4cplus::helpers::getLogLog().error(LOG4CPLUS_TEXT("ShippingAppender: Port is not set"));
+    }
+
+    int  batchSize    = 256;
+    int  queueSize    = 1024 * 1024;
+    long spoolMaxSize = 16 * 1024 * 1024;
+    _batchDelayMs     = 1000;
+    _reconnectDelayMs = 1000;
+    _compressionLevel = Z_DEFAULT_COMPRESSION;
+    properties.getInt(batchSize, LOG4CPLUS_TEXT("BatchSize"));
+    properties.getInt(_batchDelayMs, LOG4CPLUS_TEXT("BatchDelayMs"));
+    properties.getInt(queueSize, LOG4CPLUS_TEXT("QueueSize"));
+    properties.getLong(spoolMaxSize, LOG4CPLUS_TEXT("SpoolMaxSize"));
+    properties.getInt(_reconnectDelayMs, LOG4CPLUS_TEXT("ReconnectDelayMs"));
+    properties.getInt(_compressionLevel, LOG4CPLUS_TEXT("CompressionLevel"));
+    _spoolFile    = properties.getProperty(LOG4CPLUS_TEXT("SpoolFile"));
+    _batchSize    = size_t(std::max(batchSize, 1));
+    _queueSize    = std::min(size_t(std::max(queueSize, 1)), size_t(FTY_LOG_SHIPPING_MAX_BATCH));
+    _spoolMaxSize = uint64_t(std::max(spoolMaxSize, 0L));
+
+    // A spool left by a previous run is replayed too
+    struct stat st;
+    _spoolPending = !_spoolFile.empty()
+                    && (stat(_spoolFile.c_str(), &st) == 0 || stat((_spoolFile + ".1").c_str(), &st) == 0);
+
+    _streamBuf.setTarget(&_line);
+    _queueSince  = std::chrono::steady_clock::now();
+    _nextConnect = _queueSince;
+    _sender      = std::thread(&ShippingAppender::sender, this);
+}
+
+ShippingAppender::~ShippingAppender()
+{
+    destructorImpl();
+}
+
+void ShippingAppender::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stop) {
+            return;
+        }
+        _stop = true;
+    }
+    _wakeUp.notify_all();
+    _sender.join();
+    disconnect();
+    closed = true;
+}
+
+void ShippingAppender::append(const log4cplus::spi::InternalLoggingEvent& event)
+{
+    _line.clear();
+    layout->formatAndAppend(_stream, event);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stop) {
+        return;
+    }
+    if (_queue.size() + _line.size() > _queueSize) {
+        _droppedEvents++;
+        return;
+    }
+    if (_queueEvents == 0) {
+        _queueSince = std::chrono::steady_clock::now();
+    }
+    _queue.append(_line);
+    _queueEvents++;
+    // The sender waits for the first event (to start the batch delay) and for full batches
+    if (_queueEvents == 1 || _queueEvents >= _batchSize || _queue.size() >= _queueSize / 2) {
+        _wakeUp.notify_one();
+    }
+}
+
+void ShippingAppender::sender()
+{
+    std::string                  batch;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop || _queueEvents) {
+        auto deadline = _queueSince + std::chrono::milliseconds(_batchDelayMs);
+        bool ready    = _stop || _queueEvents >= _batchSize || _queue.size() >= _queueSize / 2
+                     || (_queueEvents && std::chrono::steady_clock::now() >= deadline);
+        if (!ready) {
+            if (_queueEvents) {
+                _wakeUp.wait_until(lock, deadline);
+            } else if (_spoolPending) {
+                // Replay the spool without waiting for new events
+                lock.unlock();
+                if (_socket == -1) {
+                    connect();
+                }
+                lock.lock();
+                if (_spoolPending && !_stop && !_queueEvents) {
+                    _wakeUp.wait_for(lock, std::chrono::milliseconds(_reconnectDelayMs));
+                }
+            } else {
+                _wakeUp.wait(lock);
+            }
+            continue;
+        }
+
+        batch.swap(_queue);
+        _queue.clear();
+        uint32_t events = _queueEvents;
+        _queueEvents    = 0;
+        bool stopping   = _stop;
+        lock.unlock();
+
+        if (!buildFrame(batch, events)) {
+            _droppedEvents += events;
+        } else if (stopping && _socket == -1) {
+            // No new connection (and replay) when closing
+            spool(events);
+        } else {
+            ship(events);
+        }
+
+        lock.lock();
+    }
+}
+
+bool ShippingAppender::buildFrame(const std::string& lines, uint32_t events)
+{
+    uLongf compressedSize = compressBound(uLong(lines.size()));
+    _frame.resize(FRAME_HEADER_SIZE + compressedSize);
+    if (compress2(reinterpret_cast<Bytef*>(&_frame[FRAME_HEADER_SIZE]), &compressedSize,
+            reinterpret_cast<const Bytef*>(lines.data()), uLong(lines.size()), _compressionLevel)
+        != Z_OK) {
+        // Never sent: the collector would take the frame for garbage and drop the connection
+        _frame.clear();
+        return false;
+    }
+    _frame.resize(FRAME_HEADER_SIZE + compressedSize);
+    putUint32(&_frame[0], FTY_LOG_SHIPPING_MAGIC);
+    putUint32(&_frame[4], uint32_t(compressedSize));
+    putUint32(&_frame[8], uint32_t(lines.size()));
+    putUint32(&_frame[12], events);
+    return true;
+}
+
+bool ShippingAppender::connect()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (_port.empty() || now < _nextConnect) {
+        return false;
+    }
+    _nextConnect = now + std::chrono::milliseconds(_reconnectDelayMs);
+
+    struct addrinfo  hints  = {};
+    struct addrinfo* result = nullptr;
+    hints.ai_family         = AF_UNSPEC;
+    hints.ai_socktype       = SOCK_STREAM;
+    if (getaddrinfo(_host.c_str(), _port.c_str(), &hints, &result) != 0) {
+        return false;
+    }
+
+    for (struct addrinfo* address = result; address && _socket == -1; address = address->ai_next) {
+        int fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, address->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        int error = 0;
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == -1) {
+            error = errno;
+            if (error == EINPROGRESS) {
+                struct pollfd ready = {fd, POLLOUT, 0};
+                socklen_t     size  = sizeof(error);
+                if (poll(&ready, 1, NETWORK_TIMEOUT_MS) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) == -1) {
+                    error = ETIMEDOUT;
+                }
+            }
+        }
+        if (error) {
+            ::close(fd);
+            continue;
+        }
+
+        // Blocking writes, bounded in time
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        struct timeval timeout = {NETWORK_TIMEOUT_MS / 1000, (NETWORK_TIMEOUT_MS % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        int keepAlive = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(keepAlive));
+        _socket = fd;
+    }
+    freeaddrinfo(result);
+
+    if (_socket == -1) {
+        return false;
+    }
+    _connected = true;
+    if (_spoolPending && !replaySpool()) {
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+void ShippingAppender::disconnect()
+{
+    if (_socket != -1) {
+        ::close(_socket);
+        _socket = -1;
+    }
+    _connected = false;
+}
+
+bool ShippingAppender::sendAll(const char* data, size_t size)
+{
+    while (size) {
+        ssize_t r = send(_socket, data, size, MSG_NOSIGNAL);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        data += r;
+        size -= size_t(r);
+    }
+    return true;
+}
+
+bool ShippingAppender::peerClosed()
+{
+    char    byte;
+    ssize_t r = recv(_socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return r == 0 || (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+void ShippingAppender::ship(uint32_t events)
+{
+    if (_socket != -1 && peerClosed()) {
+        // Reconnect at once to a restarted collector
+        disconnect();
+        _nextConnect = std::chrono::steady_clock::now();
+    }
+    if (_socket == -1 && !connect()) {
+        spool(events);
+        return;
+    }
+    if (!sendAll(_frame.data(), _frame.size())) {
+        disconnect();
+        spool(events);
+        return;
+    }
+    _sentEvents += events;
+}
+
+void ShippingAppender::spool(uint32_t events)
+{
+    if (_spoolFile.empty() || _frame.size() > _spoolMaxSize / 2) {
+        _droppedEvents += events;
+        return;
+    }
+
+    struct stat st;
+    if (stat(_spoolFile.c_str(), &st) == 0 && uint64_t(st.st_size) + _frame.size() > _spoolMaxSize / 2) {
+        // The oldest half of the spool is discarded
+        rename(_spoolFile.c_str(), (_spoolFile + ".1").c_str());
+    }
+
+    int fd = ::open(_spoolFile.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+    if (fd == -1 || write(fd, _frame.data(), _frame.size()) != ssize_t(_frame.size())) {
+        _droppedEvents += events;
+    } else {
+        _spooledEvents += events;
+        _spoolPending = true;
+    }
+    if (fd != -1) {
+        ::close(fd);
+    }
+}
+
+bool ShippingAppender::replaySpool()
+{
+    std::string frame;
+    for (const std::string& path : {_spoolFile + ".1", _spoolFile}) {
+        FILE* file = fopen(path.c_str(), "rbe");
+        if (!file) {
+            continue;
+        }
+        char header[FRAME_HEADER_SIZE];
+        bool sent = true;
+        // A truncated last frame (write interrupted by a crash) is ignored
+        while (sent && fread(header, sizeof(header), 1, file) == 1 && getUint32(header) == FTY_LOG_SHIPPING_MAGIC) {
+            frame.assign(header, sizeof(header));
+            frame.resize(sizeof(header) + getUint32(header + 4));
+            if (fread(&frame[sizeof(header)], frame.size() - sizeof(header), 1, file) != 1) {
+                break;
+            }
+            sent = sendAll(frame.data(), frame.size());
+            if (sent) {
+                _sentEvents += getUint32(header + 12);
+            }
+        }
+        fclose(file);
+        if (!sent) {
+            return false;
+        }
+    }
+    unlink((_spoolFile + ".1").c_str());
+    unlink(_spoolFile.c_str());
+    _spoolPending = false;
+    return true;
+}
+
+uint64_t ShippingAppender::sentEvents() const
+{
+    return _sentEvents.load();
+}
+
+uint64_t ShippingAppender::spooledEvents() const
+{
+    return _spooledEvents.load();
+}
+
+uint64_t ShippingAppender::droppedEvents() const
+{
+    return _droppedEvents.load();
+}
+
+bool ShippingAppender::connected() const
+{
+    return _connected.load();
+}
+
+void ShippingAppender::registerFactory()
+{
+    log4cplus::spi::getAppenderFactoryRegistry().put(std::unique_ptr<log4cplus::spi::AppenderFactory>(
+        new log4cplus::spi::FactoryTempl<ShippingAppender, log4cplus::spi::AppenderFactory>(
+            LOG4CPLUS_TEXT("fty::logger::ShippingAppender"))));
+}
+
+} // namespace fty::logger
@@ -0,0 +1,700 @@
+/*  =========================================================================
+    fty_shm_transport - Shared memory transport of the logs to a collector
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty_shm_transport - Shared memory transport of the logs to a collector
+@discuss
+    Ring layout: a header (magic, version, capacity, pid of the producer,
+    head written by the producer, tail and heartbeat written by the
+    collector) followed by the data area. Each record is a RecordHeader
+    followed by the logger name and the rendered line, padded to 8 bytes.
+    A record never wraps: when it does not fit before the end of the data
+    area, the producer writes a record of size 0 (if there is room for a
+    header) and continues at the beginning, the consumer skipping both the
+    marker and any space too small for a header.
+
+    A producer re-creating its ring (a transport dropped and set again)
+    gets a new shared memory object under the same name: the collector
+    tells it from the one it attached by its inode.
+@end
+ */
+#include "fty-log/fty_shm_transport.h"
+#include "fty-log/fty_log_index.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fty::logger {
+
+static constexpr uint32_t RING_MAGIC   = 0x46544c52; // "FTLR"
+static constexpr uint32_t RING_VERSION = 1;
+
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    int64_t  pid;
+    // written by the producer
+    alignas(64) std::atomic<uint64_t> head;
+    // written by the collector
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> heartbeatMs;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring needs address-free atomics");
+
+struct RecordHeader
+{
+    // Size of the whole record, padding included; 0 for the end-of-area marker
+    uint32_t size;
+    uint32_t lineSize;
+    int64_t  timestampUs;
+    int32_t  level;
+    uint16_t loggerNameSize;
+    uint16_t reserved;
+};
+
+static constexpr size_t DATA_OFFSET = (sizeof(ShmRingHeader) + 63) & ~size_t(63);
+
+static size_t align8(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+static uint64_t monotonicMs()
+{
+    return uint64_t(
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+////////////////////////
+// ShmRing section
+////////////////////////
+
+ShmRing::ShmRing(const std::string& name, ino_t inode, void* mapping, size_t mappingSize)
+    : _name(name)
+    , _inode(inode)
+    , _mapping(mapping)
+    , _mappingSize(mappingSize)
+    , _header(static_cast<ShmRingHeader*>(mapping))
+    , _data(static_cast<char*>(mapping) + DATA_OFFSET)
+{
+}
+
+ShmRing::~ShmRing()
+{
+    munmap(_mapping, _mappingSize);
+}
+
+std::unique_ptr<ShmRing> ShmRing::create(const std::string& name, size_t capacity)
+{
+    // Capacity is a power of 2 to wrap positions with a mask
+    size_t size = 4096;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    size_t mappingSize = DATA_OFFSET + size;
+
+    // A ring left by a dead process with the same pid is replaced
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0660);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (ftruncate(fd, off_t(mappingSize)) == -1 || fstat(fd, &st) == -1) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    ShmRingHeader* header = new (mapping) ShmRingHeader;
+    header->capacity      = size;
+    header->pid           = getpid();
+    header->head.store(0);
+    header->tail.store(0);
+    header->heartbeatMs.store(0);
+    header->version = RING_VERSION;
+    // Valid only once initialized
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = RING_MAGIC;
+
+    return std::unique_ptr<ShmRing>(new ShmRing(name, st.st_ino, mapping, mappingSize));
+}
+
+std::unique_ptr<ShmRing> ShmRing::open(const std::string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || size_t(st.st_size) <= DATA_OFFSET) {
+        close(fd);
+        return nullptr;
+    }
+    size_t mappingSize = size_t(st.st_size);
+    void*  mapping     = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto* header = static_cast<ShmRingHeader*>(mapping);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != RING_MAGIC || header->version != RING_VERSION
+        || DATA_OFFSET + header->capacity != mappingSize) {
+        munmap(mapping, mappingSize);
+        return nullptr;
+    }
+    return std::unique_ptr<ShmRing>(new ShmRing(name, st.st_ino, mapping, mappingSize));
+}
+
+bool ShmRing::write(int64_t timestampUs, int level, const std::string& loggerName, const char* line, size_t size)
+{
+    const uint64_t capacity   = _header->capacity;
+    const size_t   nameSize   = std::min<size_t>(loggerName.size(), UINT16_MAX);
+    const size_t   recordSize = align8(sizeof(RecordHeader) + nameSize + size);
+    if (recordSize > capacity / 2) {
+        return false;
+    }
+
+    uint64_t head = _header->head.load(std::memory_order_relaxed);
+    uint64_t tail = _header->tail.load(std::memory_order_acquire);
+
+    size_t position   = size_t(head & (capacity - 1));
+    size_t contiguous = size_t(capacity) - position;
+    size_t skipped    = contiguous < recordSize ? contiguous : 0;
+
+    if (head + skipped + recordSize - tail > capacity) {
+        return false;
+    }
+
+    if (skipped) {
+        if (skipped >= sizeof(RecordHeader)) {
+            RecordHeader marker{};
+            memcpy(_data + position, &marker, sizeof(marker));
+        }
+        position = 0;
+    }
+
+    RecordHeader record{};
+    record.size           = uint32_t(recordSize);
+    record.lineSize       = uint32_t(size);
+    record.timestampUs    = timestampUs;
+    record.level          = level;
+    record.loggerNameSize = uint16_t(nameSize);
+
+    char* out = _data + position;
+    memcpy(out, &record, sizeof(record));
+    memcpy(out + sizeof(record), loggerName.data(), nameSize);
+    memcpy(out + sizeof(record) + nameSize, line, size);
+
+    _header->head.store(head + skipped + recordSize, std::memory_order_release);
+    return true;
+}
+
+size_t ShmRing::read(std::vector<ShmRecord>& out)
+{
+    const uint64_t capacity = _header->capacity;
+    uint64_t       tail     = _header->tail.load(std::memory_order_relaxed);
+    uint64_t       head     = _header->head.load(std::memory_order_acquire);
+    size_t         count    = 0;
+
+    while (tail < head) {
+        size_t position   = size_t(tail & (capacity - 1));
+        size_t contiguous = size_t(capacity) - position;
+        if (contiguous < sizeof(RecordHeader)) {
+            tail += contiguous;
+            continue;
+        }
+
+        RecordHeader record;
+        memcpy(&record, _data + position, sizeof(record));
+        if (record.size == 0) {
+            tail += contiguous;
+            continue;
+        }
+        if (record.size > contiguous || record.size > head - tail
+            || sizeof(record) + record.loggerNameSize + record.lineSize > record.size) {
+            // Corrupted ring: drop its content
+            tail = head;
+            break;
+        }
+
+        const char* payload = _data + position + sizeof(record);
+        out.push_back(ShmRecord{record.timestampUs, record.level, std::string(payload, record.loggerNameSize),
+            std::string(payload + record.loggerNameSize, record.lineSize)});
+        count++;
+        tail += record.size;
+    }
+
+    _header->tail.store(tail, std::memory_order_release);
+    return count;
+}
+
+void ShmRing::heartbeat()
+{
+    _header->heartbeatMs.store(monotonicMs(), std::memory_order_release);
+}
+
+bool ShmRing::collectorAlive(uint64_t staleMs) const
+{
+    uint64_t heartbeat = _header->heartbeatMs.load(std::memory_order_acquire);
+    return heartbeat != 0 && monotonicMs() - heartbeat <= staleMs;
+}
+
+bool ShmRing::empty() const
+{
+    return _header->head.load(std::memory_order_acquire) == _header->tail.load(std::memory_order_acquire);
+}
+
+pid_t ShmRing::pid() const
+{
+    return pid_t(_header->pid);
+}
+
+const std::string& ShmRing::name() const
+{
+    return _name;
+}
+
+ino_t ShmRing::inode() const
+{
+    return _inode;
+}
+
+void ShmRing::unlink()
+{
+    shm_unlink(_name.c_str());
+}
+
+////////////////////////
+// ShmTransport section
+////////////////////////
+
+std::string ShmTransport::ringName(const std::string& prefix, pid_t pid)
+{
+    return "/" + prefix + "." + std::to_string(pid);
+}
+
+// Transports of this process by prefix
+static std::mutex                                         transportsMutex;
+static std::map<std::string, std::weak_ptr<ShmTransport>> transports;
+
+// Living transports, for the fork handlers
+static std::mutex                 instancesMutex;
+static std::vector<ShmTransport*> instances;
+
+std::shared_ptr<ShmTransport> ShmTransport::get(const std::string& prefix, size_t capacity)
+{
+    static std::once_flag forkHandlers;
+    std::call_once(forkHandlers, [] {
+        pthread_atfork(&ShmTransport::prepareFork, &ShmTransport::parentAfterFork, &ShmTransport::childAfterFork);
+    });
+
+    std::lock_guard<std::mutex>    lock(transportsMutex);
+    std::shared_ptr<ShmTransport>  transport = transports[prefix].lock();
+    if (!transport) {
+        std::unique_ptr<ShmRing> ring = ShmRing::create(ringName(prefix, getpid()), capacity);
+        if (!ring) {
+            fprintf(stderr, "[ERROR]: %s:%d (%s) can't create shared memory log ring %s: %s\n", __FILE__,
+                __LINE__, __func__, ringName(prefix, getpid()).c_str(), strerror(errno));
+            return nullptr;
+        }
+        transport.reset(new ShmTransport(std::move(ring)));
+        transports[prefix] = transport;
+    }
+    return transport;
+}
+
+ShmTransport::ShmTransport(std::unique_ptr<ShmRing> ring)
+    : _ring(std::move(ring))
+{
+    std::lock_guard<std::mutex> lock(instancesMutex);
+    instances.push_back(this);
+}
+
+ShmTransport::~ShmTransport()
+{
+    {
+        std::lock_guard<std::mutex> lock(instancesMutex);
+        instances.erase(std::find(instances.begin(), instances.end(), this));
+    }
+    // A ring with pending events is left to the collector, which removes it
+    // once drained; the ring of a detached transport is the parent's
+    if (!_detached && (_ring->empty() || !_ring->collectorAlive(COLLECTOR_TIMEOUT_MS))) {
+        _ring->unlink();
+    }
+}
+
+bool ShmTransport::write(int64_t timestampUs, int level, const std::string& loggerName, const char* line, size_t size)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_detached && _ring->collectorAlive(COLLECTOR_TIMEOUT_MS)
+        && _ring->write(timestampUs, level, loggerName, line, size)) {
+        return true;
+    }
+    _fallbacks++;
+    return false;
+}
+
+bool ShmTransport::connected() const
+{
+    return !_detached && _ring->collectorAlive(COLLECTOR_TIMEOUT_MS);
+}
+
+void ShmTransport::prepareFork()
+{
+    transportsMutex.lock();
+    instancesMutex.lock();
+    for (ShmTransport* instance : instances) {
+        instance->_mutex.lock();
+    }
+}
+
+void ShmTransport::parentAfterFork()
+{
+    for (ShmTransport* instance : instances) {
+        instance->_mutex.unlock();
+    }
+    instancesMutex.unlock();
+    transportsMutex.unlock();
+}
+
+void ShmTransport::childAfterFork()
+{
+    // A ring has a single producer: the rings are left to the parent, the
+    // next get() of the child creates the ring of its own pid
+    for (ShmTransport* instance : instances) {
+        instance->_detached = true;
+        instance->_mutex.unlock();
+    }
+    instancesMutex.unlock();
+    transports.clear();
+    transportsMutex.unlock();
+}
+
+uint64_t ShmTransport::fallbacks() const
+{
+    return _fallbacks.load();
+}
+
+////////////////////////
+// RotatingFile section
+////////////////////////
+
+// Size of the buffer triggering a write
+static constexpr size_t ROTATING_FILE_BUFFER = 64 * 1024;
+
+RotatingFile::RotatingFile(const std::string& path, uint64_t maxFileSize, unsigned maxBackups)
+    : _path(path)
+    , _maxFileSize(maxFileSize)
+    , _maxBackups(maxBackups)
+    , _fd(-1)
+    , _fileSize(0)
+{
+    _buffer.reserve(ROTATING_FILE_BUFFER);
+    open();
+}
+
+RotatingFile::~RotatingFile()
+{
+    flush();
+    if (_fd != -1) {
+        close(_fd);
+    }
+}
+
+void RotatingFile::open()
+{
+    _fd = ::open(_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+    if (_fd == -1) {
+        fprintf(stderr, "[ERROR]: %s:%d (%s) can't open %s: %s\n", __FILE__, __LINE__, __func__, _path.c_str(),
+            strerror(errno));
+        _fileSize = 0;
+        return;
+    }
+    struct stat st;
+    _fileSize = fstat(_fd, &st) == 0 ? uint64_t(st.st_size) : 0;
+}
+
+void RotatingFile::rotate()
+{
+    flush();
+    if (_fd != -1) {
+        close(_fd);
+        _fd = -1;
+    }
+
+    if (_maxBackups == 0) {
+        ::unlink(_path.c_str());
+    } else {
+        for (unsigned i = _maxBackups; i > 1; i--) {
+            std::string from = _path + "." + std::to_string(i - 1);
+            std::string to   = _path + "." + std::to_string(i);
+            rename(from.c_str(), to.c_str());
+        }
+        rename(_path.c_str(), (_path + ".1").c_str());
+    }
+    onRotate();
+    open();
+}
+
+void RotatingFile::onRotate()
+{
+}
+
+uint64_t RotatingFile::append(const char* data, size_t size)
+{
+    uint64_t current = _fileSize + _buffer.size();
+    if (_maxFileSize && current > 0 && current + size > _maxFileSize) {
+        rotate();
+        current = _fileSize;
+    }
+    _buffer.append(data, size);
+    if (_buffer.size() >= ROTATING_FILE_BUFFER) {
+        flush();
+    }
+    return current;
+}
+
+void RotatingFile::flush()
+{
+    size_t written = 0;
+    while (_fd != -1 && written < _buffer.size()) {
+        ssize_t r = ::write(_fd, _buffer.data() + written, _buffer.size() - written);
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "[ERROR]: %s:%d (%s) can't write to %s: %s\n", __FILE__, __LINE__, __func__,
+                _path.c_str(), strerror(errno));
+            break;
+        }
+        written += size_t(r);
+    }
+    _fileSize += written;
+    _buffer.clear();
+}
+
+void RotatingFile::sync()
+{
+    flush();
+    if (_fd != -1) {
+        fdatasync(_fd);
+    }
+}
+
+bool RotatingFile::isOpen() const
+{
+    return _fd != -1;
+}
+
+const std::string& RotatingFile::path() const
+{
+    return _path;
+}
+
+uint64_t RotatingFile::offset() const
+{
+    return _fileSize + _buffer.size();
+}
+
+////////////////////////
+// ShmCollector section
+////////////////////////
+
+// Delay between two scans of the shared memory directory
+static constexpr uint64_t DISCOVERY_INTERVAL_MS = 1000;
+
+ShmCollector::ShmCollector(const Options& options)
+    : _options(options)
+    , _store(new IndexedRotatingFile(options.output, options.maxFileSize, options.maxBackups, options.index))
+    , _sequence(0)
+    , _lastDiscoveryMs(0)
+    , _lastSyncMs(monotonicMs())
+{
+}
+
+ShmCollector::~ShmCollector()
+{
+    flush();
+}
+
+void ShmCollector::discover()
+{
+    DIR* dir = opendir(_options.shmDirectory.c_str());
+    if (!dir) {
+        return;
+    }
+
+    // Rings currently in the directory, by name, with their inode
+    std::map<std::string, ino_t> found;
+    const std::string            prefix = _options.prefix + ".";
+    while (struct dirent* entry = readdir(dir)) {
+        std::string file = entry->d_name;
+        if (file.compare(0, prefix.size(), prefix) != 0 || file.size() == prefix.size()
+            || file.find_first_not_of("0123456789", prefix.size()) != std::string::npos) {
+            continue;
+        }
+        struct stat st;
+        if (stat((_options.shmDirectory + "/" + file).c_str(), &st) == 0) {
+            found.emplace("/" + file, st.st_ino);
+        }
+    }
+    closedir(dir);
+
+    // Rings removed or re-created by their producer are read a last time and dropped
+    for (auto it = _rings.begin(); it != _rings.end();) {
+        auto current = found.find(it->first);
+        if (current == found.end() || current->second != it->second->inode()) {
+            read(*it->second);
+            it = _rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const auto& entry : found) {
+        if (_rings.count(entry.first)) {
+            continue;
+        }
+        if (std::unique_ptr<ShmRing> ring = ShmRing::open(entry.first)) {
+            ring->heartbeat();
+            _rings.emplace(entry.first, std::move(ring));
+        }
+    }
+}
+
+void ShmCollector::read(ShmRing& ring)
+{
+    _records.clear();
+    ring.read(_records);
+    for (ShmRecord& record : _records) {
+        _pending.push_back(Pending{record.timestampUs, _sequence++, std::move(record)});
+    }
+}
+
+void ShmCollector::drain()
+{
+    for (auto it = _rings.begin(); it != _rings.end();) {
+        ShmRing& ring = *it->second;
+
+        // Whether the producer is gone is checked before draining, so that
+        // nothing it wrote before exiting can be left behind
+        bool dead = kill(ring.pid(), 0) == -1 && errno == ESRCH;
+
+        ring.heartbeat();
+        read(ring);
+
+        if (dead) {
+            ring.unlink();
+            it = _rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ShmCollector::write(int64_t upToUs)
+{
+    // Merge the events of all the producers in timestamp order (arrival order for equal timestamps)
+    std::sort(_pending.begin(), _pending.end(), [](const Pending& a, const Pending& b) {
+        return a.timestampUs != b.timestampUs ? a.timestampUs < b.timestampUs : a.sequence < b.sequence;
+    });
+
+    size_t count = 0;
+    while (count < _pending.size() && _pending[count].timestampUs <= upToUs) {
+        const ShmRecord& record = _pending[count].record;
+        _store->append(record.line.data(), record.line.size(), record.timestampUs, record.level, record.loggerName);
+        count++;
+    }
+    _pending.erase(_pending.begin(), _pending.begin() + std::ptrdiff_t(count));
+    _store->flush();
+
+    uint64_t now = monotonicMs();
+    if (count && now - _lastSyncMs >= _options.syncIntervalMs) {
+        _store->sync();
+        _lastSyncMs = now;
+    }
+    return count;
+}
+
+size_t ShmCollector::poll()
+{
+    uint64_t now = monotonicMs();
+    if (_lastDiscoveryMs == 0 || now - _lastDiscoveryMs >= DISCOVERY_INTERVAL_MS) {
+        discover();
+        _lastDiscoveryMs = now;
+    }
+    drain();
+
+    int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch())
+                        .count();
+    return write(nowUs - int64_t(_options.reorderWindowMs) * 1000);
+}
+
+size_t ShmCollector::flush()
+{
+    drain();
+    size_t count = write(INT64_MAX);
+    _store->sync();
+    _lastSyncMs = monotonicMs();
+    return count;
+}
+
+void ShmCollector::run(const std::atomic<bool>& stop, unsigned intervalMs)
+{
+    while (!stop.load()) {
+        poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+    flush();
+}
+
+size_t ShmCollector::ringCount() const
+{
+    return _rings.size();
+}
+
+} // namespace fty::logger
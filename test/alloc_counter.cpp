@@ -0,0 +1,86 @@
+#include "alloc_counter.h"
+#include <cstdlib>
+
+// glibc entry points used by the interposed allocation functions below
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t nmemb, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void  __libc_free(void* ptr);
+}
+
+static thread_local bool   counting    = false;
+static thread_local size_t allocations = 0;
+
+static void countAllocation()
+{
+    if (counting) {
+        ++allocations;
+    }
+}
+
+extern "C" {
+
+void* malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    countAllocation();
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : 12 /* ENOMEM */;
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+}
+
+namespace fty::test {
+
+AllocationCounter::AllocationCounter()
+{
+    allocations = 0;
+    counting    = true;
+}
+
+AllocationCounter::~AllocationCounter()
+{
+    counting = false;
+}
+
+size_t AllocationCounter::count() const
+{
+    return allocations;
+}
+
+} // namespace fty::test
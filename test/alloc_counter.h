@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+
+namespace fty::test {
+
+// Count the heap allocations (malloc family, and thus operator new) done by
+// the current thread while an instance is alive
+class AllocationCounter
+{
+public:
+    AllocationCounter();
+    ~AllocationCounter();
+
+    size_t count() const;
+};
+
+} // namespace fty::test
@@ -0,0 +1,157 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_console_appender.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <chrono>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+using fty::logger::NonBlockingConsoleAppender;
+
+// Read what is available in a non-blocking pipe
+static std::string readAvailable(int fd)
+{
+    std::string content;
+    char        buffer[4096];
+    for (ssize_t r; (r = read(fd, buffer, sizeof(buffer))) > 0;) {
+        content.append(buffer, size_t(r));
+    }
+    return content;
+}
+
+TEST_CASE("Non-blocking console appender")
+{
+    int fds[2];
+    REQUIRE(pipe2(fds, O_CLOEXEC | O_NONBLOCK) == 0);
+    // Smallest pipe, to fill it quickly
+    fcntl(fds[1], F_SETPIPE_SZ, 4096);
+    // The console appender is given a blocking descriptor, as stderr usually is
+    fcntl(fds[1], F_SETFL, 0);
+
+    Ftylog  log("fty-log-console-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    auto* appender = new NonBlockingConsoleAppender(fds[1], 16 * 1024);
+    appender->setLayout(std::unique_ptr<log4cplus::Layout>(new log4cplus::PatternLayout("%p %m%n")));
+    log4cplus::SharedAppenderPtr appenderPtr(appender);
+    fty::test::setOnlyAppender("fty-log-console-test", appenderPtr);
+
+    SECTION("Output flows when the console is read")
+    {
+        std::string output;
+        for (int i = 0; i < 1000; i++) {
+            log_info_log(ftylog, "event %d", i);
+            output += readAvailable(fds[0]);
+        }
+        appender->close();
+        output += readAvailable(fds[0]);
+
+        std::string expected;
+        for (int i = 0; i < 1000; i++) {
+            expected += "INFO event " + std::to_string(i) + "\n";
+        }
+        CHECK(output == expected);
+        CHECK(appender->droppedBytes() == 0);
+    }
+
+    SECTION("Logging keeps its latency on a full console")
+    {
+        // Nobody reads the pipe
+        auto slowest = std::chrono::steady_clock::duration::zero();
+        for (int i = 0; i < 10000; i++) {
+            auto start = std::chrono::steady_clock::now();
+            log_info_log(ftylog, "event %d with some padding to fill the console faster", i);
+            slowest = std::max(slowest, std::chrono::steady_clock::now() - start);
+        }
+        CHECK(slowest < std::chrono::milliseconds(50));
+        CHECK(appender->droppedEvents() > 0);
+    }
+
+    SECTION("Events are dropped on a full console")
+    {
+        // Nobody reads the pipe: what does not fit in the pipe and the buffer is dropped
+        const size_t shortest = strlen("INFO event 0 with some padding to fill the console faster\n");
+        for (int i = 0; i < 10000; i++) {
+            log_info_log(ftylog, "event %d with some padding to fill the console faster", i);
+        }
+        CHECK(appender->droppedEvents() >= 10000 - (4096 + 16 * 1024) / shortest);
+        CHECK(appender->droppedBytes() >= appender->droppedEvents() * shortest);
+
+        // A FATAL event waits for the console
+        std::atomic<bool> logged{false};
+        std::thread       fatal([&] {
+            log_fatal_log(ftylog, "fatal event");
+            logged = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CHECK(!logged);
+
+        std::string output;
+        while (!logged) {
+            output += readAvailable(fds[0]);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        fatal.join();
+        output += readAvailable(fds[0]);
+
+        CHECK(output.find("fty-log: console output stalled, ") != std::string::npos);
+        CHECK(output.size() >= strlen("FATAL fatal event\n"));
+        CHECK(output.compare(output.size() - strlen("FATAL fatal event\n"), std::string::npos, "FATAL fatal event\n")
+              == 0);
+    }
+
+    SECTION("A FATAL event does not wait for a console stalled for good")
+    {
+        for (int i = 0; i < 1000; i++) {
+            log_info_log(ftylog, "event %d with some padding to fill the console faster", i);
+        }
+        uint64_t dropped = appender->droppedEvents();
+        log_fatal_log(ftylog, "fatal event");
+        // Older events made room for it
+        CHECK(appender->droppedEvents() > dropped);
+
+        std::string output;
+        auto        deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (output.find("FATAL fatal event\n") == std::string::npos && std::chrono::steady_clock::now() < deadline) {
+            output += readAvailable(fds[0]);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(output.find("FATAL fatal event\n") != std::string::npos);
+    }
+
+    log4cplus::Logger::getInstance("fty-log-console-test").removeAllAppenders();
+    appender->close();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_CASE("Non-blocking console mode")
+{
+    Ftylog log("fty-log-console-mode-test");
+
+    auto consoleAppenders = [](bool nonBlocking) {
+        int count = 0;
+        for (auto& appender : log4cplus::Logger::getInstance("fty-log-console-mode-test").getAllAppenders()) {
+            log4cplus::Appender& app = *appender;
+            count += nonBlocking ? typeid(app) == typeid(NonBlockingConsoleAppender)
+                                 : typeid(app) == typeid(log4cplus::ConsoleAppender);
+        }
+        return count;
+    };
+    CHECK(consoleAppenders(false) == 1);
+
+    log.setConsoleNonBlocking(true);
+    CHECK(consoleAppenders(false) == 0);
+    CHECK(consoleAppenders(true) == 1);
+
+    log.setVerboseMode();
+    CHECK(consoleAppenders(true) == 1);
+
+    log.setConsoleNonBlocking(false);
+    CHECK(consoleAppenders(false) == 1);
+    CHECK(consoleAppenders(true) == 0);
+}
@@ -0,0 +1,112 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "alloc_counter.h"
+#include "fty_log.h"
+#include "test_appender.h"
+
+struct Point
+{
+    int x, y;
+};
+
+template <>
+struct fmt::formatter<Point> : fmt::formatter<int>
+{
+    template <typename FormatContext>
+    auto format(const Point& p, FormatContext& ctx) const
+    {
+        return fmt::format_to(ctx.out(), "({}, {})", p.x, p.y);
+    }
+};
+
+TEST_CASE("fmt log")
+{
+    Ftylog log("fty-log-fmt-test");
+    log.setLogLevelTrace();
+
+    auto appender = new fty::test::MessagesAppender;
+    fty::test::setOnlyAppender("fty-log-fmt-test", appender);
+
+    SECTION("Formatting")
+    {
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "{} is {}", "answer", 42);
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "point {}", Point{1, 2});
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "{}% done", 100);
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "no {} args %s");
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, std::string("{:>4}"), 7);
+
+        REQUIRE(appender->messages.size() == 5);
+        CHECK(appender->messages[0] == "answer is 42");
+        CHECK(appender->messages[1] == "point (1, 2)");
+        CHECK(appender->messages[2] == "100% done");
+        CHECK(appender->messages[3] == "no {} args %s");
+        CHECK(appender->messages[4] == "   7");
+    }
+
+    SECTION("Level")
+    {
+        log.setLogLevelWarning();
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "{}", 1);
+        log.insertLogFmt(log4cplus::ERROR_LOG_LEVEL, __FILE__, __LINE__, __func__, "{}", 2);
+
+        REQUIRE(appender->messages.size() == 1);
+        CHECK(appender->messages[0] == "2");
+    }
+
+    SECTION("Invalid format")
+    {
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, std::string("{:d}"), "text");
+        CHECK(appender->messages.empty());
+    }
+
+    SECTION("Allocations")
+    {
+        fty::test::setOnlyAppender("fty-log-fmt-test", new log4cplus::NullAppender);
+
+        // warm up the per-thread buffers
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__,
+            "device {} replied {} after {:.2f} ms", "ups-1", 1000, 1.5);
+
+        size_t fmtPath = 0;
+        {
+            fty::test::AllocationCounter counter;
+            for (int i = 0; i < 100; i++) {
+                log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__,
+                    "device {} replied {} after {:.2f} ms", "ups-1", i, 1.5);
+            }
+            fmtPath = counter.count();
+        }
+        CHECK(fmtPath == 0);
+
+        size_t legacyPath = 0;
+        {
+            fty::test::AllocationCounter counter;
+            for (int i = 0; i < 100; i++) {
+                log.insertLog(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__,
+                    fty::logger::format("device {} replied {} after {:.2f} ms", "ups-1", i, 1.5).c_str());
+            }
+            legacyPath = counter.count();
+        }
+        CHECK(legacyPath >= 100);
+    }
+}
+
+TEST_CASE("fmt log benchmark", "[.][benchmark]")
+{
+    Ftylog log("fty-log-fmt-bench");
+    log.setLogLevelTrace();
+    fty::test::setOnlyAppender("fty-log-fmt-bench", new log4cplus::NullAppender);
+
+    BENCHMARK("legacy format + printf path")
+    {
+        log.insertLog(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__,
+            fty::logger::format("device {} replied {} after {:.2f} ms", "ups-1", 42, 1.5).c_str());
+    };
+
+    BENCHMARK("fmt path")
+    {
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__,
+            "device {} replied {} after {:.2f} ms", "ups-1", 42, 1.5);
+    };
+}
@@ -0,0 +1,271 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_journald_appender.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <chrono>
+#include <fcntl.h>
+#include <map>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using fty::logger::JournaldAppender;
+
+// Stand-in for the journal socket, validating the wire format of the entries
+class TestJournal
+{
+public:
+    explicit TestJournal(const std::string& path)
+        : _path(path)
+    {
+        unlink(path.c_str());
+        _socket                    = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_un address = {};
+        address.sun_family         = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        REQUIRE(bind(_socket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0);
+        struct timeval timeout = {1, 0};
+        setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    ~TestJournal()
+    {
+        close(_socket);
+        unlink(_path.c_str());
+    }
+
+    // Receive an entry, empty if none came or if it is not well formed
+    std::multimap<std::string, std::string> receive()
+    {
+        std::string datagram(256 * 1024, '\0');
+        union
+        {
+            struct cmsghdr header;
+            char           buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec  iov     = {&datagram[0], datagram.size()};
+        struct msghdr message = {};
+        message.msg_iov        = &iov;
+        message.msg_iovlen     = 1;
+        message.msg_control    = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        ssize_t r = recvmsg(_socket, &message, MSG_CMSG_CLOEXEC);
+        if (r == -1) {
+            return {};
+        }
+        datagram.resize(size_t(r));
+
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        if (header && header->cmsg_type == SCM_RIGHTS) {
+            // Entry passed in a memfd: it must be sealed
+            int fd;
+            memcpy(&fd, CMSG_DATA(header), sizeof(int));
+            _memfds++;
+            int seals = fcntl(fd, F_GET_SEALS);
+            datagram.clear();
+            char buffer[65536];
+            for (ssize_t n; (n = pread(fd, buffer, sizeof(buffer), off_t(datagram.size()))) > 0;) {
+                datagram.append(buffer, size_t(n));
+            }
+            close(fd);
+            if (!(seals & F_SEAL_WRITE) || !(seals & F_SEAL_SHRINK) || !(seals & F_SEAL_GROW)) {
+                return {};
+            }
+        }
+        return parse(datagram);
+    }
+
+    int memfds() const
+    {
+        return _memfds;
+    }
+
+private:
+    static bool validName(const std::string& name)
+    {
+        if (name.empty() || name.size() > 64 || name[0] == '_' || (name[0] >= '0' && name[0] <= '9')) {
+            return false;
+        }
+        for (char c : name) {
+            if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::multimap<std::string, std::string> parse(const std::string& entry)
+    {
+        std::multimap<std::string, std::string> fields;
+        size_t                                  position = 0;
+        while (position < entry.size()) {
+            size_t end = entry.find_first_of("=\n", position);
+            if (end == std::string::npos) {
+                return {};
+            }
+            std::string name = entry.substr(position, end - position);
+            if (!validName(name)) {
+                return {};
+            }
+            std::string value;
+            if (entry[end] == '=') {
+                size_t newline = entry.find('\n', end);
+                if (newline == std::string::npos) {
+                    return {};
+                }
+                value    = entry.substr(end + 1, newline - end - 1);
+                position = newline + 1;
+            } else {
+                // Binary form: little-endian 64-bit size, value, newline
+                if (end + 9 > entry.size()) {
+                    return {};
+                }
+                uint64_t size = 0;
+                for (int i = 0; i < 8; i++) {
+                    size |= uint64_t(uint8_t(entry[end + 1 + size_t(i)])) << (8 * i);
+                }
+                if (end + 9 + size + 1 > entry.size() || entry[end + 9 + size] != '\n') {
+                    return {};
+                }
+                value    = entry.substr(end + 9, size);
+                position = end + 9 + size + 1;
+            }
+            fields.emplace(name, value);
+        }
+        return fields;
+    }
+
+    std::string _path;
+    int         _socket;
+    int         _memfds = 0;
+};
+
+static std::string field(const std::multimap<std::string, std::string>& entry, const std::string& name)
+{
+    auto it = entry.find(name);
+    return it == entry.end() ? "<missing>" : it->second;
+}
+
+TEST_CASE("Journald field names")
+{
+    CHECK(fty::logger::journaldFieldName("request-id") == "REQUEST_ID");
+    CHECK(fty::logger::journaldFieldName("_PID") == "PID");
+    CHECK(fty::logger::journaldFieldName("9lives") == "LIVES");
+    CHECK(fty::logger::journaldFieldName("__") == "");
+    CHECK(fty::logger::journaldFieldName(std::string(100, 'a')) == std::string(64, 'A'));
+}
+
+TEST_CASE("Journald appender")
+{
+    std::string path = "/tmp/fty-log-journal-test-" + std::to_string(getpid()) + ".socket";
+    TestJournal journal(path);
+
+    Ftylog  log("fty-log-journal-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    auto* appender = new JournaldAppender("fty-test", path);
+    log4cplus::SharedAppenderPtr appenderPtr(appender);
+    fty::test::setOnlyAppender("fty-log-journal-test", appenderPtr);
+
+    SECTION("Fields")
+    {
+        Ftylog::setContext({{"request-id", "42"}, {"_private", "x"}, {"priority", "0"}});
+        log_warning_log(ftylog, "structured %s", "event");
+        Ftylog::clearContext();
+        auto entry = journal.receive();
+
+        CHECK(field(entry, "MESSAGE") == "structured event");
+        CHECK(field(entry, "PRIORITY") == "4");
+        CHECK(entry.count("PRIORITY") == 1);
+        CHECK(field(entry, "CODE_FILE").find("journald_appender.cpp") != std::string::npos);
+        CHECK(std::stoi(field(entry, "CODE_LINE")) > 0);
+        CHECK(field(entry, "CODE_FUNC") != "<missing>");
+        CHECK(field(entry, "SYSLOG_IDENTIFIER") == "fty-test");
+        CHECK(field(entry, "FTY_LOGGER") == "fty-log-journal-test");
+        CHECK(field(entry, "REQUEST_ID") == "42");
+        CHECK(field(entry, "PRIVATE") == "x");
+    }
+
+    SECTION("Priorities")
+    {
+        log_trace_log(ftylog, "trace");
+        CHECK(field(journal.receive(), "PRIORITY") == "7");
+        log_debug_log(ftylog, "debug");
+        CHECK(field(journal.receive(), "PRIORITY") == "7");
+        log_info_log(ftylog, "info");
+        CHECK(field(journal.receive(), "PRIORITY") == "6");
+        log_error_log(ftylog, "error");
+        CHECK(field(journal.receive(), "PRIORITY") == "3");
+        log_fatal_log(ftylog, "fatal");
+        CHECK(field(journal.receive(), "PRIORITY") == "2");
+    }
+
+    SECTION("Multi-line values")
+    {
+        Ftylog::setContext({{"payload", "a=b\nc"}});
+        log_info_log(ftylog, "first line\nsecond line");
+        Ftylog::clearContext();
+        auto entry = journal.receive();
+
+        CHECK(field(entry, "MESSAGE") == "first line\nsecond line");
+        CHECK(field(entry, "PAYLOAD") == "a=b\nc");
+    }
+
+    SECTION("Entry larger than a datagram")
+    {
+        std::string large(1024 * 1024, 'x');
+        log_info_log(ftylog, "%s", large.c_str());
+        auto entry = journal.receive();
+
+        CHECK(field(entry, "MESSAGE") == large);
+        CHECK(journal.memfds() == 1);
+        CHECK(appender->droppedEvents() == 0);
+    }
+
+    SECTION("Busy journal")
+    {
+        // Nobody reads the journal: its queue fills up, then the events are dropped without waiting
+        for (int i = 0; i < 10000 && appender->droppedEvents() == 0; i++) {
+            log_info_log(ftylog, "event %d", i);
+        }
+        REQUIRE(appender->droppedEvents() > 0);
+
+        uint64_t    dropped = appender->droppedEvents();
+        std::string large(1024 * 1024, 'x');
+        log_info_log(ftylog, "%s", large.c_str());
+        CHECK(appender->droppedEvents() == dropped + 1);
+        CHECK(appender->droppedErrors() == 0);
+
+        // An ERROR event waits for a while before being dropped
+        auto start = std::chrono::steady_clock::now();
+        log_error_log(ftylog, "error event");
+        auto waited = std::chrono::steady_clock::now() - start;
+        CHECK(waited >= std::chrono::milliseconds(JournaldAppender::ERROR_TIMEOUT_MS / 2));
+        CHECK(waited < std::chrono::seconds(1));
+        CHECK(appender->droppedEvents() == dropped + 2);
+        CHECK(appender->droppedErrors() == 1);
+
+        // Taken once the journal is read
+        std::thread reader([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(JournaldAppender::ERROR_TIMEOUT_MS / 4));
+            journal.receive();
+        });
+        log_error_log(ftylog, "error event");
+        reader.join();
+        CHECK(appender->droppedErrors() == 1);
+    }
+
+    SECTION("Missing journal")
+    {
+        unlink(path.c_str());
+        log_info_log(ftylog, "lost");
+        CHECK(appender->droppedEvents() == 1);
+    }
+
+    log4cplus::Logger::getInstance("fty-log-journal-test").removeAllAppenders();
+}
@@ -0,0 +1,163 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_log_budget.h"
+#include "fty_log.h"
+#include "test_appender.h"
+
+using fty::logger::LogBudget;
+using std::chrono::milliseconds;
+
+TEST_CASE("Log budget")
+{
+    LogBudget   budget(100, 10000);
+    auto        now = std::chrono::steady_clock::now();
+    std::string notice;
+
+    auto second = [&](int events, size_t size) {
+        int changes = 0;
+        for (int i = 0; i < events; i++) {
+            changes += budget.account(size, log4cplus::TRACE_LOG_LEVEL, now + milliseconds(i * 1000 / events), notice);
+        }
+        now += std::chrono::seconds(1);
+        return changes;
+    };
+
+    // Starts the first second
+    budget.account(0, log4cplus::TRACE_LOG_LEVEL, now, notice);
+    now += std::chrono::seconds(1);
+
+    SECTION("Under budget")
+    {
+        CHECK(second(100, 100) == 0);
+        CHECK(budget.threshold() == log4cplus::TRACE_LOG_LEVEL);
+    }
+
+    SECTION("Raised in steps up to ERROR, lowered back")
+    {
+        CHECK(second(150, 10) == 1);
+        CHECK(budget.threshold() == log4cplus::DEBUG_LOG_LEVEL);
+        CHECK(notice.find("events below DEBUG are dropped") != std::string::npos);
+
+        CHECK(second(450, 10) == 3);
+        CHECK(budget.threshold() == log4cplus::ERROR_LOG_LEVEL);
+        // ERROR and FATAL are never dropped
+        CHECK(second(1000, 10) == 0);
+        CHECK(budget.threshold() == log4cplus::ERROR_LOG_LEVEL);
+
+        // Not quiet enough
+        for (int i = 0; i < 10; i++) {
+            CHECK(second(80, 10) == 0);
+        }
+        CHECK(budget.threshold() == log4cplus::ERROR_LOG_LEVEL);
+
+        // A second is accounted by the first event of the next one
+        for (int i = 0; i <= LogBudget::QUIET_SECONDS; i++) {
+            second(10, 10);
+        }
+        CHECK(budget.threshold() == log4cplus::WARN_LOG_LEVEL);
+        CHECK(notice == "log volume back under budget, events below WARN are dropped");
+
+        // Seconds without events are quiet
+        now += std::chrono::seconds(3 * LogBudget::QUIET_SECONDS);
+        CHECK(second(1, 10) == 1);
+        CHECK(budget.threshold() == log4cplus::INFO_LOG_LEVEL);
+        now += std::chrono::seconds(10 * LogBudget::QUIET_SECONDS);
+        second(1, 10);
+        now += std::chrono::seconds(10 * LogBudget::QUIET_SECONDS);
+        second(1, 10);
+        CHECK(budget.threshold() == log4cplus::TRACE_LOG_LEVEL);
+        CHECK(notice == "log volume back under budget, no event is dropped anymore");
+    }
+
+    SECTION("Lowered while all the events are dropped")
+    {
+        CHECK(second(350, 10) == 3);
+        CHECK(budget.threshold() == log4cplus::WARN_LOG_LEVEL);
+
+        // Only dropped INFO events follow: the threshold stays while they would exceed the budget
+        auto dropped = [&](int events) {
+            int changes = 0;
+            for (int i = 0; i < events; i++) {
+                notice.clear();
+                budget.admits(log4cplus::INFO_LOG_LEVEL, log4cplus::TRACE_LOG_LEVEL, now + milliseconds(i * 1000 / events),
+                    notice);
+                changes += !notice.empty();
+            }
+            now += std::chrono::seconds(1);
+            return changes;
+        };
+        for (int i = 0; i < 2 * LogBudget::QUIET_SECONDS; i++) {
+            CHECK(dropped(200) == 0);
+        }
+        CHECK(budget.threshold() == log4cplus::WARN_LOG_LEVEL);
+
+        // Once they subside, the threshold comes down without any event printed
+        int changes = 0;
+        for (int i = 0; i <= LogBudget::QUIET_SECONDS; i++) {
+            changes += dropped(10);
+        }
+        CHECK(changes == 1);
+        CHECK(budget.threshold() == log4cplus::INFO_LOG_LEVEL);
+        CHECK(budget.admits(log4cplus::INFO_LOG_LEVEL, log4cplus::TRACE_LOG_LEVEL, now, notice));
+    }
+
+    SECTION("Limits replaced")
+    {
+        CHECK(second(150, 10) == 1);
+        budget.setLimits(1000, 0);
+        CHECK(budget.threshold() == log4cplus::TRACE_LOG_LEVEL);
+        CHECK(second(150, 10) == 0);
+        CHECK(budget.eventsPerSecond() == 1000);
+    }
+
+    SECTION("Bytes")
+    {
+        CHECK(second(20, 1000) == 1);
+        CHECK(budget.threshold() == log4cplus::DEBUG_LOG_LEVEL);
+    }
+
+    SECTION("Steps start from the logger level")
+    {
+        CHECK(budget.account(20000, log4cplus::INFO_LOG_LEVEL, now, notice));
+        CHECK(budget.threshold() == log4cplus::WARN_LOG_LEVEL);
+    }
+}
+
+TEST_CASE("Logger with a volume budget")
+{
+    Ftylog  log("fty-log-budget-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    auto appender = new fty::test::MessagesAppender;
+    fty::test::setOnlyAppender("fty-log-budget-test", appender);
+
+    log.setBudget(100, 0);
+    for (int i = 0; i < 1000; i++) {
+        log_info_log(ftylog, "storm event %d", i);
+    }
+    int evaluated = 0;
+    FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "streamed " << ++evaluated;
+    log_warning_log(ftylog, "warning");
+    log_error_log(ftylog, "error");
+
+    // Three steps: TRACE, DEBUG and then INFO events dropped
+    CHECK(!log.isLogInfo());
+    CHECK(log.isLogError());
+    size_t notices = 0;
+    size_t printed = 0;
+    for (const auto& message : appender->messages) {
+        notices += message.find("log volume budget exceeded") == 0;
+        printed += message.find("storm event") == 0;
+    }
+    CHECK(notices == 3);
+    // The event exceeding the budget is still printed
+    CHECK(printed < 310);
+    CHECK(appender->messages.back() == "error");
+    // The operands of a dropped stream statement are not evaluated
+    CHECK(evaluated == 0);
+
+    log.setBudget(0, 0);
+    CHECK(log.isLogInfo());
+}
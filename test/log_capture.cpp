@@ -0,0 +1,225 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_log_capture.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <thread>
+#include <unistd.h>
+
+using fty::logger::Capture;
+using fty::logger::CaptureEvent;
+using fty::logger::ReplayResult;
+
+static std::string capturePath()
+{
+    return "/tmp/fty-log-capture-test-" + std::to_string(getpid()) + ".capture";
+}
+
+TEST_CASE("Log capture")
+{
+    std::string path = capturePath();
+
+    Ftylog  log("fty-log-capture-test");
+    Ftylog* ftylog   = &log;
+    auto*   appender = new fty::test::MessagesAppender();
+    fty::test::setOnlyAppender("fty-log-capture-test", appender);
+    log.setLogLevelDebug();
+    REQUIRE(log.setCapture(path));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 100; i++) {
+                log_info_log(ftylog, "thread %d event %d", t, i);
+                if (i % 10 == 0) {
+                    log_error_log(ftylog, "device\treply:\n%s", std::string(size_t(i), 'r').c_str());
+                }
+                // Disabled level, not captured
+                log_trace_log(ftylog, "trace %d", i);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    log.unsetCapture();
+
+    Capture capture;
+    REQUIRE(fty::logger::readCapture(path, capture));
+    CHECK(capture.agent == "fty-log-capture-test");
+
+    SECTION("Content")
+    {
+        REQUIRE(capture.sites.size() == 2);
+        CHECK(capture.sites[0].file == __FILE__);
+        CHECK(capture.sites[0].func == "operator()");
+        // Printf-like call sites: their format is the sample
+        CHECK(capture.sites[0].sample == "thread %d event %d");
+        CHECK(capture.sites[1].sample == "device\treply:\n%s");
+        CHECK(capture.sites[1].line == capture.sites[0].line + 2);
+
+        REQUIRE(capture.events.size() == 220);
+        std::set<uint32_t>  captureThreads;
+        std::vector<size_t> captured, printed;
+        size_t              errors = 0;
+        for (size_t i = 0; i < capture.events.size(); i++) {
+            const CaptureEvent& event = capture.events[i];
+            captureThreads.insert(event.thread);
+            CHECK(event.level == (event.site == 0 ? log4cplus::INFO_LOG_LEVEL : log4cplus::ERROR_LOG_LEVEL));
+            CHECK((i == 0 || event.timeUs >= capture.events[i - 1].timeUs));
+            captured.push_back(event.size);
+            errors += event.site == 1;
+        }
+        CHECK(captureThreads.size() == 2);
+        CHECK(errors == 20);
+
+        for (const std::string& message : appender->messages) {
+            printed.push_back(message.size());
+        }
+        std::sort(captured.begin(), captured.end());
+        std::sort(printed.begin(), printed.end());
+        CHECK(captured == printed);
+    }
+
+    SECTION("Replay")
+    {
+        Ftylog replayLog("fty-log-replay-test");
+        auto*  replayed = new fty::test::MessagesAppender();
+        fty::test::setOnlyAppender("fty-log-replay-test", replayed);
+        replayLog.setLogLevelTrace();
+
+        fty::logger::ReplayOptions options;
+        options.repeat      = 2;
+        ReplayResult result = fty::logger::replayCapture(replayLog, capture, options);
+        CHECK(result.events == 440);
+        CHECK(replayed->messages.size() == 440);
+        CHECK(result.latenciesNs.size() == 440);
+        CHECK(std::is_sorted(result.latenciesNs.begin(), result.latenciesNs.end()));
+        CHECK(result.percentile(50) <= result.percentile(99));
+        CHECK(result.percentile(100) == result.latenciesNs.back());
+
+        // Same sizes of messages as captured
+        std::vector<size_t> captured, sizes;
+        uint64_t            bytes = 0;
+        for (const CaptureEvent& event : capture.events) {
+            captured.push_back(event.size);
+            captured.push_back(event.size);
+            bytes += 2 * event.size;
+        }
+        for (const std::string& message : replayed->messages) {
+            sizes.push_back(message.size());
+        }
+        std::sort(captured.begin(), captured.end());
+        std::sort(sizes.begin(), sizes.end());
+        CHECK(sizes == captured);
+        CHECK(result.bytes == bytes);
+
+        log4cplus::Logger::getInstance("fty-log-replay-test").removeAllAppenders();
+    }
+
+    SECTION("Incomplete last line of a capture being written")
+    {
+        std::ifstream input(path);
+        std::string   content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        {
+            std::ofstream output(path);
+            output << content << "E\t12";
+        }
+        Capture partial;
+        CHECK(fty::logger::readCapture(path, partial));
+        CHECK(partial.events.size() == capture.events.size());
+
+        {
+            std::ofstream output(path);
+            output << "not a capture\n";
+        }
+        CHECK(!fty::logger::readCapture(path, partial));
+    }
+
+    log4cplus::Logger::getInstance("fty-log-capture-test").removeAllAppenders();
+    remove(path.c_str());
+}
+
+TEST_CASE("Log capture samples")
+{
+    std::string path = capturePath();
+
+    Ftylog  log("fty-log-capture-test");
+    Ftylog* ftylog = &log;
+    fty::test::setOnlyAppender("fty-log-capture-test", new fty::test::MessagesAppender());
+    log.setLogLevelDebug();
+    REQUIRE(log.setCapture(path));
+    // More events than a thread buffers
+    for (int i = 0; i < 500; i++) {
+        log_info_log(ftylog, "path C:\\%s\t%d", "dir", i);
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "stream C:\\dir\t" << i;
+    }
+    log.unsetCapture();
+
+    Capture capture;
+    REQUIRE(fty::logger::readCapture(path, capture));
+    REQUIRE(capture.sites.size() == 2);
+    CHECK(capture.sites[0].file == __FILE__);
+    // The format of a printf-like call site, the first message of the others
+    CHECK(capture.sites[0].sample == "path C:\\%s\t%d");
+    CHECK(capture.sites[1].sample == "stream C:\\dir\t0");
+
+    REQUIRE(capture.events.size() == 1000);
+    for (size_t i = 0; i < capture.events.size(); i++) {
+        CHECK(capture.events[i].site == i % 2);
+    }
+
+    log4cplus::Logger::getInstance("fty-log-capture-test").removeAllAppenders();
+    remove(path.c_str());
+}
+
+TEST_CASE("Log capture sites of reused texts")
+{
+    std::string path    = capturePath();
+    auto        capture = fty::logger::LogCapture::create(path, "fty-log-capture-test");
+    REQUIRE(capture);
+
+    // A format built at run time in the same buffer
+    char format[32];
+    strcpy(format, "first %d");
+    capture->record(log4cplus::INFO_LOG_LEVEL, "file.cpp", 10, "func", "first 1", format);
+    strcpy(format, "second %d");
+    capture->record(log4cplus::INFO_LOG_LEVEL, "file.cpp", 10, "func", "second 1", format);
+    capture->record(log4cplus::INFO_LOG_LEVEL, "file.cpp", 10, "other", "second 2", format);
+    strcpy(format, "first %d");
+    capture->record(log4cplus::INFO_LOG_LEVEL, "file.cpp", 10, "func", "first 2", format);
+    capture.reset();
+
+    Capture result;
+    REQUIRE(fty::logger::readCapture(path, result));
+    REQUIRE(result.sites.size() == 3);
+    CHECK(result.sites[0].sample == "first %d");
+    CHECK(result.sites[1].sample == "second %d");
+    CHECK(result.sites[2].func == "other");
+    REQUIRE(result.events.size() == 4);
+    CHECK(result.events[0].site == 0);
+    CHECK(result.events[1].site == 1);
+    CHECK(result.events[2].site == 2);
+    CHECK(result.events[3].site == 0);
+
+    remove(path.c_str());
+}
+
+TEST_CASE("Replay percentiles")
+{
+    ReplayResult result;
+    CHECK(result.percentile(50) == 0);
+    for (uint64_t i = 1; i <= 100; i++) {
+        result.latenciesNs.push_back(i);
+    }
+    CHECK(result.percentile(0) == 1);
+    CHECK(result.percentile(50) == 50);
+    CHECK(result.percentile(99) == 99);
+    CHECK(result.percentile(99.9) == 100);
+    CHECK(result.percentile(100) == 100);
+}
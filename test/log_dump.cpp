@@ -0,0 +1,150 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "alloc_counter.h"
+#include "fty-log/fty_log_dump.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <iomanip>
+#include <sstream>
+
+TEST_CASE("Hex encoding")
+{
+    std::string data;
+    for (int i = 0; i < 300; i++) {
+        data += char(i * 7);
+    }
+    for (size_t size = 0; size <= data.size(); size++) {
+        std::string expected;
+        for (size_t i = 0; i < size; i++) {
+            char hex[3];
+            snprintf(hex, sizeof(hex), "%02x", uint8_t(data[i]));
+            expected += hex;
+        }
+        std::string encoded(2 * size, '?');
+        fty::logger::hexEncode(data.data(), size, &encoded[0]);
+        CHECK(encoded == expected);
+    }
+}
+
+TEST_CASE("Log dumps")
+{
+    Ftylog  log("fty-log-dump-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    auto appender = new fty::test::MessagesAppender;
+    fty::test::setOnlyAppender("fty-log-dump-test", appender);
+
+    SECTION("Hex dump")
+    {
+        const char frame[] = "\x01\x03\x00\x10\x00\x02\xc5\xceModbus frame, 35 bytes\x7f";
+        log_hexdump_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "request", frame, sizeof(frame) - 1, 64);
+        log_hexdump_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "request", frame, sizeof(frame) - 1, 20);
+        log_hexdump_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "empty", frame, 0, 64);
+
+        REQUIRE(appender->messages.size() == 3);
+        CHECK(appender->messages[0] ==
+              "request (31 bytes):\n"
+              "00000000  01030010 0002c5ce 4d6f6462 75732066  |........Modbus f|\n"
+              "00000010  72616d65 2c203335 20627974 65737f    |rame, 35 bytes. |");
+        CHECK(appender->messages[1] ==
+              "request (31 bytes):\n"
+              "00000000  01030010 0002c5ce 4d6f6462 75732066  |........Modbus f|\n"
+              "00000010  72616d65                             |rame            |\n"
+              "[truncated: 11 more bytes]");
+        CHECK(appender->messages[2] == "empty (0 bytes):");
+    }
+
+    SECTION("Payload")
+    {
+        std::string json = "{\n";
+        for (int i = 0; i < 1000; i++) {
+            json += "  \"sensor-" + std::to_string(i) + "\": \"température ok\",\n";
+        }
+        json += "}\n";
+        log_payload_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "inventory", json.data(), json.size(), json.size());
+
+        REQUIRE(appender->messages.size() > 1);
+        std::string joined;
+        for (size_t i = 0; i < appender->messages.size(); i++) {
+            std::string prefix = "inventory [" + std::to_string(i + 1) + "/" +
+                                 std::to_string(appender->messages.size()) + "]: ";
+            const std::string& message = appender->messages[i];
+            REQUIRE(message.compare(0, prefix.size(), prefix) == 0);
+            CHECK(message.size() - prefix.size() <= FTY_LOG_PAYLOAD_CHUNK);
+            joined += message.substr(prefix.size()) + "\n";
+        }
+        CHECK(joined == json);
+
+        appender->messages.clear();
+        log_payload_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "small", "{\"a\": 1}", 8, 64);
+        log_payload_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "cut", "état: défaut", strlen("état: défaut"), 9);
+        REQUIRE(appender->messages.size() == 2);
+        CHECK(appender->messages[0] == "small: {\"a\": 1}");
+        // The limit falls in "é": the whole character is left out
+        CHECK(appender->messages[1] == "cut: état: d [truncated: 6 more bytes]");
+    }
+
+    SECTION("C interface")
+    {
+        ftylog_insertLogHexDump(ftylog, log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "frame", "ab", 2, 64);
+        ftylog_insertLogPayload(ftylog, log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "text", "ab", 2, 64);
+        REQUIRE(appender->messages.size() == 2);
+        CHECK(appender->messages[0] ==
+              "frame (2 bytes):\n00000000  6162                                 |ab              |");
+        CHECK(appender->messages[1] == "text: ab");
+    }
+
+    SECTION("Disabled level")
+    {
+        log.setLogLevelInfo();
+        std::string large(1024 * 1024, 'x');
+
+        fty::test::AllocationCounter counter;
+        log_hexdump_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "frame", large.data(), large.size(), large.size());
+        log_payload_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "text", large.data(), large.size(), large.size());
+        CHECK(counter.count() == 0);
+        CHECK(appender->messages.empty());
+    }
+}
+
+TEST_CASE("Log dumps benchmark", "[.][benchmark]")
+{
+    Ftylog  log("fty-log-dump-bench");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+    fty::test::setOnlyAppender("fty-log-dump-bench", new log4cplus::NullAppender);
+
+    std::string frame(4096, '\0');
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = char(i * 31);
+    }
+
+    BENCHMARK("hand-rolled hex string + log_debug_log, 4KiB")
+    {
+        std::ostringstream hex;
+        for (char c : frame) {
+            hex << std::hex << std::setw(2) << std::setfill('0') << int(uint8_t(c)) << ' ';
+        }
+        log_debug_log(ftylog, "frame: %s", hex.str().c_str());
+    };
+
+    BENCHMARK("log_hexdump_log, 4KiB")
+    {
+        log_hexdump_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "frame", frame.data(), frame.size(), frame.size());
+    };
+
+    std::string hex(2 * frame.size(), '\0');
+    BENCHMARK("hexEncode, 4KiB")
+    {
+        fty::logger::hexEncode(frame.data(), frame.size(), &hex[0]);
+        return hex[0];
+    };
+
+    log.setLogLevelInfo();
+    BENCHMARK("log_hexdump_log, 4KiB, disabled level")
+    {
+        log_hexdump_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "frame", frame.data(), frame.size(), frame.size());
+    };
+}
@@ -0,0 +1,154 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "alloc_counter.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <functional>
+
+namespace {
+
+// Appender reading all the fields of the events into a string keeping its memory
+class FieldsAppender : public log4cplus::Appender
+{
+public:
+    FieldsAppender()
+    {
+        output.reserve(4096);
+    }
+
+    ~FieldsAppender() override
+    {
+        destructorImpl();
+    }
+
+    void close() override
+    {
+    }
+
+    std::string output;
+    // Called at the start of each append, if set
+    std::function<void()> onAppend;
+
+protected:
+    void append(const log4cplus::spi::InternalLoggingEvent& event) override
+    {
+        if (onAppend) {
+            onAppend();
+        }
+        output.clear();
+        output += event.getLoggerName();
+        output += ' ';
+        output += std::to_string(event.getLogLevel());
+        output += ' ';
+        output += event.getFile();
+        output += ':';
+        output += std::to_string(event.getLine());
+        output += ' ';
+        output += event.getFunction();
+        output += ' ';
+        output += event.getThread();
+        output += ' ';
+        output += event.getMessage();
+    }
+};
+
+std::string helperFunction(Ftylog* ftylog, FieldsAppender* appender)
+{
+    log_warning_log(ftylog, "from %s", "helper");
+    return appender->output;
+}
+
+// Event logged by a function with a known name, at the returned line
+int namedFunction(Ftylog* ftylog)
+{
+    int line = __LINE__ + 1;
+    log_info_log(ftylog, "%s", "here");
+    return line;
+}
+
+} // namespace
+
+TEST_CASE("Logging events")
+{
+    Ftylog  log("fty-log-event-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    auto* appender = new FieldsAppender();
+    log4cplus::SharedAppenderPtr appenderPtr(appender);
+    fty::test::setOnlyAppender("fty-log-event-test", appenderPtr);
+
+    SECTION("No allocation end to end")
+    {
+        // Warm up the per-thread buffers and event
+        for (int i = 0; i < 2; i++) {
+            log_info_log(ftylog, "device %s replied %d after %.2f ms", "ups-1", 1000, 1.5);
+            ftylog_insertLog(ftylog, log4cplus::DEBUG_LOG_LEVEL, __FILE__, __LINE__, __func__, "c event %d", 1000);
+            log.insertLogFmt(log4cplus::ERROR_LOG_LEVEL, __FILE__, __LINE__, __func__, "device {} lost", "ups-1");
+        }
+
+        fty::test::AllocationCounter counter;
+        for (int i = 0; i < 100; i++) {
+            log_info_log(ftylog, "device %s replied %d after %.2f ms", "ups-1", i, 1.5);
+            ftylog_insertLog(ftylog, log4cplus::DEBUG_LOG_LEVEL, __FILE__, __LINE__, __func__, "c event %d", i);
+            log.insertLogFmt(log4cplus::ERROR_LOG_LEVEL, __FILE__, __LINE__, __func__, "device {} lost", "ups-1");
+        }
+        CHECK(counter.count() == 0);
+    }
+
+    SECTION("Call sites")
+    {
+        std::string helper = helperFunction(ftylog, appender);
+        CHECK(helper.find(std::string(" ") + __FILE__ + ":") != std::string::npos);
+        CHECK(helper.find(" helperFunction ") != std::string::npos);
+        CHECK(helper.compare(helper.size() - 11, 11, "from helper") == 0);
+
+        int         line = namedFunction(ftylog);
+        std::string here = appender->output;
+        CHECK(here.find(std::string(__FILE__) + ":" + std::to_string(line) + " ") != std::string::npos);
+        CHECK(here.find(" namedFunction ") != std::string::npos);
+        CHECK(here.find(" helperFunction ") == std::string::npos);
+
+        // Same buffer, other content
+        char name[] = "first";
+        log.insertLog(log4cplus::INFO_LOG_LEVEL, name, 1, name, "%s", "in first");
+        CHECK(appender->output.find(" first:1 first ") != std::string::npos);
+        memcpy(name, "other", sizeof(name));
+        log.insertLog(log4cplus::INFO_LOG_LEVEL, name, 2, name, "%s", "in other");
+        CHECK(appender->output.find(" other:2 other ") != std::string::npos);
+
+        log.insertLog(log4cplus::INFO_LOG_LEVEL, "other.cpp", 7, nullptr, "%s", "elsewhere");
+        CHECK(appender->output.find(" other.cpp:7  ") != std::string::npos);
+
+        CHECK(helperFunction(ftylog, appender) == helper);
+    }
+
+    SECTION("Logging from an appender")
+    {
+        Ftylog nested("fty-log-event-nested-test");
+        auto*  nestedAppender = new fty::test::MessagesAppender();
+        fty::test::setOnlyAppender("fty-log-event-nested-test", nestedAppender);
+        nested.setLogLevelTrace();
+
+        appender->onAppend = [&] {
+            Ftylog* nestedLog = &nested;
+            log_info_log(nestedLog, "nested %d", 1);
+        };
+        log_info_log(ftylog, "outer %d", 1);
+        appender->onAppend = nullptr;
+
+        REQUIRE(nestedAppender->messages.size() == 1);
+        CHECK(nestedAppender->messages[0] == "nested 1");
+        CHECK(appender->output.compare(0, 25, "fty-log-event-test 20000 ") == 0);
+        CHECK(appender->output.compare(appender->output.size() - 7, 7, "outer 1") == 0);
+
+        // The event of the thread is available again
+        log_info_log(ftylog, "outer %d", 2);
+        CHECK(appender->output.compare(appender->output.size() - 7, 7, "outer 2") == 0);
+
+        log4cplus::Logger::getInstance("fty-log-event-nested-test").removeAllAppenders();
+    }
+
+    log4cplus::Logger::getInstance("fty-log-event-test").removeAllAppenders();
+}
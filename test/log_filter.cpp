@@ -0,0 +1,358 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_log_filter.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <log4cplus/helpers/property.h>
+#include <log4cplus/nullappender.h>
+#include <thread>
+#include <unistd.h>
+
+using fty::logger::FilterRule;
+
+namespace {
+
+FilterRule rule(log4cplus::LogLevel level, const std::string& file, bool accept = false)
+{
+    FilterRule result;
+    result.level  = level;
+    result.file   = file;
+    result.accept = accept;
+    return result;
+}
+
+void noisyFunction(Ftylog* ftylog)
+{
+    log_debug_log(ftylog, "noisy %d", 1);
+    log_info_log(ftylog, "noisy %d", 2);
+}
+
+std::string configPath()
+{
+    return "/tmp/fty-log-filter-test-" + std::to_string(getpid()) + ".cfg";
+}
+
+// Number of threads of the process
+size_t threadCount()
+{
+    size_t count = 0;
+    DIR*   dir   = opendir("/proc/self/task");
+    while (dirent* entry = readdir(dir)) {
+        count += entry->d_name[0] != '.';
+    }
+    closedir(dir);
+    return count;
+}
+
+} // namespace
+
+TEST_CASE("Filter rules")
+{
+    Ftylog  log("fty-log-filter-test.agent");
+    Ftylog* ftylog   = &log;
+    auto*   appender = new fty::test::MessagesAppender();
+    fty::test::setOnlyAppender("fty-log-filter-test.agent", appender);
+    log.setLogLevelTrace();
+
+    SECTION("Source file and level")
+    {
+        log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "log_filter.cpp"), rule(log4cplus::FATAL_LOG_LEVEL, "other.cpp")});
+        log_trace_log(ftylog, "trace %d", 1);
+        log_debug_log(ftylog, "debug %d", 1);
+        log_info_log(ftylog, "info %d", 1);
+        log.insertLog(log4cplus::DEBUG_LOG_LEVEL, "src/other.cpp", 1, "f", "other %d", 1);
+        log.insertLog(log4cplus::DEBUG_LOG_LEVEL, "src/another.cpp", 1, "f", "another %d", 1);
+
+        REQUIRE(appender->messages.size() == 2);
+        CHECK(appender->messages[0] == "info 1");
+        CHECK(appender->messages[1] == "another 1");
+        CHECK(log.filterHits() == std::vector<uint64_t>{2, 1});
+    }
+
+    SECTION("Function and MDC")
+    {
+        // Only the events of the device ups-1, the errors of all, nothing from noisyFunction
+        FilterRule noisy;
+        noisy.function = "noisyFunction";
+        FilterRule device;
+        device.mdcKey   = "device";
+        device.mdcValue = "ups-1";
+        device.accept   = true;
+        FilterRule others;
+        others.level = log4cplus::WARN_LOG_LEVEL;
+        log.setFilter({noisy, device, others});
+
+        noisyFunction(ftylog);
+        Ftylog::setContext({{"device", "ups-1"}});
+        log_info_log(ftylog, "ups-1 %d", 1);
+        noisyFunction(ftylog);
+        Ftylog::setContext({{"device", "ups-2"}});
+        log_info_log(ftylog, "ups-2 %d", 1);
+        log_error_log(ftylog, "ups-2 %d", 2);
+        Ftylog::clearContext();
+        log_warning_log(ftylog, "no device %d", 1);
+
+        REQUIRE(appender->messages.size() == 2);
+        CHECK(appender->messages[0] == "ups-1 1");
+        CHECK(appender->messages[1] == "ups-2 2");
+        CHECK(log.filterHits() == std::vector<uint64_t>{4, 1, 2});
+    }
+
+    SECTION("Logger")
+    {
+        FilterRule other = rule(log4cplus::FATAL_LOG_LEVEL, "");
+        other.logger     = "fty-log-filter-test.other";
+        FilterRule parent = rule(log4cplus::DEBUG_LOG_LEVEL, "");
+        parent.logger     = "fty-log-filter-test";
+        log.setFilter({other, parent});
+
+        log_debug_log(ftylog, "debug %d", 1);
+        log_error_log(ftylog, "error %d", 1);
+        REQUIRE(appender->messages.size() == 1);
+        CHECK(appender->messages[0] == "error 1");
+        CHECK(log.filterHits() == std::vector<uint64_t>{0, 1});
+    }
+
+    SECTION("Deny by default")
+    {
+        log.setFilter({rule(log4cplus::FATAL_LOG_LEVEL, "log_filter.cpp", true)}, false);
+        log_info_log(ftylog, "here %d", 1);
+        log.insertLog(log4cplus::ERROR_LOG_LEVEL, "elsewhere.cpp", 1, "f", "elsewhere %d", 1);
+        REQUIRE(appender->messages.size() == 1);
+        CHECK(appender->messages[0] == "here 1");
+    }
+
+    SECTION("Filtered out before formatting")
+    {
+        log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "log_filter.cpp")});
+        int  calls = 0;
+        auto count = [&] {
+            return ++calls;
+        };
+        FTY_LOG_STREAM_LOG(log4cplus::DEBUG_LOG_LEVEL, ftylog) << "call " << count();
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "call " << count();
+        log_hexdump_log(log4cplus::DEBUG_LOG_LEVEL, ftylog, "frame", "abc", 3, 16);
+        log.insertLogFmt(log4cplus::DEBUG_LOG_LEVEL, __FILE__, __LINE__, __func__, "fmt {}", 1);
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "fmt {}", 2);
+
+        CHECK(calls == 1);
+        REQUIRE(appender->messages.size() == 2);
+        CHECK(appender->messages[0] == "call 1");
+        CHECK(appender->messages[1] == "fmt 2");
+        CHECK(log.filterHits() == std::vector<uint64_t>{3});
+    }
+
+    SECTION("Rules replaced")
+    {
+        log.setFilter({rule(log4cplus::INFO_LOG_LEVEL, "log_filter.cpp")});
+        log_info_log(ftylog, "info %d", 1);
+        log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "log_filter.cpp")});
+        log_info_log(ftylog, "info %d", 2);
+        log.unsetFilter();
+        log_debug_log(ftylog, "debug %d", 3);
+        CHECK(log.filterHits().empty());
+
+        REQUIRE(appender->messages.size() == 2);
+        CHECK(appender->messages[0] == "info 2");
+        CHECK(appender->messages[1] == "debug 3");
+    }
+
+    SECTION("Rules replaced while threads log")
+    {
+        // The former rules are deleted once the threads deciding with them are done
+        log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "log_filter.cpp")});
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 2000; i++) {
+                    log_debug_log(ftylog, "debug %d", i);
+                }
+            });
+        }
+        for (int i = 0; i < 200; i++) {
+            log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "log_filter.cpp", i % 2 == 0)});
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "log_filter.cpp")});
+        log_debug_log(ftylog, "debug %d", 2000);
+
+        CHECK(appender->messages.size() <= 8000);
+        CHECK(log.filterHits() == std::vector<uint64_t>{1});
+    }
+
+    SECTION("Call sites texts at a reused address or at other addresses")
+    {
+        log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "denied.cpp")});
+        char file[] = "denied.cpp";
+        log.insertLog(log4cplus::DEBUG_LOG_LEVEL, file, 1, "f", "first %d", 1);
+        memcpy(file, "other.cpp", sizeof("other.cpp"));
+        log.insertLog(log4cplus::DEBUG_LOG_LEVEL, file, 1, "f", "second %d", 2);
+
+        std::vector<std::string> copies(2000, "denied.cpp");
+        for (const std::string& copy : copies) {
+            log.insertLog(log4cplus::DEBUG_LOG_LEVEL, copy.c_str(), 1, "f", "copy %d", 3);
+        }
+        // Decided the same once the table caches no more call sites
+        for (int i = 0; i < 2; i++) {
+            log.insertLog(log4cplus::DEBUG_LOG_LEVEL, "src/denied.cpp", 1, "f", "literal %d", 4);
+        }
+
+        REQUIRE(appender->messages.size() == 1);
+        CHECK(appender->messages[0] == "second 2");
+        CHECK(log.filterHits() == std::vector<uint64_t>{2003});
+    }
+
+    Ftylog::clearContext();
+    log4cplus::Logger::getInstance("fty-log-filter-test.agent").removeAllAppenders();
+}
+
+TEST_CASE("Filter rules of a config file")
+{
+    std::string path = configPath();
+    {
+        std::ofstream config(path);
+        config << "ftylog.filter.default=accept\n"
+                  "ftylog.filter.2.level=debug\n"
+                  "ftylog.filter.2.file=log_filter.cpp\n"
+                  "ftylog.filter.10.function=noisyFunction\n"
+                  "ftylog.filter.10.level=INFO\n"
+                  "ftylog.filter.10.action=accept\n"
+                  "ftylog.filter.1.mdc=device=ups-1\n"
+                  "ftylog.filter.1.logger=fty-log-filter-config-test\n";
+    }
+
+    SECTION("Reading")
+    {
+        std::vector<FilterRule> rules;
+        bool                    acceptByDefault = false;
+        CHECK(fty::logger::readFilterRules(log4cplus::helpers::Properties(path), rules, acceptByDefault));
+        CHECK(acceptByDefault);
+        REQUIRE(rules.size() == 3);
+        CHECK(rules[0].logger == "fty-log-filter-config-test");
+        CHECK(rules[0].mdcKey == "device");
+        CHECK(rules[0].mdcValue == "ups-1");
+        CHECK(rules[0].level == log4cplus::FATAL_LOG_LEVEL);
+        CHECK(rules[1].level == log4cplus::DEBUG_LOG_LEVEL);
+        CHECK(rules[1].file == "log_filter.cpp");
+        CHECK(!rules[1].accept);
+        CHECK(rules[2].function == "noisyFunction");
+        CHECK(rules[2].level == log4cplus::INFO_LOG_LEVEL);
+        CHECK(rules[2].accept);
+
+        CHECK(!fty::logger::readFilterRules(log4cplus::helpers::Properties(), rules, acceptByDefault));
+        CHECK(rules.empty());
+    }
+
+    SECTION("Logger")
+    {
+        Ftylog  log("fty-log-filter-config-test", path);
+        Ftylog* ftylog   = &log;
+        auto*   appender = new fty::test::MessagesAppender();
+        fty::test::setOnlyAppender("fty-log-filter-config-test", appender);
+        log.setLogLevelTrace();
+
+        log_debug_log(ftylog, "debug %d", 1);
+        noisyFunction(ftylog);
+        log_info_log(ftylog, "info %d", 1);
+        REQUIRE(appender->messages.size() == 2);
+        CHECK(appender->messages[0] == "noisy 2");
+        CHECK(appender->messages[1] == "info 1");
+        CHECK(log.filterHits() == std::vector<uint64_t>{0, 2, 1});
+
+        log4cplus::Logger::getInstance("fty-log-filter-config-test").removeAllAppenders();
+    }
+
+    SECTION("No filter without filter options")
+    {
+        std::string other = path + ".other";
+        {
+            std::ofstream config(other);
+            config << "ftylog.sanitize=true\n";
+        }
+        size_t threads = threadCount();
+        {
+            Ftylog log("fty-log-filter-config-test", other);
+            CHECK(threadCount() == threads);
+        }
+        {
+            Ftylog log("fty-log-filter-config-test", path);
+            CHECK(threadCount() == threads + 1);
+        }
+        remove(other.c_str());
+    }
+
+    SECTION("Reloaded when modified")
+    {
+        fty::logger::LogFilter filter("fty-log-filter-config-test", {});
+        filter.watchConfigFile(path, 10);
+        {
+            std::ofstream config(path);
+            config << "ftylog.filter.default=deny\n"
+                      "ftylog.filter.1.level=WARN\n";
+        }
+        for (int i = 0; i < 200 && filter.rules().empty(); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(filter.rules().size() == 1);
+        CHECK(!filter.acceptByDefault());
+        CHECK(!filter.accepts(log4cplus::WARN_LOG_LEVEL, __FILE__, __func__));
+        CHECK(!filter.accepts(log4cplus::ERROR_LOG_LEVEL, __FILE__, __func__));
+        CHECK(filter.hits() == std::vector<uint64_t>{1});
+    }
+
+    remove(path.c_str());
+}
+
+TEST_CASE("Filter rules benchmark", "[.][benchmark]")
+{
+    Ftylog  log("fty-log-filter-bench");
+    Ftylog* ftylog = &log;
+    fty::test::setOnlyAppender("fty-log-filter-bench", new log4cplus::NullAppender);
+
+    log.setLogLevelInfo();
+    BENCHMARK("log_debug_log, disabled level")
+    {
+        log_debug_log(ftylog, "device %s replied %d after %.2f ms", "ups-1", 42, 1.5);
+    };
+
+    log.setLogLevelTrace();
+    FilterRule device;
+    device.mdcKey   = "device";
+    device.mdcValue = "ups-2";
+    device.level    = log4cplus::DEBUG_LOG_LEVEL;
+
+    log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "nut_polling.cc"), rule(log4cplus::DEBUG_LOG_LEVEL, "log_filter.cpp"),
+        device});
+    BENCHMARK("log_debug_log, filtered out by a file rule")
+    {
+        log_debug_log(ftylog, "device %s replied %d after %.2f ms", "ups-1", 42, 1.5);
+    };
+
+    log.setFilter({rule(log4cplus::DEBUG_LOG_LEVEL, "nut_polling.cc"), device});
+    Ftylog::setContext({{"device", "ups-2"}});
+    BENCHMARK("log_debug_log, filtered out by a MDC rule")
+    {
+        log_debug_log(ftylog, "device %s replied %d after %.2f ms", "ups-1", 42, 1.5);
+    };
+    Ftylog::clearContext();
+
+    BENCHMARK("log_info_log, above the level of the rules")
+    {
+        log_info_log(ftylog, "device %s replied %d after %.2f ms", "ups-1", 42, 1.5);
+    };
+
+    log.unsetFilter();
+    BENCHMARK("log_info_log, no filter")
+    {
+        log_info_log(ftylog, "device %s replied %d after %.2f ms", "ups-1", 42, 1.5);
+    };
+
+    log4cplus::Logger::getInstance("fty-log-filter-bench").removeAllAppenders();
+}
@@ -0,0 +1,261 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty_log.h"
+#include "test_appender.h"
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <log4cplus/nullappender.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using fty::logger::preparseFormat;
+
+namespace {
+
+std::string vasprintfFormat(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    char* out  = nullptr;
+    int   size = vasprintf(&out, format, args);
+    va_end(args);
+    if (size < 0) {
+        return "vasprintf failed";
+    }
+    std::string result(out, size_t(size));
+    free(out);
+    return result;
+}
+
+enum Color
+{
+    Red,
+    Green
+};
+
+enum class Mode : unsigned
+{
+    Off,
+    On = 3000000000u
+};
+
+// Log wrapper: its calls share the call site of its log_info_log
+template <size_t N>
+void logWrapped(Ftylog* ftylog, const char (&format)[N], int value)
+{
+    log_info_log(ftylog, format, value);
+}
+
+// Format in an array on the stack, its content depending on the call
+void logLocalFormat(Ftylog* ftylog, char name, int value)
+{
+    const char format[] = {name, '=', '%', 'd', '\0'};
+    log_info_log(ftylog, format, value);
+}
+
+} // namespace
+
+// Log a printf-like message, check it was pre-parsed and printed as vasprintf formats it
+#define CHECK_FORMAT(...)                                                                                              \
+    do {                                                                                                               \
+        CHECK(fty::logger::PreparsedFormatOf<decltype(fty::logger::formatTypes(__VA_ARGS__))>::make(                   \
+            [&]() -> decltype(auto) { return (FTY_LOG_FORMAT_OF(__VA_ARGS__, 0)); })                                  \
+                  .valid);                                                                                             \
+        log_info_log(ftylog, __VA_ARGS__);                                                                             \
+        REQUIRE(appender->messages.size() == 1);                                                                       \
+        CHECK(appender->messages[0] == vasprintfFormat(__VA_ARGS__));                                                  \
+        appender->messages.clear();                                                                                    \
+    } while (0)
+
+// Parsed at compile time
+static_assert(preparseFormat<int, const char*>("device %d: %s").valid);
+static_assert(preparseFormat<int, const char*>("device %d: %s").count == 2);
+static_assert(preparseFormat<>("100%% sure").valid);
+static_assert(preparseFormat<>("no conversion").count == 0);
+static_assert(preparseFormat<long double>("%10.3Lf").valid);
+// Not supported, formatted by vsnprintf
+static_assert(!preparseFormat<int*>("%n").valid);
+static_assert(!preparseFormat<>("%m").valid);
+static_assert(!preparseFormat<int, int>("%*d").valid);
+static_assert(!preparseFormat<int>("%1$d").valid);
+static_assert(!preparseFormat<int>("%ls").valid);
+static_assert(!preparseFormat<int>("trailing %").valid);
+// Arguments not matching the conversions
+static_assert(!preparseFormat<int>("%s").valid);
+static_assert(!preparseFormat<const char*>("%d").valid);
+static_assert(!preparseFormat<double>("%d").valid);
+static_assert(!preparseFormat<long double>("%f").valid);
+static_assert(!preparseFormat<int>("%d %d").valid);
+static_assert(!preparseFormat<int, int>("%d").valid);
+
+TEST_CASE("Pre-parsed formats")
+{
+    Ftylog  log("fty-log-format-test");
+    Ftylog* ftylog   = &log;
+    auto*   appender = new fty::test::MessagesAppender();
+    fty::test::setOnlyAppender("fty-log-format-test", appender);
+    log.setLogLevelTrace();
+
+    SECTION("Same output as vasprintf")
+    {
+        int         value = 42;
+        char        name[16] = "ups-1";
+        const char* none     = nullptr;
+
+        CHECK_FORMAT("");
+        CHECK_FORMAT("no conversion");
+        CHECK_FORMAT("%%|100%%|%d%%", value);
+
+        CHECK_FORMAT("%d %i %d %i", value, -value, 0, INT_MIN);
+        CHECK_FORMAT("%5d|%-5d|%05d|%+d|% d|%.3d|%8.4d|%-+6d|%'d", value, value, -value, value, value, 7, -7, 7, 1234567);
+        CHECK_FORMAT("%hhd %hd %ld %lld %qd %jd %zd %td", static_cast<signed char>(-5), static_cast<short>(-300),
+            -70000L, -5000000000LL, LLONG_MIN, intmax_t(-7), ssize_t(-8), ptrdiff_t(-9));
+        CHECK_FORMAT("%hhu %hu %u %lu %llu %ju %zu %tu", static_cast<unsigned char>(250),
+            static_cast<unsigned short>(65000), UINT_MAX, ULONG_MAX, ULLONG_MAX, uintmax_t(7), sizeof(value),
+            ptrdiff_t(9));
+        CHECK_FORMAT("%o %#o %x %#x %X %#X %08x %.3x %-6x| %llx", 8, 8, 255, 255, 255, 255, 0xbeef, 1, 0, ULLONG_MAX);
+        // Promoted and converted arguments
+        CHECK_FORMAT("%d %u %d %x %hhd %hu", 4000000000u, -1, true, -1, 200, 70000);
+        CHECK_FORMAT("%d %u %d %c", static_cast<unsigned char>(200), static_cast<uint16_t>(65535), Green, 'A');
+        CHECK_FORMAT("%u %x", Mode::On, Mode::Off);
+        // Bit-fields and packed members, which no reference binds to
+        struct Flags
+        {
+            unsigned mode : 3;
+            int      offset : 12;
+        } flags = {5, -100};
+        struct __attribute__((packed)) Packed
+        {
+            char           tag;
+            int            value;
+            unsigned short port;
+        } packed = {'p', -7, 4222};
+        CHECK_FORMAT("%u %d", flags.mode, flags.offset);
+        CHECK_FORMAT("%c %d %hu", packed.tag, packed.value, packed.port);
+
+        CHECK_FORMAT("%c%c%5c%-3c|", 'a', 66, 'z', 'q');
+        CHECK_FORMAT("[%c]", 0);
+
+        CHECK_FORMAT("%s|%10s|%-10s|%.2s|%s|%.0s", "abc", "abc", name, "abc", name, "abc");
+        CHECK_FORMAT("%s|%.3s|%10s", none, none, none);
+        CHECK_FORMAT("%300s|%-200s|", "right", "left");
+
+        CHECK_FORMAT("%p %20p %-20p| %p %p", static_cast<void*>(&value), static_cast<void*>(&value),
+            static_cast<void*>(&value), static_cast<void*>(nullptr), name);
+
+        CHECK_FORMAT("%f %.0f %10.3f %-10.2f| %+f % f %#.0f", 1.5, 2.5, M_PI, -M_PI, 1.0, 1.0, 3.0);
+        CHECK_FORMAT("%e %E %.3e %g %G %#g %.10g %g", 12345.678, 0.000123, 1e300, 100000.0, 1e-10, 1.0, M_PI, 1e6);
+        CHECK_FORMAT("%a %A %.2a %F %f %f %e", 1.0, -0.1, 3.0, INFINITY, -INFINITY, NAN, 0.0);
+        CHECK_FORMAT("%f %lf %g", 1.25f, 0.1, 1e-5f);
+        CHECK_FORMAT("%Lf %.3Le %Lg %20.10Lf", 1.5L, 1e-300L, 1e4000L, -M_PI * 1e10L);
+        CHECK_FORMAT("%.320f", 1e-300);
+        CHECK_FORMAT("%400.2f|", 1.0);
+
+        CHECK_FORMAT("device %s replied %d after %.2f ms (%u retries, status 0x%04x)", "ups-1", 1000, 1.5, 3u, 0x2a);
+    }
+
+    SECTION("Formats formatted by vsnprintf")
+    {
+        const char* format = "device %s";
+        log_info_log(ftylog, format, "ups-1");
+        log_info_log(ftylog, "[%*d]", 5, 42);
+        log_info_log(ftylog, "%2$s %1$s", "world", "hello");
+        log_info_log(ftylog, "%s", std::string("string").c_str());
+        int value = 0;
+        log_info_log(ftylog, "value %d", value);
+
+        REQUIRE(appender->messages.size() == 5);
+        CHECK(appender->messages[0] == "device ups-1");
+        CHECK(appender->messages[1] == "[   42]");
+        CHECK(appender->messages[2] == "hello world");
+        CHECK(appender->messages[3] == "string");
+        CHECK(appender->messages[4] == "value 0");
+    }
+
+    SECTION("Call sites given other formats")
+    {
+        logWrapped(ftylog, "a=%d", 1);
+        logWrapped(ftylog, "b=%d", 2);
+        logWrapped(ftylog, "%d=c", 3);
+        logWrapped(ftylog, "a=%d", 4);
+        logLocalFormat(ftylog, 'd', 5);
+        logLocalFormat(ftylog, 'e', 6);
+        logLocalFormat(ftylog, 'd', 7);
+
+        std::vector<std::string> expected = {"a=1", "b=2", "3=c", "a=4", "d=5", "e=6", "d=7"};
+        CHECK(appender->messages == expected);
+    }
+
+    SECTION("Disabled level")
+    {
+        int calls = 0;
+        auto count = [&] {
+            calls++;
+            return calls;
+        };
+        log.setLogLevelInfo();
+        log_debug_log(ftylog, "call %d", count());
+        log_info_log(ftylog, "call %d", count());
+        CHECK(calls == 2);
+        REQUIRE(appender->messages.size() == 1);
+        CHECK(appender->messages[0] == "call 2");
+    }
+
+    log4cplus::Logger::getInstance("fty-log-format-test").removeAllAppenders();
+}
+
+TEST_CASE("Pre-parsed formats benchmark", "[.][benchmark]")
+{
+    Ftylog  log("fty-log-format-bench");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+    fty::test::setOnlyAppender("fty-log-format-bench", new log4cplus::NullAppender);
+
+    BENCHMARK("vsnprintf path, integers and strings")
+    {
+        log.insertLog(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__,
+            "device %s port %d: %u events, status 0x%x", "ups-1", 42, 1000u, 0x2a);
+    };
+
+    BENCHMARK("log_info_log, integers and strings")
+    {
+        log_info_log(ftylog, "device %s port %d: %u events, status 0x%x", "ups-1", 42, 1000u, 0x2a);
+    };
+
+    BENCHMARK("vsnprintf path, with a floating point conversion")
+    {
+        log.insertLog(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "device %s replied %d after %.2f ms",
+            "ups-1", 42, 1.5);
+    };
+
+    BENCHMARK("log_info_log, with a floating point conversion")
+    {
+        log_info_log(ftylog, "device %s replied %d after %.2f ms", "ups-1", 42, 1.5);
+    };
+
+    std::string out;
+    out.reserve(256);
+    static constexpr auto format =
+        preparseFormat<const char*, int, unsigned, int>("device %s port %d: %u events, status 0x%x");
+
+    BENCHMARK("snprintf alone")
+    {
+        out.resize(out.capacity());
+        return snprintf(&out[0], out.size() + 1, "device %s port %d: %u events, status 0x%x", "ups-1", 42, 1000u,
+            0x2a);
+    };
+
+    BENCHMARK("renderFormat alone")
+    {
+        const fty::logger::FormatArg args[] = {fty::logger::formatArg("ups-1"), fty::logger::formatArg(42),
+            fty::logger::formatArg(1000u), fty::logger::formatArg(0x2a)};
+        out.clear();
+        fty::logger::renderFormat(out, format.view(), args);
+        return out.size();
+    };
+
+    log4cplus::Logger::getInstance("fty-log-format-bench").removeAllAppenders();
+}
@@ -0,0 +1,254 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_log_index.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <fstream>
+#include <log4cplus/helpers/property.h>
+#include <sstream>
+#include <unistd.h>
+
+using fty::logger::IndexedFileAppender;
+using fty::logger::IndexedRotatingFile;
+using fty::logger::LogIndexQuery;
+using fty::logger::LogIndexRange;
+using fty::logger::logIndexPath;
+using fty::logger::queryLogIndex;
+
+static std::string testPath(const std::string& name)
+{
+    std::string path = "/tmp/fty-log-index-test-" + std::to_string(getpid()) + "-" + name;
+    for (const std::string& file : {path, path + ".1", path + ".2"}) {
+        remove(file.c_str());
+        remove(logIndexPath(file).c_str());
+    }
+    return path;
+}
+
+static void removeFiles(const std::string& path)
+{
+    for (const std::string& file : {path, path + ".1", path + ".2"}) {
+        remove(file.c_str());
+        remove(logIndexPath(file).c_str());
+    }
+}
+
+// Selected content of a log file, one string per line
+static std::vector<std::string> select(const std::string& path, const LogIndexQuery& query)
+{
+    std::vector<LogIndexRange> ranges;
+    REQUIRE(queryLogIndex(logIndexPath(path), query, ranges));
+
+    std::ifstream            file(path);
+    std::stringstream        content;
+    std::vector<std::string> lines;
+    content << file.rdbuf();
+    for (const LogIndexRange& range : ranges) {
+        std::istringstream selection(content.str().substr(size_t(range.offset), size_t(range.size)));
+        for (std::string line; std::getline(selection, line);) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+TEST_CASE("Log index")
+{
+    std::string path = testPath("file");
+    {
+        IndexedRotatingFile file(path, 0, 1, true, 4);
+        for (int i = 0; i < 20; i++) {
+            std::string line  = "event " + std::to_string(i) + "\n";
+            int         level = i % 5 == 0 ? log4cplus::ERROR_LOG_LEVEL : log4cplus::INFO_LOG_LEVEL;
+            file.append(line.data(), line.size(), 1000 + i * 10, level, i % 2 ? "odd" : "even");
+        }
+    }
+
+    LogIndexQuery query;
+
+    SECTION("Everything")
+    {
+        CHECK(select(path, query).size() == 20);
+    }
+
+    SECTION("Time range")
+    {
+        query.fromUs = 1050;
+        query.toUs   = 1080;
+        CHECK(select(path, query) == std::vector<std::string>{"event 5", "event 6", "event 7", "event 8"});
+    }
+
+    SECTION("Level")
+    {
+        query.minLevel = log4cplus::WARN_LOG_LEVEL;
+        CHECK(select(path, query) == std::vector<std::string>{"event 0", "event 5", "event 10", "event 15"});
+    }
+
+    SECTION("Logger")
+    {
+        query.loggers = {"odd"};
+        query.toUs    = 1070;
+        CHECK(select(path, query) == std::vector<std::string>{"event 1", "event 3", "event 5", "event 7"});
+
+        query.loggers = {"none"};
+        CHECK(select(path, query).empty());
+    }
+
+    SECTION("Continued after a restart")
+    {
+        {
+            IndexedRotatingFile file(path, 0, 1, true, 4);
+            std::string         line = "event 20\n";
+            file.append(line.data(), line.size(), 1200, log4cplus::ERROR_LOG_LEVEL, "odd");
+        }
+        query.minLevel = log4cplus::ERROR_LOG_LEVEL;
+        query.loggers  = {"odd"};
+        CHECK(select(path, query) == std::vector<std::string>{"event 5", "event 15", "event 20"});
+    }
+
+    removeFiles(path);
+}
+
+TEST_CASE("Indexed file appender")
+{
+    std::string path = testPath("appender");
+
+    log4cplus::helpers::Properties properties;
+    properties.setProperty("File", path);
+    properties.setProperty("MaxFileSize", "1KB");
+    properties.setProperty("MaxBackupIndex", "2");
+    properties.setProperty("IndexBlockSize", "8");
+    properties.setProperty("layout", "log4cplus::PatternLayout");
+    properties.setProperty("layout.ConversionPattern", "%c %p %m%n");
+
+    Ftylog  log("fty-log-index-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+    fty::test::setOnlyAppender("fty-log-index-test", new IndexedFileAppender(properties));
+
+    // 2 files of 1KB with about 30 events each
+    for (int i = 0; i < 60; i++) {
+        if (i % 10 == 0) {
+            log_error_log(ftylog, "event %02d", i);
+        } else {
+            log_info_log(ftylog, "event %02d", i);
+        }
+    }
+    log4cplus::Logger::getInstance("fty-log-index-test").removeAllAppenders();
+
+    LogIndexQuery query;
+    query.minLevel = log4cplus::ERROR_LOG_LEVEL;
+    std::vector<std::string> errors = select(path + ".1", query);
+    for (const std::string& line : select(path, query)) {
+        errors.push_back(line);
+    }
+    CHECK(errors == std::vector<std::string>{"fty-log-index-test ERROR event 00", "fty-log-index-test ERROR event 10",
+                        "fty-log-index-test ERROR event 20", "fty-log-index-test ERROR event 30",
+                        "fty-log-index-test ERROR event 40", "fty-log-index-test ERROR event 50"});
+
+    query.minLevel = log4cplus::TRACE_LOG_LEVEL;
+    CHECK(select(path + ".1", query).size() + select(path, query).size() == 60);
+
+    removeFiles(path);
+}
+
+TEST_CASE("Indexed file appender immediate flush")
+{
+    std::string path = testPath("immediate");
+
+    log4cplus::helpers::Properties properties;
+    properties.setProperty("File", path);
+    properties.setProperty("layout", "log4cplus::PatternLayout");
+    properties.setProperty("layout.ConversionPattern", "%m%n");
+
+    Ftylog  log("fty-log-index-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+    fty::test::setOnlyAppender("fty-log-index-test", new IndexedFileAppender(properties));
+
+    // Described in the index while the appender is still open
+    log_info_log(ftylog, "first");
+    log_error_log(ftylog, "second");
+    LogIndexQuery query;
+    CHECK(select(path, query) == std::vector<std::string>{"first", "second"});
+
+    log4cplus::Logger::getInstance("fty-log-index-test").removeAllAppenders();
+    removeFiles(path);
+}
+
+TEST_CASE("Log index gaps")
+{
+    std::string path = testPath("gaps");
+
+    auto append = [&](bool index, int64_t timestampUs, int count) {
+        IndexedRotatingFile file(path, 0, 1, index, 4);
+        for (int i = 0; i < count; i++) {
+            std::string line = "event " + std::to_string(timestampUs + i) + "\n";
+            file.append(line.data(), line.size(), timestampUs + i, log4cplus::INFO_LOG_LEVEL, "agent");
+        }
+    };
+    // Indexed, block lost, indexed, not indexed yet
+    append(true, 1000, 4);
+    append(false, 2000, 3);
+    append(true, 3000, 4);
+    append(false, 4000, 2);
+
+    std::ifstream file(path, std::ios::ate);
+    uint64_t      fileSize = uint64_t(file.tellg());
+    uint64_t      size     = std::string("event 1000\n").size();
+
+    LogIndexQuery                         query;
+    std::vector<LogIndexRange>            ranges;
+    std::vector<fty::logger::LogIndexGap> gaps;
+    REQUIRE(queryLogIndex(logIndexPath(path), query, ranges, &gaps, fileSize));
+    CHECK(ranges.size() == 2);
+    REQUIRE(gaps.size() == 2);
+    CHECK(gaps[0].offset == 4 * size);
+    CHECK(gaps[0].size == 3 * size);
+    CHECK(gaps[0].fromUs == 1000);
+    CHECK(gaps[0].toUs == 3003);
+    CHECK(gaps[1].offset == 11 * size);
+    CHECK(gaps[1].size == 2 * size);
+    CHECK(gaps[1].fromUs == 3000);
+    CHECK(gaps[1].toUs == INT64_MAX);
+
+    // Only the tail may hold later events
+    query.fromUs = 3500;
+    ranges.clear();
+    gaps.clear();
+    REQUIRE(queryLogIndex(logIndexPath(path), query, ranges, &gaps, fileSize));
+    CHECK(ranges.empty());
+    REQUIRE(gaps.size() == 1);
+    CHECK(gaps[0].offset == 11 * size);
+
+    removeFiles(path);
+}
+
+TEST_CASE("Indexed file appender benchmark", "[.][benchmark]")
+{
+    Ftylog  log("fty-log-index-bench");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    for (bool index : {false, true}) {
+        std::string path = testPath(index ? "bench-indexed" : "bench-plain");
+
+        log4cplus::helpers::Properties properties;
+        properties.setProperty("File", path);
+        properties.setProperty("MaxFileSize", "16MB");
+        properties.setProperty("Index", index ? "true" : "false");
+        properties.setProperty("ImmediateFlush", "false");
+        properties.setProperty("layout", "log4cplus::PatternLayout");
+        properties.setProperty("layout.ConversionPattern", "[%-5p][%d][%-l] %m%n");
+        fty::test::setOnlyAppender("fty-log-index-bench", new IndexedFileAppender(properties));
+
+        BENCHMARK(index ? "Indexed file" : "Plain file")
+        {
+            log_info_log(ftylog, "device %s replied %d", "ups-1", 42);
+        };
+
+        log4cplus::Logger::getInstance("fty-log-index-bench").removeAllAppenders();
+        removeFiles(path);
+    }
+}
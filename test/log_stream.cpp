@@ -0,0 +1,148 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "alloc_counter.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Type printed with its operator<<
+struct Voltage
+{
+    double value;
+};
+
+std::ostream& operator<<(std::ostream& stream, const Voltage& voltage)
+{
+    return stream << voltage.value << " V";
+}
+
+// Type printed with its fmt formatter
+struct Phase
+{
+    int number;
+};
+
+// Type whose printing logs
+struct Noisy
+{
+    Ftylog* log;
+};
+
+std::ostream& operator<<(std::ostream& stream, const Noisy& noisy)
+{
+    FTY_LOG_STREAM_LOG(log4cplus::DEBUG_LOG_LEVEL, noisy.log) << "printing noisy";
+    return stream << "noisy";
+}
+
+} // namespace
+
+template <>
+struct fmt::formatter<Phase> : fmt::formatter<int>
+{
+    template <typename FormatContext>
+    auto format(const Phase& phase, FormatContext& ctx) const
+    {
+        return fmt::format_to(ctx.out(), "L{}", phase.number);
+    }
+};
+
+TEST_CASE("Log stream")
+{
+    Ftylog  log("fty-log-stream-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    auto appender = new fty::test::MessagesAppender;
+    fty::test::setOnlyAppender("fty-log-stream-test", appender);
+
+    SECTION("Formatting")
+    {
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "device " << std::string("ups-1") << " replied " << 42;
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "input " << Voltage{230.5} << " on " << Phase{2};
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "mask 0x" << std::hex << 255 << std::setw(4) << 1.5;
+        // The formatting state does not leak to the next message
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << 255 << ' ' << 1.5;
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog);
+
+        REQUIRE(appender->messages.size() == 5);
+        CHECK(appender->messages[0] == "device ups-1 replied 42");
+        CHECK(appender->messages[1] == "input 230.5 V on L2");
+        CHECK(appender->messages[2] == "mask 0xff 1.5");
+        CHECK(appender->messages[3] == "255 1.5");
+        CHECK(appender->messages[4] == "");
+    }
+
+    SECTION("Disabled level")
+    {
+        log.setLogLevelWarning();
+        int evaluated = 0;
+        auto value    = [&evaluated] { return ++evaluated; };
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "value " << value();
+        FTY_LOG_STREAM_LOG(log4cplus::ERROR_LOG_LEVEL, ftylog) << "value " << value();
+
+        REQUIRE(appender->messages.size() == 1);
+        CHECK(appender->messages[0] == "value 1");
+        CHECK(evaluated == 1);
+
+        // Usable as the body of an if/else
+        if (evaluated == 1)
+            FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "not printed";
+        else
+            FTY_LOG_STREAM_LOG(log4cplus::ERROR_LOG_LEVEL, ftylog) << "not printed either";
+        CHECK(appender->messages.size() == 1);
+    }
+
+    SECTION("Logging while building a message")
+    {
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "value " << Noisy{ftylog} << " printed";
+
+        REQUIRE(appender->messages.size() == 2);
+        CHECK(appender->messages[0] == "printing noisy");
+        CHECK(appender->messages[1] == "value noisy printed");
+    }
+
+    SECTION("Allocations")
+    {
+        fty::test::setOnlyAppender("fty-log-stream-test", new log4cplus::NullAppender);
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "warm up " << Voltage{230.5} << " " << Phase{1};
+
+        fty::test::AllocationCounter counter;
+        for (int i = 0; i < 100; i++) {
+            FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "device " << i << " " << Voltage{230.5} << " "
+                                                                   << Phase{i % 3};
+        }
+        CHECK(counter.count() == 0);
+    }
+}
+
+TEST_CASE("Log stream benchmark", "[.][benchmark]")
+{
+    Ftylog  log("fty-log-stream-bench");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+    fty::test::setOnlyAppender("fty-log-stream-bench", new log4cplus::NullAppender);
+
+    BENCHMARK("std::ostringstream + log_info_log")
+    {
+        std::ostringstream message;
+        message << "device " << "ups-1" << " replied " << 42 << " at " << Voltage{230.5};
+        log_info_log(ftylog, "%s", message.str().c_str());
+    };
+
+    BENCHMARK("FTY_LOG_STREAM_LOG")
+    {
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "device " << "ups-1" << " replied " << 42 << " at "
+                                                               << Voltage{230.5};
+    };
+
+    log.setLogLevelWarning();
+    BENCHMARK("FTY_LOG_STREAM_LOG, disabled level")
+    {
+        FTY_LOG_STREAM_LOG(log4cplus::INFO_LOG_LEVEL, ftylog) << "device " << "ups-1" << " replied " << 42 << " at "
+                                                               << Voltage{230.5};
+    };
+}
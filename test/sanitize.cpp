@@ -0,0 +1,199 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "alloc_counter.h"
+#include "fty-log/fty_sanitize.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <random>
+
+using fty::logger::sanitize;
+using fty::logger::sanitizeOffset;
+
+// Byte by byte reference, decoding UTF-8 code points
+static std::string reference(const std::string& text)
+{
+    std::string out;
+    for (size_t i = 0; i < text.size();) {
+        auto   c      = uint8_t(text[i]);
+        size_t length = c < 0x80 ? 1 : c >= 0xc2 && c < 0xe0 ? 2 : c >= 0xe0 && c < 0xf0 ? 3 : c >= 0xf0 && c < 0xf5 ? 4 : 0;
+        uint32_t codePoint = length == 1 ? c : length == 2 ? c & 0x1f : length == 3 ? c & 0x0f : c & 0x07;
+        bool     valid     = length > 1 && i + length <= text.size();
+        for (size_t j = 1; valid && j < length; j++) {
+            valid     = (uint8_t(text[i + j]) & 0xc0) == 0x80;
+            codePoint = (codePoint << 6) | (uint8_t(text[i + j]) & 0x3f);
+        }
+        uint32_t minimum = length == 2 ? 0x80 : length == 3 ? 0x800 : 0x10000;
+        valid = valid && codePoint >= minimum && codePoint <= 0x10ffff && !(codePoint >= 0xd800 && codePoint < 0xe000);
+        if (valid) {
+            out.append(text, i, length);
+            i += length;
+            continue;
+        }
+        if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\r') {
+            out += "\\r";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (c == '\\') {
+            out += "\\\\";
+        } else if (c < 0x20 || c >= 0x7f) {
+            char escaped[5];
+            snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+            out += escaped;
+        } else {
+            out += char(c);
+        }
+        i++;
+    }
+    return out;
+}
+
+static std::string sanitized(const std::string& text)
+{
+    std::string out = "untouched";
+    return sanitize(text.data(), text.size(), out) ? out : text;
+}
+
+TEST_CASE("Sanitize")
+{
+    SECTION("Nothing to escape")
+    {
+        std::string out = "untouched";
+        std::string text = "device ups-1 replied 42 after 1.5 ms, {\"status\": \"OL\"} ~";
+        CHECK(!sanitize(text.data(), text.size(), out));
+        CHECK(out == "untouched");
+        CHECK(sanitizeOffset(text.data(), text.size()) == text.size());
+
+        text = "température du capteur: 21°C, état ✓ 🙂";
+        CHECK(!sanitize(text.data(), text.size(), out));
+        CHECK(out == "untouched");
+    }
+
+    SECTION("Escapes")
+    {
+        CHECK(sanitized("line 1\nline 2") == "line 1\\nline 2");
+        CHECK(sanitized("a\r\n\tb") == "a\\r\\n\\tb");
+        CHECK(sanitized(std::string("nul\0bell\a del\x7f", 14)) == "nul\\x00bell\\x07 del\\x7f");
+        CHECK(sanitized("latin-1 \xe9t\xe9") == "latin-1 \\xe9t\\xe9");
+        CHECK(sanitized("overlong \xc0\xaf surrogate \xed\xa0\x80 cut \xe2\x82") ==
+              "overlong \\xc0\\xaf surrogate \\xed\\xa0\\x80 cut \\xe2\\x82");
+        CHECK(sanitized("long enough to be scanned by blocks\nthen a newline") ==
+              "long enough to be scanned by blocks\\nthen a newline");
+        CHECK(sanitizeOffset("0123456789abcdef0123\n", 21) == 20);
+        // Text looking like an escape is not confused with one
+        CHECK(sanitized("C:\\new\\temp") == "C:\\\\new\\\\temp");
+        CHECK(sanitized("escaped \\n, newline \n") == "escaped \\\\n, newline \\n");
+        CHECK(sanitizeOffset("0123456789abcdef0123\\", 21) == 20);
+    }
+
+    SECTION("Same result as the byte by byte reference")
+    {
+        std::mt19937 random(42);
+        // Mostly printable ASCII with some special and multi-byte bytes
+        static const char special[] = "\n\t\r\x01\x7f\x80\xbf\xc3\xa9\xe2\x82\xac\xf0\x9f\x99\x82\xed\xff\\";
+        const std::string alphabet = std::string("abcdefghijklmnopqrstuvwxyz 0123456789{}\":,", 42) +
+                                     std::string(special, sizeof(special) - 1);
+        for (int i = 0; i < 10000; i++) {
+            std::string text(random() % 100, ' ');
+            for (char& c : text) {
+                c = alphabet[random() % (random() % 8 ? 42 : alphabet.size())];
+            }
+            CHECK(sanitized(text) == reference(text));
+        }
+    }
+}
+
+TEST_CASE("Sanitized logger")
+{
+    Ftylog  log("fty-log-sanitize-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    auto appender = new fty::test::MessagesAppender;
+    fty::test::setOnlyAppender("fty-log-sanitize-test", appender);
+
+    log_info_log(ftylog, "reply: %s", "{\n  \"status\": \"OL\"\n}");
+    log.setSanitize(true);
+    log_info_log(ftylog, "reply: %s", "{\n  \"status\": \"OL\"\n}");
+    log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "raw {}", "\x1b[31mred");
+    log_info_log(ftylog, "clean message");
+
+    REQUIRE(appender->messages.size() == 4);
+    CHECK(appender->messages[0] == "reply: {\n  \"status\": \"OL\"\n}");
+    CHECK(appender->messages[1] == "reply: {\\n  \"status\": \"OL\"\\n}");
+    CHECK(appender->messages[2] == "raw \\x1b[31mred");
+    CHECK(appender->messages[3] == "clean message");
+
+    SECTION("No allocation")
+    {
+        fty::test::setOnlyAppender("fty-log-sanitize-test", new log4cplus::NullAppender);
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "warm up\n{}", 0);
+
+        fty::test::AllocationCounter counter;
+        for (int i = 0; i < 100; i++) {
+            log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "clean {}", i);
+            log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "escaped\n{}", i);
+        }
+        CHECK(counter.count() == 0);
+    }
+}
+
+TEST_CASE("Sanitize benchmark", "[.][benchmark]")
+{
+    const std::string ascii = "device ups-1 replied 42 after 1.5 ms while polling the input voltage of phase L1";
+    const std::string utf8  = "capteur « salle serveur » : température 21,5 °C, humidité 40 %, état ✓";
+    const std::string json  = "reply: {\n  \"status\": \"OL\",\n  \"load\": 42,\n  \"runtime\": 3600\n}";
+    const std::string reply = std::string("device reply: \x02\x10\x7f\xc3(\xff\r\n", 15) + ascii;
+    std::string       out;
+
+    BENCHMARK("byte by byte, plain ASCII")
+    {
+        return reference(ascii);
+    };
+    BENCHMARK("sanitize, plain ASCII")
+    {
+        return sanitize(ascii.data(), ascii.size(), out);
+    };
+    BENCHMARK("byte by byte, UTF-8")
+    {
+        return reference(utf8);
+    };
+    BENCHMARK("sanitize, UTF-8")
+    {
+        return sanitize(utf8.data(), utf8.size(), out);
+    };
+    BENCHMARK("byte by byte, JSON dump")
+    {
+        return reference(json);
+    };
+    BENCHMARK("sanitize, JSON dump")
+    {
+        return sanitize(json.data(), json.size(), out);
+    };
+    BENCHMARK("byte by byte, binary reply")
+    {
+        return reference(reply);
+    };
+    BENCHMARK("sanitize, binary reply")
+    {
+        return sanitize(reply.data(), reply.size(), out);
+    };
+
+    Ftylog log("fty-log-sanitize-bench");
+    log.setLogLevelTrace();
+    fty::test::setOnlyAppender("fty-log-sanitize-bench", new log4cplus::NullAppender);
+    const char* mix[] = {ascii.c_str(), utf8.c_str(), ascii.c_str(), json.c_str()};
+    int         i     = 0;
+
+    BENCHMARK("logger, message mix")
+    {
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "{}", mix[i++ % 4]);
+    };
+    log.setSanitize(true);
+    BENCHMARK("sanitized logger, message mix")
+    {
+        log.insertLogFmt(log4cplus::INFO_LOG_LEVEL, __FILE__, __LINE__, __func__, "{}", mix[i++ % 4]);
+    };
+}
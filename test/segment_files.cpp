@@ -0,0 +1,298 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_segment_files.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <log4cplus/fileappender.h>
+#include <log4cplus/helpers/property.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using fty::logger::SegmentFiles;
+using fty::logger::SegmentMerger;
+using fty::logger::SegmentRecord;
+
+static std::string testDirectory()
+{
+    char path[] = "/tmp/fty-log-segment-test-XXXXXX";
+    REQUIRE(mkdtemp(path));
+    return path;
+}
+
+static void removeDirectory(const std::string& directory)
+{
+    for (const std::string& path : fty::logger::segmentFiles(directory)) {
+        remove(path.c_str());
+    }
+    rmdir(directory.c_str());
+}
+
+// Merged events of the segments of a directory
+static std::vector<SegmentRecord> merge(const std::string& directory)
+{
+    SegmentMerger merger;
+    for (const std::string& path : fty::logger::segmentFiles(directory)) {
+        CHECK(merger.add(path));
+    }
+    std::vector<SegmentRecord> records;
+    SegmentRecord              record;
+    while (merger.next(record)) {
+        records.push_back(record);
+    }
+    CHECK(merger.truncated().empty());
+    return records;
+}
+
+static void writeLine(SegmentFiles& segments, int64_t timestampUs, const std::string& line)
+{
+    CHECK(segments.write(timestampUs, log4cplus::INFO_LOG_LEVEL, line.data(), line.size()));
+}
+
+TEST_CASE("Segment files")
+{
+    std::string directory = testDirectory();
+
+    SECTION("Events of all the threads merged in logging order")
+    {
+        Ftylog  log("fty-log-segment-test");
+        Ftylog* ftylog = &log;
+        log.setLogLevelTrace();
+        REQUIRE(log.setSegmentFiles(directory));
+
+        // The events are numbered in the order they are logged
+        std::mutex               order;
+        int                      next = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 1000; i++) {
+                    std::lock_guard<std::mutex> lock(order);
+                    log_info_log(ftylog, "event %d", next++);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        log.unsetSegmentFiles();
+
+        CHECK(fty::logger::segmentFiles(directory).size() == 8);
+        std::vector<SegmentRecord> records = merge(directory);
+        REQUIRE(records.size() == 8000);
+        for (size_t i = 0; i < records.size(); i++) {
+            std::string suffix = "event " + std::to_string(i) + "\n";
+            INFO(records[i].line);
+            REQUIRE(records[i].line.size() > suffix.size());
+            CHECK(records[i].line.compare(records[i].line.size() - suffix.size(), suffix.size(), suffix) == 0);
+            CHECK(records[i].level == log4cplus::INFO_LOG_LEVEL);
+            CHECK(records[i].sequence == i);
+            CHECK((i == 0 || records[i].timestampUs >= records[i - 1].timestampUs));
+        }
+    }
+
+    SECTION("Set again while threads log")
+    {
+        Ftylog  log("fty-log-segment-toggle");
+        Ftylog* ftylog = &log;
+        log.setLogLevelTrace();
+        auto appender = new fty::test::MessagesAppender;
+        fty::test::setOnlyAppender("fty-log-segment-toggle", appender);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 2000; i++) {
+                    log_info_log(ftylog, "event %d", i);
+                }
+            });
+        }
+        for (int i = 0; i < 20; i++) {
+            REQUIRE(log.setSegmentFiles(directory));
+            std::this_thread::yield();
+            // Returns once the events being written to the former segments are flushed
+            log.unsetSegmentFiles();
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        // Every event is either in a segment or in the appender
+        CHECK(merge(directory).size() + appender->messages.size() == 8000);
+    }
+
+    SECTION("Errors and exiting threads written at once")
+    {
+        auto segments = SegmentFiles::create(directory, "fty-log-segment-test");
+        REQUIRE(segments);
+
+        std::thread([&] {
+            writeLine(*segments, 1, "info\n");
+            std::string error = "error\n";
+            CHECK(segments->write(2, log4cplus::ERROR_LOG_LEVEL, error.data(), error.size()));
+            CHECK(merge(directory).size() == 2);
+
+            writeLine(*segments, 3, "buffered\n");
+            CHECK(merge(directory).size() == 2);
+        }).join();
+        CHECK(merge(directory).size() == 3);
+
+        writeLine(*segments, 4, "flushed\n");
+        segments->flush();
+        CHECK(merge(directory).size() == 4);
+    }
+
+    SECTION("Runs interleaved by timestamp")
+    {
+        auto first  = SegmentFiles::create(directory, "first");
+        auto second = SegmentFiles::create(directory, "second");
+        REQUIRE(first);
+        REQUIRE(second);
+        CHECK(first->runId() != second->runId());
+
+        writeLine(*first, 10, "a\n");
+        writeLine(*second, 20, "b\n");
+        writeLine(*first, 30, "c\n");
+        writeLine(*second, 25, "d\n");
+        // Within a run, the sequence prevails over the timestamp
+        writeLine(*first, 5, "e\n");
+        first.reset();
+        second.reset();
+
+        std::string merged;
+        for (const SegmentRecord& record : merge(directory)) {
+            merged += record.line;
+        }
+        CHECK(merged == "a\nb\nd\nc\ne\n");
+    }
+
+    SECTION("Child of a fork in a run of its own")
+    {
+        auto segments = SegmentFiles::create(directory, "fty-log-segment-test");
+        REQUIRE(segments);
+        writeLine(*segments, 1, "buffered before the fork\n");
+
+        pid_t pid = fork();
+        REQUIRE(pid != -1);
+        if (pid == 0) {
+            std::string error = "child\n";
+            _exit(segments->write(2, log4cplus::ERROR_LOG_LEVEL, error.data(), error.size()) ? 0 : 1);
+        }
+        int status = 0;
+        REQUIRE(waitpid(pid, &status, 0) == pid);
+        CHECK(WIFEXITED(status));
+        CHECK(WEXITSTATUS(status) == 0);
+
+        writeLine(*segments, 3, "parent\n");
+        uint64_t runId = segments->runId();
+        segments.reset();
+
+        CHECK(fty::logger::segmentFiles(directory).size() == 2);
+        std::vector<SegmentRecord> records = merge(directory);
+        REQUIRE(records.size() == 3);
+        CHECK(records[0].line == "buffered before the fork\n");
+        CHECK(records[0].runId == runId);
+        CHECK(records[0].sequence == 0);
+        CHECK(records[1].line == "child\n");
+        CHECK(records[1].runId != runId);
+        CHECK(records[1].sequence == 0);
+        CHECK(records[2].line == "parent\n");
+        CHECK(records[2].runId == runId);
+        CHECK(records[2].sequence == 1);
+    }
+
+    SECTION("Truncated segment merged up to its last complete record")
+    {
+        auto segments = SegmentFiles::create(directory, "fty-log-segment-test");
+        REQUIRE(segments);
+        for (int i = 0; i < 10; i++) {
+            writeLine(*segments, i, "event " + std::to_string(i) + "\n");
+        }
+        segments.reset();
+
+        std::vector<std::string> paths = fty::logger::segmentFiles(directory);
+        REQUIRE(paths.size() == 1);
+        struct stat st;
+        REQUIRE(stat(paths[0].c_str(), &st) == 0);
+        REQUIRE(truncate(paths[0].c_str(), st.st_size - 3) == 0);
+
+        SegmentMerger merger;
+        CHECK(merger.add(paths[0]));
+        SegmentRecord record;
+        int           count = 0;
+        while (merger.next(record)) {
+            CHECK(record.line == "event " + std::to_string(count) + "\n");
+            count++;
+        }
+        CHECK(count == 9);
+        CHECK(merger.truncated() == paths);
+    }
+
+    SECTION("Not a segment")
+    {
+        std::string path = directory + "/other" FTY_LOG_SEGMENT_EXTENSION;
+        FILE*       file = fopen(path.c_str(), "w");
+        fputs("not a segment\n", file);
+        fclose(file);
+
+        SegmentMerger merger;
+        CHECK(!merger.add(path));
+        CHECK(!merger.add(directory + "/missing" FTY_LOG_SEGMENT_EXTENSION));
+    }
+
+    CHECK(!SegmentFiles::create(directory + "/missing", "fty-log-segment-test"));
+    removeDirectory(directory);
+}
+
+TEST_CASE("Segment files benchmark", "[.][benchmark]")
+{
+    Ftylog  log("fty-log-segment-bench");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    std::string directory = testDirectory();
+    std::string path      = directory + "/shared.log";
+
+    auto logFromThreads = [&](int count) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < count; t++) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < 1000; i++) {
+                    log_info_log(ftylog, "device %s replied %d", "ups-1", i);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    };
+
+    for (int threads : {1, 2, 4, 8, 16}) {
+        log4cplus::helpers::Properties properties;
+        properties.setProperty("File", path);
+        properties.setProperty("ImmediateFlush", "false");
+        properties.setProperty("layout", "log4cplus::PatternLayout");
+        properties.setProperty("layout.ConversionPattern", LOGPATTERN);
+        fty::test::setOnlyAppender("fty-log-segment-bench", new log4cplus::FileAppender(properties));
+
+        BENCHMARK("Shared file, " + std::to_string(threads) + " threads x 1000 events")
+        {
+            logFromThreads(threads);
+        };
+        log4cplus::Logger::getInstance("fty-log-segment-bench").removeAllAppenders();
+        remove(path.c_str());
+
+        REQUIRE(log.setSegmentFiles(directory));
+        BENCHMARK("Segment files, " + std::to_string(threads) + " threads x 1000 events")
+        {
+            logFromThreads(threads);
+        };
+        log.unsetSegmentFiles();
+        removeDirectory(directory);
+        REQUIRE(mkdir(directory.c_str(), 0700) == 0);
+    }
+    rmdir(directory.c_str());
+}
@@ -0,0 +1,173 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_shared_layout.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <fstream>
+#include <log4cplus/spi/loggingevent.h>
+#include <sstream>
+
+using fty::logger::SharedPatternLayout;
+using fty::test::RenderingAppender;
+
+static log4cplus::SharedAppenderPtr renderingAppender(log4cplus::Layout* layout)
+{
+    log4cplus::SharedAppenderPtr appender(new RenderingAppender);
+    appender->setLayout(std::unique_ptr<log4cplus::Layout>(layout));
+    return appender;
+}
+
+static RenderingAppender& rendering(log4cplus::SharedAppenderPtr& appender)
+{
+    return static_cast<RenderingAppender&>(*appender);
+}
+
+TEST_CASE("Shared pattern layout")
+{
+    Ftylog  log("fty-log-shared-layout-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance("fty-log-shared-layout-test");
+    logger.removeAllAppenders();
+    logger.setAdditivity(false);
+
+    auto first  = renderingAppender(new SharedPatternLayout("%-5p %m%n"));
+    auto second = renderingAppender(new SharedPatternLayout("%-5p %m%n"));
+    auto other  = renderingAppender(new SharedPatternLayout("[%p] %m%n"));
+    auto plain  = renderingAppender(new log4cplus::PatternLayout("%-5p %m%n"));
+    logger.addAppender(first);
+    logger.addAppender(second);
+    logger.addAppender(other);
+    logger.addAppender(plain);
+
+    uint64_t renders = SharedPatternLayout::renderCount();
+    log_info_log(ftylog, "first %d", 1);
+    log_warning_log(ftylog, "second %d", 2);
+    log_warning_log(ftylog, "second %d", 2);
+
+    // once per event and distinct pattern
+    CHECK(SharedPatternLayout::renderCount() - renders == 6);
+
+    CHECK(rendering(first).output() == "INFO  first 1\nWARN  second 2\nWARN  second 2\n");
+    CHECK(rendering(second).output() == rendering(first).output());
+    CHECK(rendering(plain).output() == rendering(first).output());
+    CHECK(rendering(other).output() == "[INFO] first 1\n[WARN] second 2\n[WARN] second 2\n");
+
+    logger.removeAllAppenders();
+}
+
+TEST_CASE("Shared pattern layout of announced events only")
+{
+    SharedPatternLayout first("%M %m%n");
+    SharedPatternLayout second("%M %m%n");
+
+    // Same event object, timestamp, level, line and message
+    log4cplus::spi::InternalLoggingEvent event(
+        "fty-log-shared-layout-test", log4cplus::INFO_LOG_LEVEL, "message", "file.cpp", 1, "first");
+    std::ostringstream output;
+    uint64_t           renders = SharedPatternLayout::renderCount();
+    first.formatAndAppend(output, event);
+    event.setFunction("second");
+    second.formatAndAppend(output, event);
+    CHECK(output.str() == "first message\nsecond message\n");
+    CHECK(SharedPatternLayout::renderCount() - renders == 2);
+
+    // Announced, rendered once until announced again
+    output.str("");
+    SharedPatternLayout::newEvent(event);
+    first.formatAndAppend(output, event);
+    second.formatAndAppend(output, event);
+    event.setFunction("third");
+    SharedPatternLayout::newEvent(event);
+    first.formatAndAppend(output, event);
+    second.formatAndAppend(output, event);
+    CHECK(output.str() == "second message\nsecond message\nthird message\nthird message\n");
+    CHECK(SharedPatternLayout::renderCount() - renders == 4);
+}
+
+TEST_CASE("Layouts of the console appenders")
+{
+    Ftylog log("fty-log-shared-layout-console");
+    log4cplus::Logger logger = log4cplus::Logger::getInstance("fty-log-shared-layout-console");
+    auto              layout = [](const log4cplus::SharedAppenderPtr& appender) -> log4cplus::Layout& {
+        return *appender->getLayout();
+    };
+
+    // Alone, nothing to share
+    REQUIRE(logger.getAllAppenders().size() == 1);
+    CHECK(typeid(layout(logger.getAllAppenders()[0])) == typeid(log4cplus::PatternLayout));
+
+    logger.addAppender(renderingAppender(new SharedPatternLayout(LOGPATTERN)));
+    log.setConsoleNonBlocking(true);
+    for (const log4cplus::SharedAppenderPtr& appender : logger.getAllAppenders()) {
+        CHECK(typeid(layout(appender)) == typeid(SharedPatternLayout));
+    }
+    log.setConsoleNonBlocking(false);
+    logger.removeAllAppenders();
+}
+
+TEST_CASE("Shared pattern layout of a config file")
+{
+    remove("/tmp/fty-log-shared-layout-first.txt");
+    remove("/tmp/fty-log-shared-layout-second.txt");
+    {
+        Ftylog  log("fty-log-shared-layout-config", "test/conf/shared-layout-config.conf");
+        Ftylog* ftylog = &log;
+
+        uint64_t renders = SharedPatternLayout::renderCount();
+        log_info_log(ftylog, "configured %d", 1);
+        CHECK(SharedPatternLayout::renderCount() - renders == 1);
+        log4cplus::Logger::getInstance("fty-log-shared-layout-config").removeAllAppenders();
+    }
+
+    auto content = [](const char* path) {
+        std::ifstream     file(path);
+        std::stringstream text;
+        text << file.rdbuf();
+        return text.str();
+    };
+    std::string first = content("/tmp/fty-log-shared-layout-first.txt");
+    CHECK(first.find("configured 1\n") != std::string::npos);
+    CHECK(content("/tmp/fty-log-shared-layout-second.txt") == first);
+}
+
+TEST_CASE("Shared pattern layout benchmark", "[.][benchmark]")
+{
+    Ftylog  log("fty-log-shared-layout-bench");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance("fty-log-shared-layout-bench");
+    logger.setAdditivity(false);
+
+    const char* pattern = "[%-5p][%d][%-l][%t] %m%n";
+
+    for (int appenders : {1, 2, 4}) {
+        logger.removeAllAppenders();
+        for (int i = 0; i < appenders; i++) {
+            logger.addAppender(renderingAppender(new log4cplus::PatternLayout(pattern)));
+        }
+        BENCHMARK("PatternLayout, " + std::to_string(appenders) + " appender(s)")
+        {
+            log_info_log(ftylog, "device %s replied %d", "ups-1", 42);
+            for (auto& appender : logger.getAllAppenders()) {
+                rendering(appender).reset();
+            }
+        };
+
+        logger.removeAllAppenders();
+        for (int i = 0; i < appenders; i++) {
+            logger.addAppender(renderingAppender(new SharedPatternLayout(pattern)));
+        }
+        BENCHMARK("SharedPatternLayout, " + std::to_string(appenders) + " appender(s)")
+        {
+            log_info_log(ftylog, "device %s replied %d", "ups-1", 42);
+            for (auto& appender : logger.getAllAppenders()) {
+                rendering(appender).reset();
+            }
+        };
+    }
+    logger.removeAllAppenders();
+}
@@ -0,0 +1,321 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_shipping_appender.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <arpa/inet.h>
+#include <log4cplus/helpers/property.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using fty::logger::ShippingAppender;
+
+// Stand-in for the remote collector, decoding the frames it receives
+class TestCollector
+{
+public:
+    explicit TestCollector(uint16_t port = 0)
+    {
+        _listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in address = {};
+        address.sin_family         = AF_INET;
+        address.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+        address.sin_port           = htons(port);
+        REQUIRE(bind(_listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0);
+        REQUIRE(listen(_listener, 4) == 0);
+        socklen_t size = sizeof(address);
+        getsockname(_listener, reinterpret_cast<struct sockaddr*>(&address), &size);
+        _port   = ntohs(address.sin_port);
+        _thread = std::thread(&TestCollector::run, this);
+    }
+
+    ~TestCollector()
+    {
+        _stop = true;
+        _thread.join();
+        close(_listener);
+    }
+
+    uint16_t port() const
+    {
+        return _port;
+    }
+
+    // Wait until count lines were received
+    std::vector<std::string> waitLines(size_t count)
+    {
+        for (int i = 0; i < 500; i++) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_lines.size() >= count) {
+                    return _lines;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _lines;
+    }
+
+    size_t frames()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _frames;
+    }
+
+    size_t connections()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _connections;
+    }
+
+    bool valid()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _valid;
+    }
+
+private:
+    void run()
+    {
+        int         client = -1;
+        std::string received;
+        while (!_stop) {
+            struct pollfd ready = {client == -1 ? _listener : client, POLLIN, 0};
+            if (poll(&ready, 1, 10) != 1) {
+                continue;
+            }
+            if (client == -1) {
+                client = accept4(_listener, nullptr, nullptr, SOCK_CLOEXEC);
+                std::lock_guard<std::mutex> lock(_mutex);
+                _connections++;
+                continue;
+            }
+            char    buffer[65536];
+            ssize_t r = read(client, buffer, sizeof(buffer));
+            if (r <= 0) {
+                // A partial frame of a broken connection is discarded
+                close(client);
+                client = -1;
+                received.clear();
+                continue;
+            }
+            received.append(buffer, size_t(r));
+
+            std::string lines;
+            uint32_t    events;
+            long        size;
+            while ((size = fty::logger::decodeShippingFrame(received.data(), received.size(), lines, events)) > 0) {
+                received.erase(0, size_t(size));
+                std::lock_guard<std::mutex> lock(_mutex);
+                _frames++;
+                size_t count = 0;
+                for (size_t start = 0, end; (end = lines.find('\n', start)) != std::string::npos; start = end + 1) {
+                    _lines.push_back(lines.substr(start, end - start));
+                    count++;
+                }
+                _valid = _valid && count == events;
+            }
+            if (size < 0) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _valid = false;
+            }
+        }
+        if (client != -1) {
+            close(client);
+        }
+    }
+
+    int                      _listener;
+    uint16_t                 _port;
+    std::atomic<bool>        _stop{false};
+    std::thread              _thread;
+    std::mutex               _mutex;
+    std::vector<std::string> _lines;
+    size_t                   _frames      = 0;
+    size_t                   _connections = 0;
+    bool                     _valid       = true;
+};
+
+static log4cplus::helpers::Properties shippingProperties(uint16_t port, const std::string& spool)
+{
+    log4cplus::helpers::Properties properties;
+    properties.setProperty("Host", "127.0.0.1");
+    properties.setProperty("Port", std::to_string(port));
+    properties.setProperty("BatchSize", "10");
+    properties.setProperty("BatchDelayMs", "50");
+    properties.setProperty("ReconnectDelayMs", "20");
+    properties.setProperty("SpoolFile", spool);
+    properties.setProperty("layout", "log4cplus::PatternLayout");
+    properties.setProperty("layout.ConversionPattern", "%m%n");
+    return properties;
+}
+
+static std::vector<std::string> events(int from, int to)
+{
+    std::vector<std::string> lines;
+    for (int i = from; i < to; i++) {
+        lines.push_back("event " + std::to_string(i));
+    }
+    return lines;
+}
+
+TEST_CASE("Shipping appender")
+{
+    std::string spool = "/tmp/fty-log-shipping-test-" + std::to_string(getpid()) + ".spool";
+    remove(spool.c_str());
+    remove((spool + ".1").c_str());
+
+    Ftylog  log("fty-log-shipping-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+
+    SECTION("Batches")
+    {
+        TestCollector                  collector;
+        log4cplus::helpers::Properties properties = shippingProperties(collector.port(), spool);
+        properties.setProperty("BatchDelayMs", "10000");
+        auto* appender = new ShippingAppender(properties);
+        fty::test::setOnlyAppender("fty-log-shipping-test", appender);
+
+        // Held until the batch is full
+        for (int i = 0; i < 9; i++) {
+            log_info_log(ftylog, "event %d", i);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        CHECK(collector.frames() == 0);
+
+        log_info_log(ftylog, "event %d", 9);
+        CHECK(collector.waitLines(10) == events(0, 10));
+        CHECK(collector.frames() == 1);
+
+        for (int i = 10; i < 110; i++) {
+            log_info_log(ftylog, "event %d", i);
+        }
+        CHECK(collector.waitLines(110) == events(0, 110));
+        CHECK(collector.frames() <= 11);
+        CHECK(collector.valid());
+        CHECK(appender->sentEvents() == 110);
+
+        log4cplus::Logger::getInstance("fty-log-shipping-test").removeAllAppenders();
+    }
+
+    SECTION("Partial batch sent after the batch delay")
+    {
+        TestCollector collector;
+        fty::test::setOnlyAppender(
+            "fty-log-shipping-test", new ShippingAppender(shippingProperties(collector.port(), spool)));
+
+        // Not a literal 0, which would be taken for the va_list of insertLog()
+        int event = 0;
+        log_info_log(ftylog, "event %d", event);
+        CHECK(collector.waitLines(1) == events(0, 1));
+        CHECK(collector.valid());
+
+        log4cplus::Logger::getInstance("fty-log-shipping-test").removeAllAppenders();
+    }
+
+    SECTION("Batch which can't be compressed")
+    {
+        TestCollector                  collector;
+        log4cplus::helpers::Properties properties = shippingProperties(collector.port(), spool);
+        // Rejected by zlib
+        properties.setProperty("CompressionLevel", "42");
+        auto* appender = new ShippingAppender(properties);
+        log4cplus::SharedAppenderPtr appenderPtr(appender);
+        fty::test::setOnlyAppender("fty-log-shipping-test", appenderPtr);
+
+        for (int i = 0; i < 10; i++) {
+            log_info_log(ftylog, "event %d", i);
+        }
+        for (int i = 0; i < 200 && appender->droppedEvents() < 10; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        CHECK(appender->droppedEvents() == 10);
+        CHECK(appender->sentEvents() == 0);
+        CHECK(appender->spooledEvents() == 0);
+        CHECK(collector.frames() == 0);
+        CHECK(collector.valid());
+
+        log4cplus::Logger::getInstance("fty-log-shipping-test").removeAllAppenders();
+    }
+
+    SECTION("Frame of an oversized batch")
+    {
+        char     frame[16];
+        uint32_t header[4] = {htonl(FTY_LOG_SHIPPING_MAGIC), htonl(16), htonl(FTY_LOG_SHIPPING_MAX_BATCH + 1), htonl(1)};
+        memcpy(frame, header, sizeof(frame));
+        std::string lines;
+        uint32_t    count;
+        CHECK(fty::logger::decodeShippingFrame(frame, sizeof(frame), lines, count) == -1);
+        CHECK(lines.empty());
+    }
+
+    SECTION("Spool replayed on reconnection")
+    {
+        uint16_t port;
+        {
+            // Reserve a port nobody listens on
+            TestCollector unused;
+            port = unused.port();
+        }
+
+        auto* appender = new ShippingAppender(shippingProperties(port, spool));
+        log4cplus::SharedAppenderPtr appenderPtr(appender);
+        fty::test::setOnlyAppender("fty-log-shipping-test", appenderPtr);
+
+        auto slowest = std::chrono::steady_clock::duration::zero();
+        for (int i = 0; i < 50; i++) {
+            auto start = std::chrono::steady_clock::now();
+            log_info_log(ftylog, "event %d", i);
+            slowest = std::max(slowest, std::chrono::steady_clock::now() - start);
+        }
+        CHECK(slowest < std::chrono::milliseconds(50));
+        for (int i = 0; i < 200 && appender->spooledEvents() < 50; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        CHECK(appender->spooledEvents() == 50);
+        CHECK(!appender->connected());
+
+        {
+            TestCollector collector(port);
+            CHECK(collector.waitLines(50) == events(0, 50));
+            for (int i = 50; i < 60; i++) {
+                log_info_log(ftylog, "event %d", i);
+            }
+            CHECK(collector.waitLines(60) == events(0, 60));
+            CHECK(collector.valid());
+            struct stat st;
+            CHECK(stat(spool.c_str(), &st) == -1);
+        }
+
+        // Collector restarted: the batches logged meanwhile are not lost
+        for (int i = 60; i < 80; i++) {
+            log_info_log(ftylog, "event %d", i);
+        }
+        for (int i = 0; i < 200 && appender->spooledEvents() < 70; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        {
+            TestCollector collector(port);
+            for (int i = 80; i < 90; i++) {
+                log_info_log(ftylog, "event %d", i);
+            }
+            CHECK(collector.waitLines(30) == events(60, 90));
+            CHECK(collector.connections() == 1);
+        }
+        CHECK(appender->droppedEvents() == 0);
+
+        log4cplus::Logger::getInstance("fty-log-shipping-test").removeAllAppenders();
+    }
+
+    remove(spool.c_str());
+    remove((spool + ".1").c_str());
+}
@@ -0,0 +1,309 @@
+#define CATCH_CONFIG_DISABLE_EXCEPTIONS
+#include <catch2/catch.hpp>
+
+#include "fty-log/fty_shm_transport.h"
+#include "fty_log.h"
+#include "test_appender.h"
+#include <fstream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using fty::logger::ShmCollector;
+using fty::logger::ShmRecord;
+using fty::logger::ShmRing;
+using fty::logger::ShmTransport;
+
+static std::string testPrefix()
+{
+    return "fty-log-test-" + std::to_string(getpid());
+}
+
+static std::vector<std::string> readLines(const std::string& path)
+{
+    std::vector<std::string> lines;
+    std::ifstream            file(path);
+    for (std::string line; std::getline(file, line);) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+static ShmCollector::Options collectorOptions()
+{
+    ShmCollector::Options options;
+    options.prefix          = testPrefix();
+    options.output          = "/tmp/" + testPrefix() + ".log";
+    options.reorderWindowMs = 0;
+    remove(options.output.c_str());
+    return options;
+}
+
+TEST_CASE("Shared memory ring")
+{
+    auto ring = ShmRing::create("/" + testPrefix() + "-ring", 4096);
+    REQUIRE(ring);
+    auto reader = ShmRing::open("/" + testPrefix() + "-ring");
+    REQUIRE(reader);
+    ring->unlink();
+
+    std::vector<ShmRecord> records;
+
+    SECTION("Records go through")
+    {
+        CHECK(ring->write(1, log4cplus::INFO_LOG_LEVEL, "agent", "first\n", 6));
+        CHECK(ring->write(2, log4cplus::ERROR_LOG_LEVEL, "agent", "second\n", 7));
+        CHECK(!reader->empty());
+        CHECK(reader->read(records) == 2);
+        CHECK(reader->empty());
+
+        REQUIRE(records.size() == 2);
+        CHECK(records[0].timestampUs == 1);
+        CHECK(records[0].level == log4cplus::INFO_LOG_LEVEL);
+        CHECK(records[0].loggerName == "agent");
+        CHECK(records[0].line == "first\n");
+        CHECK(records[1].line == "second\n");
+    }
+
+    SECTION("Full ring refuses writes")
+    {
+        std::string line(100, 'x');
+        int         written = 0;
+        while (ring->write(written, log4cplus::INFO_LOG_LEVEL, "agent", line.data(), line.size())) {
+            written++;
+        }
+        CHECK(written > 0);
+        CHECK(reader->read(records) == size_t(written));
+        CHECK(ring->write(0, log4cplus::INFO_LOG_LEVEL, "agent", line.data(), line.size()));
+    }
+
+    SECTION("Records wrap around")
+    {
+        for (int i = 0; i < 1000; i++) {
+            std::string line(size_t(i % 300), char('a' + i % 26));
+            REQUIRE(ring->write(i, log4cplus::INFO_LOG_LEVEL, "agent", line.data(), line.size()));
+            records.clear();
+            REQUIRE(reader->read(records) == 1);
+            CHECK(records[0].timestampUs == i);
+            CHECK(records[0].line == line);
+        }
+    }
+}
+
+TEST_CASE("Shared memory collector")
+{
+    ShmCollector::Options options = collectorOptions();
+
+    auto first  = ShmRing::create(ShmTransport::ringName(options.prefix, 1), 4096);
+    auto second = ShmRing::create(ShmTransport::ringName(options.prefix, 2), 4096);
+    REQUIRE(first);
+    REQUIRE(second);
+
+    {
+        ShmCollector collector(options);
+        collector.poll();
+        CHECK(collector.ringCount() == 2);
+        CHECK(first->collectorAlive(ShmTransport::COLLECTOR_TIMEOUT_MS));
+
+        first->write(10, log4cplus::INFO_LOG_LEVEL, "a", "10\n", 3);
+        first->write(30, log4cplus::INFO_LOG_LEVEL, "a", "30\n", 3);
+        first->write(50, log4cplus::INFO_LOG_LEVEL, "a", "50\n", 3);
+        second->write(20, log4cplus::INFO_LOG_LEVEL, "b", "20\n", 3);
+        second->write(40, log4cplus::INFO_LOG_LEVEL, "b", "40\n", 3);
+
+        CHECK(collector.flush() == 5);
+    }
+
+    CHECK(readLines(options.output) == std::vector<std::string>{"10", "20", "30", "40", "50"});
+
+    first->unlink();
+    second->unlink();
+    remove(options.output.c_str());
+}
+
+TEST_CASE("Shared memory transport fallback")
+{
+    ShmCollector::Options options = collectorOptions();
+
+    Ftylog  log("fty-log-shm-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+    auto appender = new fty::test::MessagesAppender;
+    fty::test::setOnlyAppender("fty-log-shm-test", appender);
+
+    REQUIRE(log.setShmTransport(options.prefix));
+
+    // No collector: logged locally
+    log_info_log(ftylog, "without collector");
+    CHECK(appender->messages == std::vector<std::string>{"without collector"});
+
+    {
+        ShmCollector collector(options);
+        collector.poll();
+        CHECK(ShmTransport::get(options.prefix)->connected());
+
+        log_info_log(ftylog, "with collector");
+        CHECK(appender->messages.size() == 1);
+
+        collector.flush();
+    }
+
+    std::vector<std::string> lines = readLines(options.output);
+    REQUIRE(lines.size() == 1);
+    CHECK(lines[0].find("with collector") != std::string::npos);
+
+    log.unsetShmTransport();
+    remove(options.output.c_str());
+}
+
+TEST_CASE("Shared memory transport set again")
+{
+    ShmCollector::Options options = collectorOptions();
+
+    Ftylog  log("fty-log-shm-test");
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+    auto appender = new fty::test::MessagesAppender;
+    fty::test::setOnlyAppender("fty-log-shm-test", appender);
+
+    ShmCollector collector(options);
+    REQUIRE(log.setShmTransport(options.prefix));
+    collector.poll();
+    log_info_log(ftylog, "first ring");
+
+    // A new ring under the same name, attached on the next scan
+    log.unsetShmTransport();
+    REQUIRE(log.setShmTransport(options.prefix));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    collector.poll();
+    CHECK(collector.ringCount() == 1);
+    CHECK(ShmTransport::get(options.prefix)->connected());
+
+    log_info_log(ftylog, "second ring");
+    CHECK(appender->messages.empty());
+    collector.flush();
+
+    std::vector<std::string> lines = readLines(options.output);
+    REQUIRE(lines.size() == 2);
+    CHECK(lines[0].find("first ring") != std::string::npos);
+    CHECK(lines[1].find("second ring") != std::string::npos);
+
+    log.unsetShmTransport();
+    remove(options.output.c_str());
+}
+
+TEST_CASE("Shared memory transport in a forked child")
+{
+    ShmCollector::Options options = collectorOptions();
+    ShmCollector          collector(options);
+
+    auto transport = ShmTransport::get(options.prefix);
+    REQUIRE(transport);
+    collector.poll();
+    REQUIRE(transport->connected());
+
+    pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+        // The ring of the parent is not written by the child, which gets its own
+        bool detached = !transport->connected() && !transport->write(1, log4cplus::INFO_LOG_LEVEL, "child", "x\n", 2);
+        auto own      = ShmTransport::get(options.prefix);
+        bool separate = own && own != transport;
+        own.reset();
+        _exit(detached && separate ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0);
+
+    CHECK(transport->write(2, log4cplus::INFO_LOG_LEVEL, "parent", "parent\n", 7));
+    CHECK(collector.flush() == 1);
+    CHECK(readLines(options.output) == std::vector<std::string>{"parent"});
+
+    transport.reset();
+    remove(options.output.c_str());
+}
+
+// Run in the producer processes spawned by the next test case
+TEST_CASE("Shared memory transport producer", "[.]")
+{
+    const char* prefix = getenv("FTY_LOG_TEST_SHM_PREFIX");
+    const char* id     = getenv("FTY_LOG_TEST_SHM_ID");
+    if (!prefix || !id) {
+        return;
+    }
+
+    Ftylog  log(std::string("fty-log-shm-producer-") + id);
+    Ftylog* ftylog = &log;
+    log.setLogLevelTrace();
+    REQUIRE(log.setShmTransport(prefix));
+
+    // Wait for the collector to attach the ring of this process
+    auto transport = ShmTransport::get(prefix);
+    for (int i = 0; i < 500 && !transport->connected(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(transport->connected());
+
+    for (int i = 0; i < 1000; i++) {
+        log_info_log(ftylog, "producer %s message %d", id, i);
+        if (i % 100 == 0) {
+            // let the collector drain the ring
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    CHECK(transport->fallbacks() == 0);
+}
+
+TEST_CASE("Shared memory transport with several processes")
+{
+    const int             producers = 4;
+    ShmCollector::Options options   = collectorOptions();
+    ShmCollector          collector(options);
+    std::atomic<bool>     stop{false};
+    std::thread           collecting([&] {
+        collector.run(stop, 5);
+    });
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < producers; i++) {
+        pid_t pid = fork();
+        REQUIRE(pid != -1);
+        if (pid == 0) {
+            setenv("FTY_LOG_TEST_SHM_PREFIX", options.prefix.c_str(), 1);
+            setenv("FTY_LOG_TEST_SHM_ID", std::to_string(i).c_str(), 1);
+            execl("/proc/self/exe", "/proc/self/exe", "Shared memory transport producer", nullptr);
+            _exit(127);
+        }
+        children.push_back(pid);
+    }
+
+    for (pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        CHECK(WIFEXITED(status));
+        CHECK(WEXITSTATUS(status) == 0);
+    }
+
+    // Rings of dead producers are removed once drained
+    for (int i = 0; i < 500 && collector.ringCount() > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    stop = true;
+    collecting.join();
+    CHECK(collector.ringCount() == 0);
+
+    std::vector<int> next(producers, 0);
+    for (const std::string& line : readLines(options.output)) {
+        int id, message;
+        REQUIRE(sscanf(line.c_str() + line.find("producer "), "producer %d message %d", &id, &message) == 2);
+        REQUIRE(id >= 0);
+        REQUIRE(id < producers);
+        CHECK(message == next[size_t(id)]);
+        next[size_t(id)] = message + 1;
+    }
+    CHECK(next == std::vector<int>(producers, 1000));
+
+    remove(options.output.c_str());
+}
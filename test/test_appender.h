@@ -0,0 +1,79 @@
+#pragma once
+#include <log4cplus/appender.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/nullappender.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fty::test {
+
+// Appender keeping the raw messages of the events it receives
+class MessagesAppender : public log4cplus::Appender
+{
+public:
+    MessagesAppender()
+    {
+        messages.reserve(1024);
+    }
+
+    ~MessagesAppender() override
+    {
+        destructorImpl();
+    }
+
+    void close() override
+    {
+    }
+
+    std::vector<std::string> messages;
+
+protected:
+    void append(const log4cplus::spi::InternalLoggingEvent& event) override
+    {
+        messages.push_back(event.getMessage());
+    }
+};
+
+// Appender rendering the events with its layout into a string
+class RenderingAppender : public log4cplus::Appender
+{
+public:
+    ~RenderingAppender() override
+    {
+        destructorImpl();
+    }
+
+    void close() override
+    {
+    }
+
+    std::string output() const
+    {
+        return stream.str();
+    }
+
+    void reset()
+    {
+        stream.str("");
+    }
+
+protected:
+    void append(const log4cplus::spi::InternalLoggingEvent& event) override
+    {
+        layout->formatAndAppend(stream, event);
+    }
+
+    std::ostringstream stream;
+};
+
+// Replace the appenders of a logger by the given one, without forwarding to the root logger
+inline void setOnlyAppender(const std::string& loggerName, log4cplus::SharedAppenderPtr appender)
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(loggerName);
+    logger.removeAllAppenders();
+    logger.setAdditivity(false);
+    logger.addAppender(appender);
+}
+
+} // namespace fty::test
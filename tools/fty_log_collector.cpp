@@ -0,0 +1,124 @@
+/*  =========================================================================
+    fty-log-collector - Per-host collector of the shared memory log rings
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty-log-collector - Drains the shared memory rings of the agents using
+    the shared memory transport (Ftylog::setShmTransport or
+    BIOS_LOG_SHM_TRANSPORT=true) into one rotating log file.
+@end
+ */
+#include "fty-log/fty_shm_transport.h"
+#include <atomic>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static std::atomic<bool> stopRequested{false};
+
+static void onSignal(int)
+{
+    stopRequested = true;
+}
+
+static void usage(const char* program)
+{
+    printf("Usage: %s [options]\n"
+           "  -o, --output FILE        rotating log file (default %s)\n"
+           "  -s, --max-size BYTES     size triggering a rotation (default %llu)\n"
+           "  -b, --backups N          number of rotated files kept (default %u)\n"
+           "  -p, --prefix PREFIX      prefix of the rings to collect (default %s)\n"
+           "  -i, --interval MS        delay between two collection passes (default 50)\n"
+           "  -w, --reorder-window MS  delay to merge late events in timestamp order (default %u)\n"
+           "  -y, --sync-interval MS   maximum delay between two syncs of the file (default %u)\n"
+           "  -x, --index              maintain the index of the files (see fty-log-query)\n"
+           "  -h, --help               print this help\n",
+        program, fty::logger::ShmCollector::Options().output.c_str(),
+        static_cast<unsigned long long>(fty::logger::ShmCollector::Options().maxFileSize),
+        fty::logger::ShmCollector::Options().maxBackups, FTY_LOG_SHM_DEFAULT_PREFIX,
+        fty::logger::ShmCollector::Options().reorderWindowMs, fty::logger::ShmCollector::Options().syncIntervalMs);
+}
+
+int main(int argc, char* argv[])
+{
+    fty::logger::ShmCollector::Options options;
+    unsigned                           interval = 50;
+
+    static const struct option longOptions[] = {
+        {"output", required_argument, nullptr, 'o'},
+        {"max-size", required_argument, nullptr, 's'},
+        {"backups", required_argument, nullptr, 'b'},
+        {"prefix", required_argument, nullptr, 'p'},
+        {"interval", required_argument, nullptr, 'i'},
+        {"reorder-window", required_argument, nullptr, 'w'},
+        {"sync-interval", required_argument, nullptr, 'y'},
+        {"index", no_argument, nullptr, 'x'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:s:b:p:i:w:y:xh", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'o':
+                options.output = optarg;
+                break;
+            case 's':
+                options.maxFileSize = strtoull(optarg, nullptr, 10);
+                break;
+            case 'b':
+                options.maxBackups = unsigned(strtoul(optarg, nullptr, 10));
+                break;
+            case 'p':
+                options.prefix = optarg;
+                break;
+            case 'i':
+                interval = unsigned(strtoul(optarg, nullptr, 10));
+                break;
+            case 'w':
+                options.reorderWindowMs = unsigned(strtoul(optarg, nullptr, 10));
+                break;
+            case 'y':
+                options.syncIntervalMs = unsigned(strtoul(optarg, nullptr, 10));
+                break;
+            case 'x':
+                options.index = true;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    struct sigaction action = {};
+    action.sa_handler       = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    fty::logger::ShmCollector collector(options);
+    collector.run(stopRequested, interval);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/*  =========================================================================
+    fty-log-merge - Merge per-thread log segment files into one ordered log
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty-log-merge - Prints the events of segment files written by
+    Ftylog::setSegmentFiles (BIOS_LOG_SEGMENT_DIR) as one log: in sequence
+    order within a process, the processes being interleaved by timestamp.
+@end
+ */
+#include "fty-log/fty_segment_files.h"
+#include <cerrno>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static void usage(const char* program)
+{
+    printf("Usage: %s [options] FILE|DIRECTORY...\n"
+           "  -o, --output FILE    write the merged log to FILE (default: stdout)\n"
+           "  -h, --help           print this help\n"
+           "The segment files (*" FTY_LOG_SEGMENT_EXTENSION ") of the given directories are merged\n"
+           "with the given files.\n",
+        program);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* output = nullptr;
+
+    static const struct option longOptions[] = {
+        {"output", required_argument, nullptr, 'o'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:h", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'o':
+                output = optarg;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int                        status = EXIT_SUCCESS;
+    fty::logger::SegmentMerger merger;
+    for (int i = optind; i < argc; i++) {
+        struct stat st;
+        std::vector<std::string> paths;
+        if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+            paths = fty::logger::segmentFiles(argv[i]);
+        } else {
+            paths.push_back(argv[i]);
+        }
+        for (const std::string& path : paths) {
+            if (!merger.add(path)) {
+                fprintf(stderr, "%s: not a readable segment file\n", path.c_str());
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+
+    FILE* out = output ? fopen(output, "we") : stdout;
+    if (!out) {
+        fprintf(stderr, "%s: %s\n", output, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    fty::logger::SegmentRecord record;
+    while (merger.next(record)) {
+        fwrite(record.line.data(), 1, record.line.size(), out);
+    }
+    if (fflush(out) != 0 || (out != stdout && fclose(out) != 0)) {
+        fprintf(stderr, "%s: %s\n", output ? output : "stdout", strerror(errno));
+        status = EXIT_FAILURE;
+    }
+
+    for (const std::string& path : merger.truncated()) {
+        fprintf(stderr, "%s: ends with an incomplete record\n", path.c_str());
+    }
+    return status;
+}
@@ -0,0 +1,298 @@
+/*  =========================================================================
+    fty-log-query - Extract a time range, level or logger slice of log files
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty-log-query - Prints the events of log files written with an index
+    (fty::logger::IndexedFileAppender, fty-log-collector --index) selected
+    by time range, minimum level and logger, reading only the selected
+    parts of the files. The parts not described by the index (events not
+    indexed yet, blocks lost in a crash) are scanned line by line.
+@end
+ */
+#include "fty-log/fty_log_index.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <fcntl.h>
+#include <getopt.h>
+#include <log4cplus/loglevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static void usage(const char* program)
+{
+    printf("Usage: %s [options] FILE...\n"
+           "  -f, --from TIME      first time of the events (default: no limit)\n"
+           "  -t, --to TIME        last time of the events (default: no limit)\n"
+           "  -l, --level LEVEL    minimum level: TRACE, DEBUG, INFO, WARN, ERROR or FATAL\n"
+           "  -n, --logger NAME    only the events of this logger (repeatable)\n"
+           "  -h, --help           print this help\n"
+           "TIME is either a number of seconds since the epoch or a local time\n"
+           "formatted as YYYY-MM-DD HH:MM:SS[.ffffff] (or YYYY-MM-DDTHH:MM:SS[.ffffff]).\n"
+           "Files are printed in the order given: list rotated files oldest first.\n"
+           "The lines not described by the index are selected by the level and logger\n"
+           "names they contain, their time being only bounded by the indexed lines around.\n",
+        program);
+}
+
+// Time in microseconds since the epoch, false if not a valid time
+static bool parseTime(const char* text, int64_t& timestampUs)
+{
+    char*  end   = nullptr;
+    double epoch = strtod(text, &end);
+    if (end != text && *end == '\0') {
+        timestampUs = int64_t(epoch * 1000000);
+        return true;
+    }
+
+    struct tm   tm   = {};
+    const char* rest = strptime(text, "%Y-%m-%d %H:%M:%S", &tm);
+    if (!rest) {
+        rest = strptime(text, "%Y-%m-%dT%H:%M:%S", &tm);
+    }
+    if (!rest) {
+        return false;
+    }
+    int64_t fraction = 0;
+    if (*rest == '.') {
+        int64_t scale = 100000;
+        for (rest++; *rest >= '0' && *rest <= '9'; rest++, scale /= 10) {
+            fraction += (*rest - '0') * scale;
+        }
+    }
+    if (*rest != '\0') {
+        return false;
+    }
+    tm.tm_isdst = -1;
+    time_t seconds = mktime(&tm);
+    if (seconds == time_t(-1)) {
+        return false;
+    }
+    timestampUs = int64_t(seconds) * 1000000 + fraction;
+    return true;
+}
+
+static bool parseLevel(const char* text, int& level)
+{
+    static const struct
+    {
+        const char*         name;
+        log4cplus::LogLevel level;
+    } levels[] = {
+        {"TRACE", log4cplus::TRACE_LOG_LEVEL},
+        {"DEBUG", log4cplus::DEBUG_LOG_LEVEL},
+        {"INFO", log4cplus::INFO_LOG_LEVEL},
+        {"WARN", log4cplus::WARN_LOG_LEVEL},
+        {"ERROR", log4cplus::ERROR_LOG_LEVEL},
+        {"FATAL", log4cplus::FATAL_LOG_LEVEL},
+    };
+    for (const auto& entry : levels) {
+        if (strcasecmp(text, entry.name) == 0) {
+            level = entry.level;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Position of word in line as a whole word, npos if it does not appear
+static size_t findWord(const std::string& line, const std::string& word)
+{
+    for (size_t position = line.find(word); position != std::string::npos; position = line.find(word, position + 1)) {
+        size_t end = position + word.size();
+        if ((position == 0 || !isalnum(static_cast<unsigned char>(line[position - 1])))
+            && (end == line.size() || !isalnum(static_cast<unsigned char>(line[end])))) {
+            return position;
+        }
+    }
+    return std::string::npos;
+}
+
+// Whether a line of a part not described by the index is selected: the first
+// level name it contains is the level of its event, a line without one
+// continues the previous event
+static bool scannedLineSelected(const std::string& line, const fty::logger::LogIndexQuery& query, bool previous)
+{
+    static const struct
+    {
+        const char*         name;
+        log4cplus::LogLevel level;
+    } levels[] = {
+        {"TRACE", log4cplus::TRACE_LOG_LEVEL},
+        {"DEBUG", log4cplus::DEBUG_LOG_LEVEL},
+        {"INFO", log4cplus::INFO_LOG_LEVEL},
+        {"WARN", log4cplus::WARN_LOG_LEVEL},
+        {"ERROR", log4cplus::ERROR_LOG_LEVEL},
+        {"FATAL", log4cplus::FATAL_LOG_LEVEL},
+    };
+
+    size_t levelPosition = std::string::npos;
+    int    level         = 0;
+    for (const auto& entry : levels) {
+        size_t position = findWord(line, entry.name);
+        if (position < levelPosition) {
+            levelPosition = position;
+            level         = entry.level;
+        }
+    }
+    if (levelPosition == std::string::npos) {
+        return previous;
+    }
+    if (level < query.minLevel) {
+        return false;
+    }
+    return query.loggers.empty()
+        || std::any_of(query.loggers.begin(), query.loggers.end(), [&](const std::string& logger) {
+               return findWord(line, logger) != std::string::npos;
+           });
+}
+
+// Print the lines of a part not described by the index which are selected
+static void printScanned(FILE* file, const fty::logger::LogIndexGap& gap, const fty::logger::LogIndexQuery& query)
+{
+    if (fseeko(file, off_t(gap.offset), SEEK_SET) != 0) {
+        return;
+    }
+    bool     selected = true;
+    uint64_t left     = gap.size;
+    char*    line     = nullptr;
+    size_t   capacity = 0;
+    ssize_t  size;
+    while (left > 0 && (size = getline(&line, &capacity, file)) > 0) {
+        std::string text(line, size_t(std::min<uint64_t>(uint64_t(size), left)));
+        left -= text.size();
+        selected = scannedLineSelected(text, query, selected);
+        if (selected) {
+            fwrite(text.data(), 1, text.size(), stdout);
+        }
+    }
+    free(line);
+}
+
+// Print the selected parts of a log file, return false on error
+static bool printSelection(const char* path, const fty::logger::LogIndexQuery& query)
+{
+    FILE* file = fopen(path, "rbe");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    uint64_t    fileSize = fstat(fileno(file), &st) == 0 ? uint64_t(st.st_size) : 0;
+
+    std::vector<fty::logger::LogIndexRange> ranges;
+    std::vector<fty::logger::LogIndexGap>   gaps;
+    if (!fty::logger::queryLogIndex(fty::logger::logIndexPath(path), query, ranges, &gaps, fileSize)) {
+        fprintf(stderr, "%s: no readable index (%s)\n", path, fty::logger::logIndexPath(path).c_str());
+        fclose(file);
+        return false;
+    }
+
+    // Selected ranges and scanned gaps in the order of the file
+    std::vector<char> buffer(64 * 1024);
+    size_t            next = 0;
+    for (const fty::logger::LogIndexRange& range : ranges) {
+        for (; next < gaps.size() && gaps[next].offset < range.offset; next++) {
+            printScanned(file, gaps[next], query);
+        }
+        // The index may describe events not written yet
+        uint64_t offset = range.offset;
+        uint64_t end    = std::min(range.offset + range.size, fileSize);
+        while (offset < end) {
+            ssize_t r = pread(fileno(file), buffer.data(), std::min<uint64_t>(buffer.size(), end - offset),
+                off_t(offset));
+            if (r <= 0) {
+                break;
+            }
+            fwrite(buffer.data(), 1, size_t(r), stdout);
+            offset += uint64_t(r);
+        }
+    }
+    for (; next < gaps.size(); next++) {
+        printScanned(file, gaps[next], query);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    fty::logger::LogIndexQuery query;
+
+    static const struct option longOptions[] = {
+        {"from", required_argument, nullptr, 'f'},
+        {"to", required_argument, nullptr, 't'},
+        {"level", required_argument, nullptr, 'l'},
+        {"logger", required_argument, nullptr, 'n'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:t:l:n:h", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'f':
+                if (!parseTime(optarg, query.fromUs)) {
+                    fprintf(stderr, "invalid time: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                if (!parseTime(optarg, query.toUs)) {
+                    fprintf(stderr, "invalid time: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                if (!parseLevel(optarg, query.minLevel)) {
+                    fprintf(stderr, "invalid level: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n':
+                query.loggers.push_back(optarg);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = optind; i < argc; i++) {
+        if (!printSelection(argv[i], query)) {
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,127 @@
+/*  =========================================================================
+    fty-log-replay - Replay a captured logging activity and measure it
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+ */
+
+/*
+@header
+    fty-log-replay - Issues the logging activity of a capture file
+    (Ftylog::setCapture, BIOS_LOG_CAPTURE) again with a given log
+    configuration, and reports the throughput and the latency percentiles
+    of the logging calls.
+@end
+ */
+#include "fty-log/fty_log_capture.h"
+#include "fty_log.h"
+#include <getopt.h>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void usage(const char* program)
+{
+    printf("Usage: %s [options] CAPTURE\n"
+           "  -c, --config FILE    log configuration file (default: console output)\n"
+           "  -n, --logger NAME    name of the logger (default: agent of the capture)\n"
+           "  -p, --paced          issue the events at their captured pace (default: as fast as possible)\n"
+           "  -r, --repeat COUNT   replay the capture COUNT times (default: 1)\n"
+           "  -h, --help           print this help\n"
+           "The BIOS_LOG_* environment variables apply as for the agents (BIOS_LOG_LEVEL,\n"
+           "BIOS_LOG_PATTERN, BIOS_LOG_SHM_TRANSPORT, BIOS_LOG_SEGMENT_DIR, ...).\n"
+           "The report is printed on stderr.\n",
+        program);
+}
+
+int main(int argc, char* argv[])
+{
+    const char*                config = "";
+    const char*                logger = nullptr;
+    fty::logger::ReplayOptions options;
+
+    static const struct option longOptions[] = {
+        {"config", required_argument, nullptr, 'c'},
+        {"logger", required_argument, nullptr, 'n'},
+        {"paced", no_argument, nullptr, 'p'},
+        {"repeat", required_argument, nullptr, 'r'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:n:pr:h", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'c':
+                config = optarg;
+                break;
+            case 'n':
+                logger = optarg;
+                break;
+            case 'p':
+                options.paced = true;
+                break;
+            case 'r':
+                options.repeat = unsigned(atoi(optarg));
+                if (options.repeat == 0) {
+                    fprintf(stderr, "invalid count: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fty::logger::Capture capture;
+    if (!fty::logger::readCapture(argv[optind], capture)) {
+        fprintf(stderr, "%s: not a readable capture file\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    Ftylog log(logger ? logger : capture.agent.empty() ? "fty-log-replay" : capture.agent, config);
+    // The replay itself is not captured
+    log.unsetCapture();
+
+    fty::logger::ReplayResult result = fty::logger::replayCapture(log, capture, options);
+
+    std::set<uint32_t> threads;
+    for (const fty::logger::CaptureEvent& event : capture.events) {
+        threads.insert(event.thread);
+    }
+    double seconds = result.seconds > 0 ? result.seconds : 1e-9;
+    fprintf(stderr, "events:     %llu in %zu threads, %llu bytes of messages\n",
+        static_cast<unsigned long long>(result.events), threads.size(),
+        static_cast<unsigned long long>(result.bytes));
+    fprintf(stderr, "duration:   %.3f s\n", result.seconds);
+    fprintf(stderr, "throughput: %.0f events/s, %.2f MB/s\n", double(result.events) / seconds,
+        double(result.bytes) / seconds / 1e6);
+    fprintf(stderr, "latency:    p50 %llu ns, p90 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+        static_cast<unsigned long long>(result.percentile(50)), static_cast<unsigned long long>(result.percentile(90)),
+        static_cast<unsigned long long>(result.percentile(99)),
+        static_cast<unsigned long long>(result.percentile(99.9)),
+        static_cast<unsigned long long>(result.percentile(100)));
+    return EXIT_SUCCESS;
+}